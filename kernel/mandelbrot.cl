@@ -1,59 +1,940 @@
 /* (C) Copyright 2018 by Roland Bernard. All rights reserved. */
 #pragma OPENCL EXTENSION cl_khr_fp64 : enable
 
-__kernel void computeColors(__global uchar3* buffer,
-                            double2 delta,
-                            double2 topLeft,
+// Größe der Kacheln für computeIterationsPersistent (muss mit mandelbrot.cpp übereinstimmen)
+#define TILE_WIDTH 16
+#define TILE_HEIGHT 16
+// Exponent ab dem die Störungsrechnung in double rechnet (muss mit perturbation.hpp übereinstimmen)
+#define PERTURB_DOUBLE_EXP -900
+// Toleranz der Periodizität relativ zur Grösse eines Samples (muss mit mandelbrot.hpp übereinstimmen)
+#define PERIOD_TOLERANCE 1e-3
+// Abstand zum Rand der Hauptkardioide bei der Störungsrechnung (muss mit perturbation.hpp übereinstimmen)
+#define PERTURB_BULB_MARGIN 1e-12
+// Abstand zum Rand der Hauptkardioide bei double-double (muss mit native.hpp übereinstimmen)
+#define DD_BULB_MARGIN 1e-12
+
+// Werte im Iterations-Buffer für nicht entkommene Samples (muss mit native.hpp übereinstimmen)
+#define SMOOTH_ACTIVE -1.0f
+#define SMOOTH_INTERIOR -2.0f
+#define SMOOTH_PENDING -3.0f
+// Maximaler Abstand eines übernommenen Samples vom neuen Gitter (muss mit native.hpp übereinstimmen)
+#define REPROJECT_TOLERANCE 1e-3
+// Unterschied benachbarter Pixel ab dem sie verfeinert werden (muss mit native.hpp übereinstimmen)
+#define ADAPTIVE_THRESHOLD 1.0f
+// Mindestgrösse, Anzahl Proben und Klasse nicht füllbarer Samples beim Unterteilen (muss mit native.hpp übereinstimmen)
+#define SUBDIVIDE_MIN 6
+#define SUBDIVIDE_PROBES 5
+#define SUBDIVIDE_MIXED -2
+
+/* Varianten des Programmes (siehe mandelbrot::kernels): Mit USE_FLOAT iteriert computeIterations in
+ * float, der Iterations-Buffer und die Argumente bleiben double. Die Störungsrechnung und double-double
+ * gibt es dann nicht. Mit FIXED_SAMPLES ist die Anzahl Samples pro Pixel eine Konstante (siehe samplesOf).
+ * Die Formel (siehe nextZ) ist ohne Optionen z² + c, mit FORMULA_POWER=n z^n + c, mit FORMULA_SHIP das
+ * Burning Ship. Mit JULIA_X und JULIA_Y ist c fest und z beginnt beim Punkt des Samples (Julia-Menge).
+ */
+#ifdef USE_FLOAT
+typedef float real;
+typedef float2 real2;
+#define convert_real2 convert_float2
+#else
+typedef double real;
+typedef double2 real2;
+#define convert_real2 convert_double2
+#endif
+
+// Der Test der Hauptkardioide gilt nur für z² + c
+#if !defined(FORMULA_POWER) && !defined(FORMULA_SHIP) && !defined(JULIA_X)
+#define FORMULA_BULB
+#endif
+
+// Iterationen für die Färbung nach dem Entkommen, bei z^n würden mehr überlaufen (muss mit native_kernel.cpp übereinstimmen)
+#ifdef FORMULA_POWER
+#define FORMULA_TAIL 1
+#else
+#define FORMULA_TAIL 4
+#endif
+
+// Gibt die Anzahl Samples pro Pixel zurück, mit FIXED_SAMPLES als Konstante für aufgerollte Schleifen
+uint samplesOf(uint samples)
+{
+#ifdef FIXED_SAMPLES
+    return FIXED_SAMPLES;
+#else
+    return samples;
+#endif
+}
+
+// Gibt den geglätteten Iterationswert eines nach i Iterationen entkommenen Samples zurück
+float smoothOf(uint i,
+               real2 tmpZ)
+{
+    return (i + 1 - (.69314718055994530941723212145817656807550013436026f / native_sqrt(convert_float(tmpZ.y + tmpZ.x)) / .69314718055994530941723212145817656807550013436026f));
+}
+
+// Gibt die Farbe eines entkommenen Samples zurück, gewichtet mit weight
+float3 colorOf(float smooth,
+               float weight)
+{
+    return (float3)((native_sin(0.01f * smooth + 1) * 230 + 25) * weight,
+                    (native_sin(0.013f * smooth + 2) * 230 + 25) * weight,
+                    (native_sin(0.016f * smooth + 4) * 230 + 25) * weight);
+}
+
+/* Gibt das letzte Sample auf dem Gitter jedes step-ten Samples zurück, das nicht hinter dem Pixel x
+ * liegt, für Pixel ohne eigenes gerechnetes Sample (muss mit nativeLattice in native.hpp übereinstimmen)
+ */
+uint lattice(uint x,
+             uint samples,
+             uint step)
+{
+    return x*samples / step * step;
+}
+
+/* Gibt die Position des Samples id eines Aufrufes zurück. Ohne Liste liegen die Samples auf dem
+ * Gitter jedes step-ten Samples, sonst gehören je samples² Samples zu einem Pixel aus list.
+ */
+uint2 samplePos(uint id,
+                uint2 res,
+                uint step,
+                uint samples,
+                __global const uint* list)
+{
+    uint width;
+    uint pixel;
+
+    if(list != 0)
+    {
+        width = res.x / samples;
+        pixel = list[id / (samples * samples)];
+        id %= samples * samples;
+        return (uint2)(pixel % width, pixel / width) * samples + (uint2)(id % samples, id / samples);
+    }
+    width = (res.x + step - 1) / step;
+    return (uint2)(id % width, id / width) * step;
+}
+
+/* Gibt true zurück falls sich zwei Samples sichtbar unterscheiden: Nur eines ist vor iterationen
+ * entkommen, oder beide, aber mit mehr als ADAPTIVE_THRESHOLD Unterschied (wie nativeEdge in native.hpp)
+ */
+bool edge(float a,
+          uint countA,
+          float b,
+          uint countB,
+          uint iterationen)
+{
+    bool escapedA = a >= 0 && countA < iterationen;
+    bool escapedB = b >= 0 && countB < iterationen;
+
+    return escapedA != escapedB || (escapedA && fabs(a - b) > ADAPTIVE_THRESHOLD);
+}
+
+// Gibt z der nächsten Iteration mit der Formel der Variante zurück, tmpZ ist z² (komponentenweise)
+real2 nextZ(real2 z,
+            real2 tmpZ,
+            real2 c)
+{
+#if defined(FORMULA_POWER)
+    real2 w = z;
+    uint k;
+
+    for(k = 1; k < FORMULA_POWER; k++)
+        w = (real2)(w.x*z.x - w.y*z.y, w.x*z.y + w.y*z.x);
+    return w + c;
+#elif defined(FORMULA_SHIP)
+    return (real2)(tmpZ.x - tmpZ.y + c.x, 2*fabs(z.x*z.y) + c.y);
+#else
+    return (real2)(tmpZ.x - tmpZ.y + c.x, 2*z.x*z.y + c.y);
+#endif
+}
+
+// Weitere Iterationen für eine glattere Färbung, gibt z² (komponentenweise) zurück
+real2 smoothTail(real2 z,
+                 real2 c)
+{
+    real2 tmpZ = z * z;
+    uint e;
+
+    for (e=0; e<FORMULA_TAIL; ++e)
+    {
+        z = nextZ(z, tmpZ, c);
+        tmpZ.x = z.x*z.x;
+        tmpZ.y = z.y*z.y;
+    }
+    return tmpZ;
+}
+
+// Gibt true zurück falls c um mehr als margin in der Hauptkardioide oder im Kreis der Periode 2 liegt
+bool inBulb(real2 c,
+            real margin)
+{
+    real qx = c.x - (real)0.25;
+    real q = qx*qx + c.y*c.y;
+
+    return q*(q + qx) - (real)0.25*c.y*c.y < -margin || (c.x + 1)*(c.x + 1) + c.y*c.y - (real)0.0625 < -margin;
+}
+
+/* Iteriert das Sample g mit dem Punkt c und speichert das Ergebnis im Iterations-Buffer. Ist start 0,
+ * werden nur noch nicht gerechnete Samples (SMOOTH_PENDING, siehe reprojectSamples) iteriert, sonst
+ * nur nicht entkommene Samples ab ihrem gespeicherten z.
+ * Samples in der Hauptkardioide oder im Kreis der Periode 2 werden nicht iteriert, periodische
+ * Orbits werden erkannt sobald sie zu einem gespeicherten Punkt zurückkehren (Brent). Die Anzahl
+ * beider Fälle wird zu bulb und periodic addiert.
+ */
+void iterateSample(__global float* smooth,
+                   __global double2* state,
+                   __global uint* count,
+                   uint g,
+                   real2 c,
+                   real tolerance,
+                   uint start,
+                   uint iterationen,
+                   uint* bulb,
+                   uint* periodic)
+{
+    real2 z;
+    real2 tmpZ;
+    real2 saved;
+    real2 d;
+    uint i;
+    uint check;
+
+    if(start == 0)
+    {
+        if(smooth[g] != SMOOTH_PENDING)
+            return;
+#ifdef FORMULA_BULB
+        if(inBulb(c, 0))
+        {
+            smooth[g] = SMOOTH_INTERIOR;
+            count[g] = 0;
+            (*bulb)++;
+            return;
+        }
+#endif
+#ifdef JULIA_X
+        z = c;
+#else
+        z = (real2)(0.0, 0.0);
+#endif
+    }
+    else
+    {
+        if(smooth[g] != SMOOTH_ACTIVE)
+            return;
+        z = convert_real2(state[g]);
+    }
+#ifdef JULIA_X
+    c = (real2)(JULIA_X, JULIA_Y);
+#endif
+
+    tmpZ = z * z;
+    saved = z;
+    check = start + 1;
+
+    for(i = start; i < iterationen && tmpZ.y + tmpZ.x < 4; i++)
+    {
+        z = nextZ(z, tmpZ, c);
+        tmpZ.x = z.x*z.x;
+        tmpZ.y = z.y*z.y;
+
+        d = z - saved;
+        if(d.x*d.x + d.y*d.y < tolerance)
+        {
+            smooth[g] = SMOOTH_INTERIOR;
+            count[g] = i + 1;
+            (*periodic)++;
+            return;
+        }
+        if(i + 1 == check)
+        {
+            saved = z;
+            check *= 2;
+        }
+    }
+
+    count[g] = i;
+    if(i < iterationen)
+        smooth[g] = smoothOf(i, smoothTail(z, c));
+    else
+    {
+        // Nicht entkommene Samples können später fortgesetzt werden
+        smooth[g] = SMOOTH_ACTIVE;
+        state[g] = convert_double2(z);
+    }
+}
+
+/* Erstellt den Iterations-Buffer eines neuen Bildes, ein Sample pro Work-Item. Samples des letzten
+ * Bildes (old*, Auflösung oldRes) die genau auf dem neuen Gitter liegen werden übernommen, alle
+ * anderen mit SMOOTH_PENDING markiert. map bildet das neue Gitter auf das alte ab:
+ * alt = map.xy * neu + map.zw. Ist oldRes 0, wird nichts übernommen.
+ */
+__kernel void reprojectSamples(__global float* smooth,
+                               __global double2* state,
+                               __global uint* count,
+                               __global const float* oldSmooth,
+                               __global const double2* oldState,
+                               __global const uint* oldCount,
+                               uint2 res,
+                               uint2 oldRes,
+                               double4 map)
+{
+    uint g = get_global_id(0);
+    double2 f = map.xy * convert_double2((uint2)(g%res.x, g/res.x)) + map.zw;
+    double2 r = round(f);
+    uint o;
+
+    if(fabs(f.x - r.x) >= REPROJECT_TOLERANCE || fabs(f.y - r.y) >= REPROJECT_TOLERANCE
+       || r.x < 0 || r.y < 0 || r.x >= oldRes.x || r.y >= oldRes.y)
+    {
+        smooth[g] = SMOOTH_PENDING;
+        return;
+    }
+
+    o = convert_uint(r.y) * oldRes.x + convert_uint(r.x);
+    smooth[g] = oldSmooth[o];
+    state[g] = oldState[o];
+    count[g] = oldCount[o];
+}
+
+// Gibt das Quadrat der Toleranz der Periodizität für Samples im Abstand delta zurück
+double periodTolerance(double2 delta)
+{
+    double tolerance = min(fabs(delta.x), fabs(delta.y)) * PERIOD_TOLERANCE;
+
+    return tolerance * tolerance;
+}
+
+// Addiert die Zähler eines Work-Items zu counters
+void addCounters(__global uint* counters,
+                 uint bulb,
+                 uint periodic)
+{
+    if(bulb > 0)
+        atomic_add(&counters[0], bulb);
+    if(periodic > 0)
+        atomic_add(&counters[1], periodic);
+}
+
+/* Iteriert ein Sample pro Work-Item. Die Samples bilden ein Gitter mit der Auflösung res (Pixel
+ * mal samples) und dem Abstand delta, davon wird nur jedes step-te (in x und y) gerechnet, oder
+ * alle Samples der Pixel in list (siehe samplePos). Das Ergebnis wird im Iterations-Buffer
+ * (smooth, state, count) gespeichert und erst von colorImage gefärbt.
+ */
+__kernel void computeIterations(__global float* smooth,
+                                __global double2* state,
+                                __global uint* count,
+                                double2 delta,
+                                double2 topLeft,
+                                uint2 res,
+                                uint step,
+                                uint start,
+                                uint iterationen,
+                                __global uint* counters,
+                                uint samples,
+                                __global const uint* list)
+{
+    uint2 pos = samplePos(get_global_id(0), res, step, samplesOf(samples), list);
+    uint bulb = 0;
+    uint periodic = 0;
+
+    // Der Punkt wird in double berechnet, erst das Ergebnis wird (mit USE_FLOAT) gerundet
+    iterateSample(smooth, state, count, pos.y * res.x + pos.x, convert_real2(topLeft + delta * convert_double2(pos)),
+                  periodTolerance(delta), start, iterationen, &bulb, &periodic);
+    addCounters(counters, bulb, periodic);
+}
+
+/* Persistente Variante: Es werden nur so viele Work-Groups gestartet wie das Device gleichzeitig
+ * ausführen kann. Jede Work-Group holt sich über den Zähler next die nächste freie Kachel, bis
+ * alle Kacheln berechnet sind. So warten keine Work-Groups auf einzelne langsame Kacheln.
+ */
+__kernel void computeIterationsPersistent(__global float* smooth,
+                                          __global double2* state,
+                                          __global uint* count,
+                                          double2 delta,
+                                          double2 topLeft,
+                                          uint2 res,
+                                          uint step,
+                                          uint start,
+                                          uint iterationen,
+                                          __global uint* counters,
+                                          __global uint* next)
+{
+    __local uint tile;
+    uint2 grid = (res + (uint2)(step - 1)) / step;
+    uint2 tiles = (grid + (uint2)(TILE_WIDTH - 1, TILE_HEIGHT - 1)) / (uint2)(TILE_WIDTH, TILE_HEIGHT);
+    uint2 pos;
+    uint bulb = 0;
+    uint periodic = 0;
+    uint p;
+    real tolerance = periodTolerance(delta);
+
+    while(true)
+    {
+        // Nächste Kachel für die ganze Work-Group holen
+        if(get_local_id(0) == 0)
+            tile = atomic_inc(next);
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if(tile >= tiles.x * tiles.y)
+            break;
+
+        for(p = get_local_id(0); p < TILE_WIDTH * TILE_HEIGHT; p += get_local_size(0))
+        {
+            // Die Kacheln liegen auf dem Gitter jedes step-ten Samples
+            pos.x = ((tile % tiles.x) * TILE_WIDTH + p % TILE_WIDTH) * step;
+            pos.y = ((tile / tiles.x) * TILE_HEIGHT + p / TILE_WIDTH) * step;
+            if(pos.x < res.x && pos.y < res.y)
+                iterateSample(smooth, state, count, pos.y * res.x + pos.x, convert_real2(topLeft + delta * convert_double2(pos)),
+                              tolerance, start, iterationen, &bulb, &periodic);
+        }
+
+        // Alle müssen tile gelesen haben bevor es überschrieben wird
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    // Die Zähler werden erst am Ende addiert, so gibt es pro Work-Item höchstens zwei atomare Zugriffe
+    addCounters(counters, bulb, periodic);
+}
+
+/* 2D-Variante: Eine Work-Group ist ein Rechteck des Gitters jedes step-ten Samples, so haben ihre
+ * Work-Items ähnlich viele Iterationen. Jedes Work-Item rechnet per Samples einer Zeile im Abstand
+ * der Breite der Work-Group, benachbarte Work-Items bleiben so benachbarte Samples. Die Grösse der
+ * Work-Groups und per bestimmt der Auto-Tuner (mandelbrot::tune), y enthält den Offset des Streifens.
+ */
+__kernel void computeIterationsTiled(__global float* smooth,
+                                     __global double2* state,
+                                     __global uint* count,
+                                     double2 delta,
+                                     double2 topLeft,
+                                     uint2 res,
+                                     uint step,
+                                     uint start,
+                                     uint iterationen,
+                                     __global uint* counters,
+                                     uint per)
+{
+    uint2 grid = (res + (uint2)(step - 1)) / step;
+    uint first = get_group_id(0) * get_local_size(0) * per + get_local_id(0);
+    uint2 pos;
+    uint bulb = 0;
+    uint periodic = 0;
+    uint k;
+    real tolerance = periodTolerance(delta);
+
+    pos.y = get_global_id(1);
+    if(pos.y < grid.y)
+    {
+        for(k = 0; k < per; k++)
+        {
+            pos.x = first + k * get_local_size(0);
+            if(pos.x < grid.x)
+                iterateSample(smooth, state, count, pos.y * step * res.x + pos.x * step,
+                              convert_real2(topLeft + delta * convert_double2(pos * step)),
+                              tolerance, start, iterationen, &bulb, &periodic);
+        }
+    }
+    addCounters(counters, bulb, periodic);
+}
+
+/* Iteriert ein Sample pro Work-Item aus list (Index im Iterations-Buffer), wie computeIterations mit
+ * start 0. Damit rechnet mandelbrot::subdivide die Ränder aller Rechtecke einer Runde in einem Aufruf.
+ */
+__kernel void computeSampleList(__global float* smooth,
+                                __global double2* state,
+                                __global uint* count,
+                                double2 delta,
+                                double2 topLeft,
+                                uint2 res,
+                                uint iterationen,
+                                __global uint* counters,
+                                __global const uint* list)
+{
+    uint g = list[get_global_id(0)];
+    uint2 pos = (uint2)(g % res.x, g / res.x);
+    uint bulb = 0;
+    uint periodic = 0;
+
+    iterateSample(smooth, state, count, g, convert_real2(topLeft + delta * convert_double2(pos)),
+                  periodTolerance(delta), 0, iterationen, &bulb, &periodic);
+    addCounters(counters, bulb, periodic);
+}
+
+/* Gibt die Klasse eines Samples beim Unterteilen zurück: -1 für innen, die Iteration des Entkommens
+ * für vor iterationen entkommene Samples, sonst SUBDIVIDE_MIXED (wie nativeClass in native.hpp)
+ */
+int classOf(float smooth,
+            uint count,
+            uint iterationen)
+{
+    if(smooth == SMOOTH_INTERIOR)
+        return -1;
+    if(smooth >= 0 && count < iterationen)
+        return count;
+    return SUBDIVIDE_MIXED;
+}
+
+// Gibt die Position der Probe k eines Rechtecks (x0, y0, x1, y1) zurück (wie nativeProbe in native.hpp)
+uint2 probeOf(uint4 r,
+              uint k)
+{
+    const uint a[SUBDIVIDE_PROBES] = { 2, 1, 3, 1, 3 };
+    const uint b[SUBDIVIDE_PROBES] = { 2, 1, 1, 3, 3 };
+
+    return (uint2)(r.x + (r.z - r.x) * a[k] / 4, r.y + (r.w - r.y) * b[k] / 4);
+}
+
+/* Prüft den Rand eines Rechtecks (x0, y0, x1, y1 im Gitter jedes step-ten Samples) pro Work-Item und
+ * speichert seine Klasse in classes: die gemeinsame Klasse aller Samples des Randes, sonst
+ * SUBDIVIDE_MIXED. Mit check müssen auch die Proben (siehe probeOf) die selbe Klasse haben.
+ */
+__kernel void classifyRects(__global const float* smooth,
+                            __global const uint* count,
+                            __global const uint4* rects,
+                            __global int* classes,
                             uint2 res,
+                            uint step,
                             uint iterationen,
-                            uint samples)
+                            uint check)
+{
+    uint4 r = rects[get_global_id(0)];
+    uint g = r.y * step * res.x + r.x * step;
+    int c = classOf(smooth[g], count[g], iterationen);
+    uint2 p;
+    uint k;
+
+    for(p.x = r.x; p.x <= r.z && c != SUBDIVIDE_MIXED; p.x++)
+    {
+        uint top = r.y * step * res.x + p.x * step;
+        uint bottom = r.w * step * res.x + p.x * step;
+        if(classOf(smooth[top], count[top], iterationen) != c || classOf(smooth[bottom], count[bottom], iterationen) != c)
+            c = SUBDIVIDE_MIXED;
+    }
+    for(p.y = r.y + 1; p.y < r.w && c != SUBDIVIDE_MIXED; p.y++)
+    {
+        uint left = p.y * step * res.x + r.x * step;
+        uint right = p.y * step * res.x + r.z * step;
+        if(classOf(smooth[left], count[left], iterationen) != c || classOf(smooth[right], count[right], iterationen) != c)
+            c = SUBDIVIDE_MIXED;
+    }
+    for(k = 0; k < SUBDIVIDE_PROBES && check && c != SUBDIVIDE_MIXED; k++)
+    {
+        p = probeOf(r, k);
+        g = p.y * step * res.x + p.x * step;
+        if(classOf(smooth[g], count[g], iterationen) != c)
+            c = SUBDIVIDE_MIXED;
+    }
+
+    classes[get_global_id(0)] = c;
+}
+
+/* Füllt eine Zeile des Inneren eines gleichförmigen Rechtecks pro Work-Item (Rechteck, Zeile), nur
+ * Samples mit SMOOTH_PENDING: innen mit SMOOTH_INTERIOR, ein Band mit dem zwischen linkem und
+ * rechtem Rand interpolierten Wert (wie native::subdivideRect). Die Anzahl kommt nach counters[2].
+ */
+__kernel void fillRects(__global float* smooth,
+                        __global uint* count,
+                        __global const uint4* rects,
+                        __global const int* classes,
+                        uint2 res,
+                        uint step,
+                        __global uint* counters)
 {
-    double2 c;
-    double2 z;
-    double2 tmpZ;
+    uint4 r = rects[get_global_id(0)];
+    int c = classes[get_global_id(0)];
+    uint y = r.y + 1 + get_global_id(1);
+    uint row = y * step * res.x;
+    uint filled = 0;
+    uint x;
+    uint g;
+    float left;
+    float right;
+
+    if(c == SUBDIVIDE_MIXED || y >= r.w)
+        return;
+
+    left = smooth[row + r.x * step];
+    right = smooth[row + r.z * step];
+    for(x = r.x + 1; x < r.z; x++)
+    {
+        g = row + x * step;
+        if(smooth[g] != SMOOTH_PENDING)
+            continue;
+        smooth[g] = c < 0 ? SMOOTH_INTERIOR : left + (right - left) * (x - r.x) / (r.z - r.x);
+        count[g] = c < 0 ? 0 : c;
+        filled++;
+    }
+
+    if(filled > 0)
+        atomic_add(&counters[2], filled);
+}
+
+/* Färbt ein Pixel pro Work-Item aus dem Iterations-Buffer. Samples die erst nach iterationen
+ * entkommen sind bleiben schwarz, so muss beim Verringern der Iterationen nicht neu gerechnet werden.
+ * Jedes Pixel ist der Durchschnitt seiner gerechneten Samples, Pixel ohne eines übernehmen das
+ * vorherige auf dem Gitter jedes step-ten Samples (siehe lattice).
+ */
+__kernel void colorImage(__global uchar3* buffer,
+                         __global const float* smooth,
+                         __global const uint* count,
+                         uint2 res,
+                         uint samples,
+                         uint step,
+                         uint iterationen)
+{
+    uint2 pos = (uint2)(get_global_id(0)%res.x, get_global_id(0)/res.x);
+    uint width;
     uint2 s;
-    uint i;
-    float smooth;
-    uint e;
+    uint g;
+    uint n = 0;
     float3 tmp = (float3)(0.0, 0.0, 0.0);
-    double2 preC = topLeft + delta * (double2)(get_global_id(0)%res.x, get_global_id(0)/res.x);
 
+    samples = samplesOf(samples);
+    width = res.x * samples;
+    for(s.y = 0; s.y < samples; s.y++)
+        for(s.x = 0; s.x < samples; s.x++)
+        {
+            g = (pos.y * samples + s.y) * width + pos.x * samples + s.x;
+            if(smooth[g] == SMOOTH_PENDING)
+                continue;
+            n++;
+            if(smooth[g] >= 0 && count[g] < iterationen)
+                tmp += colorOf(smooth[g], 1.0f);
+        }
+
+    if(n == 0)
+    {
+        g = lattice(pos.y, samples, step) * width + lattice(pos.x, samples, step);
+        n = 1;
+        if(smooth[g] >= 0 && count[g] < iterationen)
+            tmp += colorOf(smooth[g], 1.0f);
+    }
+
+    buffer[get_global_id(0)] = convert_uchar3(tmp / n);
+}
+
+/* Sucht die Pixel deren erstes Sample sich sichtbar von dem eines der vier Nachbarn unterscheidet
+ * (siehe edge), ein Work-Item pro Pixel. Die Pixel werden über den Zähler length kompakt in list
+ * geschrieben, so rechnet der folgende Aufruf von computeIterations nur Kanten.
+ */
+__kernel void findEdges(__global const float* smooth,
+                        __global const uint* count,
+                        uint2 res,
+                        uint samples,
+                        uint iterationen,
+                        __global uint* list,
+                        __global uint* length)
+{
+    uint2 pos = (uint2)(get_global_id(0)%res.x, get_global_id(0)/res.x);
+    uint width;
+    uint g;
+    bool found = false;
+
+    samples = samplesOf(samples);
+    width = res.x * samples;
+    g = pos.y * samples * width + pos.x * samples;
+
+    if(pos.x > 0)
+        found |= edge(smooth[g], count[g], smooth[g - samples], count[g - samples], iterationen);
+    if(pos.x + 1 < res.x)
+        found |= edge(smooth[g], count[g], smooth[g + samples], count[g + samples], iterationen);
+    if(pos.y > 0)
+        found |= edge(smooth[g], count[g], smooth[g - samples * width], count[g - samples * width], iterationen);
+    if(pos.y + 1 < res.y)
+        found |= edge(smooth[g], count[g], smooth[g + samples * width], count[g + samples * width], iterationen);
+
+    if(found)
+        list[atomic_inc(length)] = get_global_id(0);
+}
+
+#ifndef USE_FLOAT
+
+// Gibt m * 2^e zurück, ohne Überlauf bei sehr grossen Differenzen
+double2 scaleExp(double2 m,
+                 int e)
+{
+    return e < -2000 ? (double2)(0.0, 0.0) : ldexp(m, e);
+}
+
+// Komplexe Zahl m * 2^e mit gemeinsamem Exponenten (siehe complexexp in perturbation.hpp)
+typedef struct
+{
+    double2 m;
+    int e;
+} cexp;
+
+cexp cexpMake(double2 m,
+              int e)
+{
+    cexp ret;
+    int ex;
+
+    ret.m = m;
+    ret.e = 0;
+    if(m.x != 0 || m.y != 0)
+    {
+        frexp(max(fabs(m.x), fabs(m.y)), &ex);
+        ret.m = ldexp(m, -ex);
+        ret.e = e + ex;
+    }
+    return ret;
+}
+
+cexp cexpMul(cexp a,
+             cexp b)
+{
+    return cexpMake((double2)(a.m.x*b.m.x - a.m.y*b.m.y, a.m.x*b.m.y + a.m.y*b.m.x), a.e + b.e);
+}
+
+cexp cexpAdd(cexp a,
+             cexp b)
+{
+    int E = max(a.e, b.e);
+    if(a.m.x == 0 && a.m.y == 0)
+        return b;
+    if(b.m.x == 0 && b.m.y == 0)
+        return a;
+    return cexpMake(scaleExp(a.m, a.e - E) + scaleExp(b.m, b.e - E), E);
+}
+
+/* Störungsrechnung für tiefe Zooms (siehe perturbation.cpp): orbit enthält den mit hoher Genauigkeit
+ * berechneten Orbit des Referenzpunktes in der Bildmitte. Jedes Sample iteriert nur seine Abweichung
+ * dz davon. Die ersten skip Iterationen werden mit der Reihenentwicklung dz = A dc + B dc² + C dc³
+ * übersprungen. Ist dz zu klein für double, wird es als Mantisse und Exponent gerechnet. Ist ein
+ * Punkt näher bei 0 als seine Abweichung, oder ist die Referenz zu Ende, wird auf den Anfang der
+ * Referenz umgesetzt, so dass keine Glitches entstehen. Punkte deutlich innerhalb der
+ * Hauptkardioide werden nicht iteriert, auf Periodizität wird nicht geprüft (siehe perturbation.cpp).
+ * Wie computeIterations wird ein Sample pro Work-Item in den Iterations-Buffer gerechnet (nur
+ * SMOOTH_PENDING, auf dem Gitter oder aus list), nicht entkommene Samples werden aber nicht fortgesetzt.
+ */
+__kernel void computePerturbation(__global float* smooth,
+                                  __global uint* count,
+                                  __global const double2* orbit,
+                                  uint orbitLength,
+                                  double2 deltaM,
+                                  int2 deltaE,
+                                  double2 refC,
+                                  uint2 res,
+                                  uint step,
+                                  uint iterationen,
+                                  uint skip,
+                                  double2 seriesA,
+                                  double2 seriesB,
+                                  double2 seriesC,
+                                  int4 seriesE,
+                                  __global uint* counters,
+                                  uint samples,
+                                  __global const uint* list)
+{
+    uint2 pos = samplePos(get_global_id(0), res, step, samples, list);
+    uint g = pos.y * res.x + pos.x;
+
+    // Abstand dc zum Referenzpunkt
+    double2 f = convert_double2(pos) - convert_double2(res) / 2;
+    int ce = max(deltaE.x, deltaE.y);
+    double2 cm = deltaM * f;
+    cexp dcE = cexpMake((double2)(ldexp(cm.x, deltaE.x - ce), ldexp(cm.y, deltaE.y - ce)), ce);
+    double2 dc = scaleExp(dcE.m, dcE.e);
+    cexp dzE;
+    double2 dz;
+    double2 z = (double2)(0.0, 0.0);
+    double2 Z;
+    uint m = 0;
+    uint i = 0;
+
+    if(smooth[g] != SMOOTH_PENDING)
+        return;
+
+    // Punkte deutlich innerhalb der Hauptkardioide oder des Kreises entkommen nie
+    if(inBulb(refC + dc, PERTURB_BULB_MARGIN))
+    {
+        smooth[g] = SMOOTH_INTERIOR;
+        count[g] = 0;
+        addCounters(counters, 1, 0);
+        return;
+    }
+
+    // Überspringen der ersten Iterationen mit der Reihenentwicklung
+    dzE = cexpMake((double2)(0.0, 0.0), 0);
+    if(skip > 0)
+    {
+        dzE = cexpMul(cexpMake(seriesC, seriesE.z), dcE);
+        dzE = cexpMul(cexpAdd(cexpMake(seriesB, seriesE.y), dzE), dcE);
+        dzE = cexpMul(cexpAdd(cexpMake(seriesA, seriesE.x), dzE), dcE);
+        i = skip;
+        m = skip;
+    }
+    if(dzE.m.x == 0 && dzE.m.y == 0)
+        dzE.e = dcE.e;
+
+    if(dzE.e < PERTURB_DOUBLE_EXP)
+    {
+        double2 dm = dzE.m;
+        int e = dzE.e;
+        int E;
 
-    for(s.x = 0; s.x < samples; s.x++)
-        for(s.y = 0; s.y < samples; s.y++)
+        for(; i < iterationen; i++)
         {
-            z = (double2)(0.0, 0.0);
-            tmpZ = z;
+            Z = orbit[m];
+            z = Z + scaleExp(dm, e);
+            if(z.x*z.x + z.y*z.y >= 4 || m == orbitLength - 1)
+                break;
 
-            c = preC + delta / samples * convert_double2(s);
+            E = max(e, dcE.e);
+            dzE = cexpMake(scaleExp(2*(double2)(Z.x*dm.x - Z.y*dm.y, Z.x*dm.y + Z.y*dm.x), e - E)
+                           + scaleExp((double2)(dm.x*dm.x - dm.y*dm.y, 2*dm.x*dm.y), 2*e - E)
+                           + scaleExp(dcE.m, dcE.e - E), E);
+            dm = dzE.m;
+            e = (dm.x == 0 && dm.y == 0) ? E : dzE.e;
+            m++;
 
-            for(i = 0; i < iterationen && tmpZ.y + tmpZ.x < 4; i++)
+            if(e > PERTURB_DOUBLE_EXP)
             {
-                z.y = z.x*z.y;
-                z.y += z.y + c.y;
-                z.x = tmpZ.x - tmpZ.y + c.x;
-                tmpZ.x = z.x*z.x;
-                tmpZ.y = z.y*z.y;
+                i++;
+                break;
             }
+        }
+        dz = scaleExp(dm, e);
+    }
+    else
+        dz = scaleExp(dzE.m, dzE.e);
 
-            for (e=0; e<4; ++e)
-            {
-                z.y = 2*z.x*z.y + c.y;
-                z.x = tmpZ.x - tmpZ.y + c.x;
-                tmpZ.x = z.x*z.x;
-                tmpZ.y = z.y*z.y;
-            }
+    for(; i < iterationen; i++)
+    {
+        Z = orbit[m];
+        z = Z + dz;
+        double r2 = z.x*z.x + z.y*z.y;
+        if(r2 >= 4)
+            break;
 
-            if(i < iterationen)
-            {
-                smooth = (i + 1 - (.69314718055994530941723212145817656807550013436026f / native_sqrt(convert_float(tmpZ.y + tmpZ.x)) / .69314718055994530941723212145817656807550013436026f));
+        if(r2 < dz.x*dz.x + dz.y*dz.y || m == orbitLength - 1)
+        {
+            dz = z;
+            Z = (double2)(0.0, 0.0);
+            m = 0;
+        }
 
-                tmp += (float3)((native_sin(0.01f * smooth + 1) * 230 + 25)  / samples / samples,
-                                (native_sin(0.013f * smooth + 2) * 230 + 25)  / samples / samples,
-                                (native_sin(0.016f * smooth + 4) * 230 + 25) / samples / samples);
-            }
+        dz = 2*(double2)(Z.x*dz.x - Z.y*dz.y, Z.x*dz.y + Z.y*dz.x)
+             + (double2)(dz.x*dz.x - dz.y*dz.y, 2*dz.x*dz.y) + dc;
+        m++;
+    }
+
+    count[g] = i;
+    smooth[g] = i < iterationen ? smoothOf(i, smoothTail(z, refC + dc)) : SMOOTH_ACTIVE;
+}
+
+/* Zahlen in double-double: x + y mit |y| höchstens ein halbes ulp von x, etwa 106 Bit
+ * (wie dd in native_kernel.cpp)
+ */
+double2 twoSum(double a,
+               double b)
+{
+    double s = a + b;
+    double v = s - a;
+
+    return (double2)(s, (a - (s - v)) + (b - v));
+}
+
+// Wie twoSum, nur für |a| >= |b|
+double2 quickTwoSum(double a,
+                    double b)
+{
+    double s = a + b;
+
+    return (double2)(s, b - (s - a));
+}
 
+double2 ddAdd(double2 a,
+              double2 b)
+{
+    double2 s = twoSum(a.x, b.x);
+
+    return quickTwoSum(s.x, s.y + a.y + b.y);
+}
+
+double2 ddMul(double2 a,
+              double2 b)
+{
+    double p = a.x * b.x;
+
+    return quickTwoSum(p, fma(a.x, b.x, -p) + (a.x*b.y + a.y*b.x));
+}
+
+double2 ddMulD(double2 a,
+               double b)
+{
+    double p = a.x * b;
+
+    return quickTwoSum(p, fma(a.x, b, -p) + a.y*b);
+}
+
+/* Iteriert ein Sample pro Work-Item in double-double, für Zooms zu tief für double aber zu flach für
+ * die Störungsrechnung. delta und topLeft enthalten x und y je als double-double (hi, lo). Wie
+ * computePerturbation werden nur Samples mit SMOOTH_PENDING gerechnet und nicht entkommene Samples
+ * nicht fortgesetzt. Der Test der Hauptkardioide ist nur in double, mit DD_BULB_MARGIN.
+ */
+__kernel void computeIterationsDD(__global float* smooth,
+                                  __global uint* count,
+                                  double4 delta,
+                                  double4 topLeft,
+                                  uint2 res,
+                                  uint step,
+                                  uint iterationen,
+                                  __global uint* counters,
+                                  uint samples,
+                                  __global const uint* list)
+{
+    uint2 pos = samplePos(get_global_id(0), res, step, samples, list);
+    uint g = pos.y * res.x + pos.x;
+    double2 cx = ddAdd(topLeft.xy, ddMulD(delta.xy, pos.x));
+    double2 cy = ddAdd(topLeft.zw, ddMulD(delta.zw, pos.y));
+    double tolerance = periodTolerance(delta.xz);
+    double2 zx = (double2)(0.0, 0.0);
+    double2 zy = zx;
+    double2 zx2 = zx;
+    double2 zy2 = zx;
+    double2 sx = zx;
+    double2 sy = zx;
+    double2 d;
+    uint i;
+    uint check = 1;
+
+    if(smooth[g] != SMOOTH_PENDING)
+        return;
+
+    if(inBulb((double2)(cx.x, cy.x), DD_BULB_MARGIN))
+    {
+        smooth[g] = SMOOTH_INTERIOR;
+        count[g] = 0;
+        addCounters(counters, 1, 0);
+        return;
+    }
+
+    for(i = 0; i < iterationen && zx2.x + zy2.x < 4; i++)
+    {
+        zy = ddAdd(2*ddMul(zx, zy), cy);
+        zx = ddAdd(ddAdd(zx2, -zy2), cx);
+        zx2 = ddMul(zx, zx);
+        zy2 = ddMul(zy, zy);
+
+        // Der Abstand ist klein gegenüber z, die Differenz der hi und lo reicht
+        d = (double2)(zx.x - sx.x, zy.x - sy.x) + (double2)(zx.y - sx.y, zy.y - sy.y);
+        if(d.x*d.x + d.y*d.y < tolerance)
+        {
+            smooth[g] = SMOOTH_INTERIOR;
+            count[g] = i + 1;
+            addCounters(counters, 0, 1);
+            return;
         }
+        if(i + 1 == check)
+        {
+            sx = zx;
+            sy = zy;
+            check *= 2;
+        }
+    }
 
-        buffer[get_global_id(0)] = convert_uchar3(tmp);
+    // Für die Färbung reicht double
+    count[g] = i;
+    smooth[g] = i < iterationen ? smoothOf(i, smoothTail((double2)(zx.x, zy.x), (double2)(cx.x, cy.x))) : SMOOTH_ACTIVE;
 }
+
+#endif
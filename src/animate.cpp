@@ -0,0 +1,507 @@
+/*  animate.cpp
+ * Name: Mandelbrot-Animation
+ * Berechnet eine Zoom-Fahrt als Folge von Bildern ohne Fenster. Zwischen zwei Schlüsselbildern wird
+ * exponentiell gezoomt. Liegt das Ziel innerhalb des Start-Bildes und gibt es genug Bilder pro
+ * Verdopplung des Zooms, wird nur dafür je ein Bild mit doppelter Auflösung berechnet und alle
+ * Bilder dazwischen daraus verkleinert.
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ */
+
+#include <iostream>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+#include "mandelbrot.hpp"
+#include "image.hpp"
+
+// Konstanten
+    // Default-Werte
+#define DEF_WIDTH 1280
+#define DEF_HEIGHT 720
+#define DEF_ITERATIONEN 1000
+#define DEF_SAMPLES 1
+#define DEF_FRAMES 300
+#define DEF_OUTPUT "frame%05d.png"
+
+    // Auflösung der Schlüsselbilder pro Verdopplung des Zooms relativ zu den Bildern
+#define KEY_SCALE 2
+
+// Ein Abschnitt der Fahrt von a nach b
+struct segment
+{
+    mandelbrot::deep a;     // Fläche am Anfang
+    mandelbrot::deep b;     // Fläche am Ende
+    floatexp dx;            // a.x - b.x
+    floatexp dy;            // a.y - b.y
+    double zoom;            // log2(a.w / b.w), die Anzahl Verdopplungen des Zooms
+    size_t frames;          // Anzahl Bilder von a (inklusive) bis b (exklusive)
+    bool nested;            // true falls jedes Bild innerhalb der vorherigen liegt
+};
+
+// Abbildung der Pixel eines Bildes auf die eines Schlüsselbildes: u = o + (p + 0.5) * s
+struct keyMap
+{
+    double ox;
+    double oy;
+    double sx;
+    double sy;
+};
+
+// Gibt die Verwendung aus
+static void usage()
+{
+    std::cout << "Usage: animate [options]\n"
+                << "  -o PATTERN          output files, printf pattern (default " << DEF_OUTPUT << ")\n"
+                << "  --size WxH          resolution in pixels (default " << DEF_WIDTH << "x" << DEF_HEIGHT << ")\n"
+                << "  --from X Y W        center and width at the start (any precision)\n"
+                << "  --to X Y W          center and width at the end\n"
+                << "  --frames N          number of frames from start to end (default " << DEF_FRAMES << ")\n"
+                << "  --keys FILE         keyframes instead of --from/--to, one \"X Y W N\" per line,\n"
+                << "                      N frames lead from the previous keyframe to this one\n"
+                << "  --iter N            maximum number of iterations (default " << DEF_ITERATIONEN << ")\n"
+                << "  --samples N         samples per pixel in x and y (default " << DEF_SAMPLES << ")\n"
+                << "  --direct            always compute every frame instead of downsampling keyframes\n"
+                << "  --cpu               use the native backend instead of OpenCL\n"
+                << "  --multi             use all OpenCL devices and the native backend\n"
+                << "  --adaptive          adaptive supersampling (only edges get all samples)\n"
+                << "  --double            always iterate in double precision (no float for shallow views)\n"
+                << "  --no-dd             use perturbation instead of double-double for moderately deep views\n"
+                << "  --julia X Y         Julia set of the point X + iY instead of the Mandelbrot set\n"
+                << "  --power N           iterate z^N + c (2 to " << FORMULA_MAX_POWER << ")\n"
+                << "  --burning-ship      iterate the Burning Ship (|Re z| + i|Im z|)^2 + c\n";
+}
+
+/* Erstellt eine Fläche aus Mittelpunkt und Breite, die Höhe folgt aus dem Seitenverhältnis
+ * @return false falls die Werte ungültig sind
+ */
+static bool parseArea(const char* x, const char* y, const char* w, mandelbrot::res res, mandelbrot::deep& area)
+{
+    double width = atof(w);
+
+    if(!(width > 0))
+        return false;
+    area.w = floatexp(width);
+    area.h = floatexp(-width * res.y / res.x);
+    size_t limbs = bigfloat::limbsFor(area.w / floatexp((double)res.x));
+    area.x = bigfloat::fromString(x, limbs);
+    area.y = bigfloat::fromString(y, limbs);
+    return true;
+}
+
+// Gibt |v| zurück
+static floatexp absolute(floatexp v)
+{
+    v.m = fabs(v.m);
+    return v;
+}
+
+// Erstellt einen Abschnitt von a nach b mit n Bildern
+static segment makeSegment(const mandelbrot::deep& a, const mandelbrot::deep& b, size_t n)
+{
+    segment s;
+
+    s.a = a;
+    s.b = b;
+    s.frames = n;
+    s.dx = (a.x - b.x).toFloatexp();
+    s.dy = (a.y - b.y).toFloatexp();
+    s.zoom = (a.w / b.w).log2();
+    // Das Ziel muss ganz im Start-Bild liegen, dann liegt jedes Bild im vorherigen
+    s.nested = s.zoom > 0 && !(absolute(a.w - b.w) * floatexp(0.5) < absolute(s.dx))
+                          && !(absolute(a.h - b.h) * floatexp(0.5) < absolute(s.dy));
+    return s;
+}
+
+/* Gibt den Anteil des Weges g(t) = (w(t) - b.w) / (a.w - b.w) multipliziert mit 2^k zurück, der
+ * Mittelpunkt ist dann b + (a - b) * g. So bleibt der Zielpunkt an der selben Stelle im Bild.
+ */
+static double pathFraction(const segment& s, double t, double k)
+{
+    if(s.zoom == 0)
+        return (1 - t) * exp2(k);
+    return (exp2(k - t * s.zoom) - exp2(k - s.zoom)) / (1 - exp2(-s.zoom));
+}
+
+/* Gibt die Fläche zum Zeitpunkt t zurück, die Breite ändert sich exponentiell
+ * @param s Der Abschnitt
+ * @param res Die Auflösung, für die Genauigkeit des Mittelpunktes
+ * @param t Der Zeitpunkt (0 für a, 1 für b, grösser für weiter als b)
+ */
+static mandelbrot::deep frameArea(const segment& s, mandelbrot::res res, double t)
+{
+    mandelbrot::deep ret;
+    double l = -t * s.zoom;
+    floatexp scale(exp2(l - floor(l)), (long)floor(l));
+    floatexp g(pathFraction(s, t, 0));
+
+    ret.w = s.a.w * scale;
+    ret.h = s.a.h * scale;
+    size_t limbs = bigfloat::limbsFor(ret.w / floatexp((double)res.x));
+    ret.x = s.b.x;
+    ret.y = s.b.y;
+    ret.x.setLimbs(limbs);
+    ret.y.setLimbs(limbs);
+    ret.x = ret.x + s.dx * g;
+    ret.y = ret.y + s.dy * g;
+    return ret;
+}
+
+/* Gibt die Abbildung eines Bildes zum Zeitpunkt t auf das Schlüsselbild k zurück. Das Schlüsselbild
+ * k ist frameArea beim Zeitpunkt k / s.zoom mit KEY_SCALE mal der Auflösung.
+ */
+static keyMap mapToKey(const segment& s, mandelbrot::res res, double t, size_t k)
+{
+    keyMap m;
+    double kx = (double)res.x * KEY_SCALE;
+    double ky = (double)res.y * KEY_SCALE;
+    // Die Differenz der Mittelpunkte, relativ zur Breite des Schlüsselbildes
+    double g = pathFraction(s, t, k) - pathFraction(s, k / s.zoom, k);
+    double scale = exp2(k - t * s.zoom);
+
+    m.sx = scale * KEY_SCALE;
+    m.sy = scale * KEY_SCALE;
+    m.ox = kx / 2 + (s.dx / s.a.w).toDouble() * g * kx - res.x / 2.0 * m.sx;
+    m.oy = ky / 2 + (s.dy / s.a.h).toDouble() * g * ky - res.y / 2.0 * m.sy;
+    return m;
+}
+
+/* Interpoliert die Farbe des Schlüsselbildes an der Stelle (u, v) bilinear
+ * @param ret Die Farbe wird hier addiert (r, g, b)
+ */
+static void sample(const mandelbrot::color* key, mandelbrot::res kres, double u, double v, float* ret)
+{
+    double fx = std::min(std::max(u - 0.5, 0.0), kres.x - 1.0);
+    double fy = std::min(std::max(v - 0.5, 0.0), kres.y - 1.0);
+    size_t x0 = (size_t)fx;
+    size_t y0 = (size_t)fy;
+    size_t x1 = std::min(x0 + 1, kres.x - 1);
+    size_t y1 = std::min(y0 + 1, kres.y - 1);
+    float ax = fx - x0;
+    float ay = fy - y0;
+    const mandelbrot::color* c[4] = { key + y0*kres.x + x0, key + y0*kres.x + x1, key + y1*kres.x + x0, key + y1*kres.x + x1 };
+    float w[4] = { (1 - ax)*(1 - ay), ax*(1 - ay), (1 - ax)*ay, ax*ay };
+
+    for(int i = 0; i < 4; i++)
+    {
+        ret[0] += w[i] * c[i]->r;
+        ret[1] += w[i] * c[i]->g;
+        ret[2] += w[i] * c[i]->b;
+    }
+}
+
+/* Setzt ein Bild aus zwei Schlüsselbildern zusammen. Wo das innere (feinere) Schlüsselbild das
+ * Pixel ganz enthält, wird dieses benutzt, sonst das äussere. Jedes Pixel ist der Durchschnitt
+ * von n² bilinearen Samples, mit n so dass die Samples höchstens zwei Pixel auseinander liegen.
+ */
+static void composeFrame(mandelbrot::color* ret, mandelbrot::res res, const mandelbrot::color* outer, keyMap mo,
+                         const mandelbrot::color* inner, keyMap mi, mandelbrot::res kres)
+{
+    for(size_t y = 0; y < res.y; y++)
+        for(size_t x = 0; x < res.x; x++)
+        {
+            keyMap m = mi;
+            const mandelbrot::color* key = inner;
+            double u = m.ox + (x + 0.5) * m.sx;
+            double v = m.oy + (y + 0.5) * m.sy;
+            if(u - m.sx / 2 < 0 || u + m.sx / 2 > kres.x || v - m.sy / 2 < 0 || v + m.sy / 2 > kres.y)
+            {
+                m = mo;
+                key = outer;
+                u = m.ox + (x + 0.5) * m.sx;
+                v = m.oy + (y + 0.5) * m.sy;
+            }
+
+            int n = std::max(1, (int)ceil(std::max(m.sx, m.sy) / 2 - 1e-9));
+            float c[3] = { 0, 0, 0 };
+            for(int j = 0; j < n; j++)
+                for(int i = 0; i < n; i++)
+                    sample(key, kres, u + ((i + 0.5) / n - 0.5) * m.sx, v + ((j + 0.5) / n - 0.5) * m.sy, c);
+
+            mandelbrot::color& out = ret[y*res.x + x];
+            out.r = c[0] / (n*n) + 0.5f;
+            out.g = c[1] / (n*n) + 0.5f;
+            out.b = c[2] / (n*n) + 0.5f;
+            out.pad = 0;
+        }
+}
+
+/* Schreibt ein Bild in die Datei mit der Nummer index
+ * @return false falls ein Fehler aufgetreten ist
+ */
+static bool writeFrame(const char* pattern, size_t index, const mandelbrot::color* image, mandelbrot::res res)
+{
+    char name[4096];
+    imageWriter writer;
+
+    snprintf(name, sizeof(name), pattern, (int)index);
+    if(!writer.open(name, res, imageWriter::formatOf(name)))
+    {
+        std::cerr << "Failed to open " << name << "\n";
+        return false;
+    }
+    writer.writeRows(image, res.y);
+    if(!writer.close())
+    {
+        std::cerr << "Failed to write " << name << "\n";
+        return false;
+    }
+    return true;
+}
+
+/* Setzt die Bilder first bis end (exklusive) eines Abschnittes aus den Schlüsselbildern k und k+1
+ * zusammen und schreibt sie. Die Bilder werden auf alle CPU-Kerne verteilt, beim OpenCL-Backend
+ * sind diese sonst frei.
+ * @param index Die Nummer der Datei des Bildes first
+ * @return false falls ein Fehler aufgetreten ist
+ */
+static bool composeFrames(const segment& s, const char* output, const mandelbrot::color* outer, const mandelbrot::color* inner,
+                          mandelbrot::res res, mandelbrot::res kres, size_t first, size_t end, size_t index)
+{
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    std::atomic<size_t> next(first);
+    std::atomic<bool> ok(true);
+
+    for(size_t w = 0; w < threads && w < end - first; w++)
+        workers.emplace_back([&]() {
+            std::vector<mandelbrot::color> image(res.x * res.y);
+            for(size_t i = next++; i < end && ok; i = next++)
+            {
+                double t = (double)i / s.frames;
+                size_t k = (size_t)floor(t * s.zoom + 1e-9);
+                composeFrame(image.data(), res, outer, mapToKey(s, res, t, k), inner, mapToKey(s, res, t, k + 1), kres);
+                if(!writeFrame(output, index + i - first, image.data(), res))
+                    ok = false;
+            }
+        });
+    for(std::thread& w : workers)
+        w.join();
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    mandelbrot::res res = { DEF_WIDTH, DEF_HEIGHT };
+    mandelbrot::backend backend = mandelbrot::OPENCL;
+    const char* output = DEF_OUTPUT;
+    const char* from[3] = { nullptr, nullptr, nullptr };
+    const char* to[3] = { nullptr, nullptr, nullptr };
+    const char* keys = nullptr;
+    size_t frames = DEF_FRAMES;
+    size_t iterationen = DEF_ITERATIONEN;
+    size_t samples = DEF_SAMPLES;
+    bool adaptive = false;
+    bool single = true;
+    bool doubleDouble = true;
+    mandelbrot::formula formula = { mandelbrot::MANDELBROT, 2, false, 0, 0 };
+    bool direct = false;
+
+    // Auswerten der Argumente
+    for(int a = 1; a < argc; a++)
+    {
+        if(strcmp(argv[a], "-o") == 0 && a + 1 < argc)
+            output = argv[++a];
+        else if(strcmp(argv[a], "--size") == 0 && a + 1 < argc)
+        {
+            if(sscanf(argv[++a], "%zux%zu", &res.x, &res.y) != 2)
+                res.x = 0;
+        }
+        else if(strcmp(argv[a], "--from") == 0 && a + 3 < argc)
+        {
+            for(int i = 0; i < 3; i++)
+                from[i] = argv[++a];
+        }
+        else if(strcmp(argv[a], "--to") == 0 && a + 3 < argc)
+        {
+            for(int i = 0; i < 3; i++)
+                to[i] = argv[++a];
+        }
+        else if(strcmp(argv[a], "--keys") == 0 && a + 1 < argc)
+            keys = argv[++a];
+        else if(strcmp(argv[a], "--frames") == 0 && a + 1 < argc)
+            frames = strtoul(argv[++a], nullptr, 10);
+        else if(strcmp(argv[a], "--iter") == 0 && a + 1 < argc)
+            iterationen = strtoul(argv[++a], nullptr, 10);
+        else if(strcmp(argv[a], "--samples") == 0 && a + 1 < argc)
+            samples = strtoul(argv[++a], nullptr, 10);
+        else if(strcmp(argv[a], "--direct") == 0)
+            direct = true;
+        else if(strcmp(argv[a], "--cpu") == 0)
+            backend = mandelbrot::NATIVE;
+        else if(strcmp(argv[a], "--multi") == 0)
+            backend = mandelbrot::MULTI;
+        else if(strcmp(argv[a], "--adaptive") == 0)
+            adaptive = true;
+        else if(strcmp(argv[a], "--double") == 0)
+            single = false;
+        else if(strcmp(argv[a], "--no-dd") == 0)
+            doubleDouble = false;
+        else if(strcmp(argv[a], "--julia") == 0 && a + 2 < argc)
+        {
+            formula.julia = true;
+            formula.jx = atof(argv[++a]);
+            formula.jy = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--power") == 0 && a + 1 < argc)
+        {
+            formula.type = mandelbrot::MULTIBROT;
+            formula.power = atoi(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--burning-ship") == 0)
+            formula.type = mandelbrot::BURNING_SHIP;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if(res.x == 0 || res.y == 0 || samples == 0 || iterationen == 0)
+    {
+        usage();
+        return 1;
+    }
+
+    // Die Abschnitte der Fahrt, aus --from/--to oder aus der Datei mit den Schlüsselbildern
+    std::vector<segment> path;
+    if(keys != nullptr)
+    {
+        FILE* file = fopen(keys, "r");
+        char x[1024], y[1024], w[64];
+        size_t n;
+        mandelbrot::deep last;
+        bool first = true;
+
+        if(file == nullptr)
+        {
+            std::cerr << "Failed to open " << keys << "\n";
+            return 1;
+        }
+        while(fscanf(file, "%1023s %1023s %63s %zu", x, y, w, &n) == 4)
+        {
+            mandelbrot::deep area;
+            if(!parseArea(x, y, w, res, area))
+                break;
+            if(!first && n > 0)
+                path.push_back(makeSegment(last, area, n));
+            last = area;
+            first = false;
+        }
+        fclose(file);
+    }
+    else if(from[0] != nullptr && to[0] != nullptr && frames >= 2)
+    {
+        mandelbrot::deep a;
+        mandelbrot::deep b;
+        if(parseArea(from[0], from[1], from[2], res, a) && parseArea(to[0], to[1], to[2], res, b))
+            path.push_back(makeSegment(a, b, frames - 1));
+    }
+    if(path.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    mandelbrot* brot = new mandelbrot(backend);
+    mandelbrot::res kres = { res.x * KEY_SCALE, res.y * KEY_SCALE };
+    brot->setAdaptive(adaptive);
+    brot->setSingle(single);
+    brot->setDoubleDouble(doubleDouble);
+    brot->setFormula(formula);
+    brot->createBuffer(direct ? res : kres);
+
+    /* Die Bilder werden im Hintergrund zusammengesetzt und geschrieben, während schon das nächste
+     * (Schlüssel-)Bild berechnet wird. Es ist immer nur ein Auftrag im Hintergrund offen.
+     */
+    std::vector<mandelbrot::color> buffers[3];
+    std::future<bool> writing;
+    size_t index = 0;
+    size_t computed = 0;
+    bool ok = true;
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t p = 0; p < path.size() && ok; p++)
+    {
+        const segment& s = path[p];
+        // Das letzte Bild der Fahrt gehört zum letzten Abschnitt
+        size_t n = s.frames + (p + 1 == path.size() ? 1 : 0);
+
+        // Die Buffer werden für den neuen Abschnitt frei
+        if(writing.valid())
+            ok = writing.get();
+
+        /* Jedes Bild wird berechnet, falls die Schlüsselbilder nicht gehen oder mehr kosten (bei
+         * weniger als KEY_SCALE² Bildern pro Verdopplung). Samples des vorherigen Bildes werden
+         * übernommen wo möglich.
+         */
+        if(direct || !s.nested || (s.zoom + 2) * KEY_SCALE * KEY_SCALE >= n)
+        {
+            for(size_t f = 0; f < n && ok; f++)
+            {
+                std::vector<mandelbrot::color>& image = buffers[f % 2];
+                image.resize(res.x * res.y);
+                brot->computeImage(image.data(), res, frameArea(s, res, (double)f / s.frames), iterationen, samples);
+                computed++;
+
+                if(writing.valid())
+                    ok = writing.get();
+                writing = std::async(std::launch::async, [output, &image, res, index]() {
+                    return writeFrame(output, index, image.data(), res);
+                });
+                index++;
+            }
+            continue;
+        }
+
+        /* Ein Schlüsselbild pro Verdopplung des Zooms. Die Bilder zwischen den Schlüsselbildern k
+         * und k+1 werden gesetzt, sobald k+1 berechnet ist, während k+2 berechnet wird.
+         */
+        size_t last = (size_t)floor((double)(n - 1) / s.frames * s.zoom + 1e-9);
+        size_t f = 0;
+        for(size_t k = 0; k <= last + 1 && ok; k++)
+        {
+            std::vector<mandelbrot::color>& key = buffers[k % 3];
+            key.resize(kres.x * kres.y);
+            brot->computeImage(key.data(), kres, frameArea(s, kres, k / s.zoom), iterationen, samples);
+            computed++;
+            if(k == 0)
+                continue;
+
+            // Die Bilder mit Zoom zwischen k-1 (inklusive) und k
+            size_t end = f;
+            while(end < n && (size_t)floor((double)end / s.frames * s.zoom + 1e-9) < k)
+                end++;
+
+            if(writing.valid())
+                ok = writing.get();
+            const std::vector<mandelbrot::color>& outer = buffers[(k - 1) % 3];
+            writing = std::async(std::launch::async, [&s, output, &outer, &key, res, kres, f, end, index]() {
+                return composeFrames(s, output, outer.data(), key.data(), res, kres, f, end, index);
+            });
+            index += end - f;
+            f = end;
+
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "[key " << k << " of " << last + 1 << ", " << index << " frames, " << ms / 1000 << " s]\n";
+        }
+    }
+    if(writing.valid())
+        ok = writing.get() && ok;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[" << index << " frames (" << computed << " computed) in " << seconds << " s, "
+                << index / seconds << " frames/s]\n";
+
+    brot->deleteBuffer();
+    delete brot;
+
+    return ok ? 0 : 1;
+}
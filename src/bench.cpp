@@ -0,0 +1,382 @@
+/*  bench.cpp
+ * Name: Mandelbrot-Benchmark
+ * Misst die Geschwindigkeit der Backends des Mandelbrot-Moduls mit einem festen Katalog von Ansichten
+ * und vergleicht ihre Ausgabe. Die Ergebnisse werden als JSON geschrieben, mit einer Prüfsumme jedes
+ * Bildes, so kann ein späterer Lauf mit --compare auf Änderungen der Geschwindigkeit und der Bilder
+ * geprüft werden.
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "mandelbrot.hpp"
+
+// Konstanten
+#define BENCH_FRAMES 5
+#define DEF_JSON "bench.json"
+
+// Eine Ansicht des Katalogs, der Mittelpunkt in beliebiger Genauigkeit
+struct view
+{
+    const char* name;
+    const char* x;      // Mittelpunkt (x)
+    const char* y;      // Mittelpunkt (y)
+    double width;       // Breite, die Höhe folgt aus dem Seitenverhältnis
+    mandelbrot::formula formula;
+};
+
+// Die Formeln der Ansichten
+static const mandelbrot::formula MANDEL = { mandelbrot::MANDELBROT, 2, false, 0, 0 };
+static const mandelbrot::formula JULIA = { mandelbrot::MANDELBROT, 2, true, -0.8, 0.156 };
+static const mandelbrot::formula CUBIC = { mandelbrot::MULTIBROT, 3, false, 0, 0 };
+static const mandelbrot::formula SHIP = { mandelbrot::BURNING_SHIP, 2, false, 0, 0 };
+
+// Die Ansichten, Indizes für settings
+enum { FULL, SEAHORSE, INTERIOR, MINIBROT, DEEP20, DEEP30, JULIASET, MULTIBROT3, BURNINGSHIP };
+static const view views[] = {
+    { "full",       "0",        "0",        4,      MANDEL },
+    { "seahorse",   "-0.745",   "0.105",    0.03,   MANDEL },   // Viel Rand, mittlere Iterationen
+    { "interior",   "-0.2",     "0",        1.2,    MANDEL },   // Fast nur Hauptkardioide und Kreis der Periode 2
+    { "minibrot",   "-1.7548776662466927", "0", 0.04, MANDEL }, // Kopie der Menge auf der reellen Achse, viel Rand
+    { "deep-1e20",  "-0.743643887037158704752191506114774", "0.131825904205311970493132056385139", 1e-20, MANDEL },
+    { "deep-1e30",  "-0.743643887037158704752191506114774", "0.131825904205311970493132056385139", 1e-30, MANDEL },
+    { "julia",      "0",        "0",        3.2,    JULIA },    // Zusammenhängende Julia-Menge mit viel Rand
+    { "multibrot3", "0",        "0",        3,      CUBIC },
+    { "burning-ship", "-1.76",  "-0.03",    0.12,   SHIP },     // Das kleine Schiff auf der reellen Achse
+};
+
+// Eine zu messende Einstellung
+struct setting
+{
+    int view;               // Index in views
+    mandelbrot::res res;
+    size_t iterationen;
+    size_t samples;
+    bool adaptive;          // Adaptives Supersampling (siehe mandelbrot::setAdaptive)
+};
+
+static const setting settings[] = {
+    { FULL,     { 256, 256 },   100,    1, false },
+    { FULL,     { 700, 700 },   1000,   1, false },
+    { FULL,     { 1920, 1080 }, 100,    2, false },
+    { SEAHORSE, { 700, 700 },   1000,   1, false },
+    { SEAHORSE, { 700, 700 },   1000,   4, false },
+    { SEAHORSE, { 700, 700 },   1000,   4, true },
+    { SEAHORSE, { 1920, 1080 }, 1000,   1, false },
+    { INTERIOR, { 700, 700 },   5000,   1, false },
+    { INTERIOR, { 1920, 1080 }, 5000,   1, false },
+    { MINIBROT, { 700, 700 },   2000,   1, false },
+    { MINIBROT, { 700, 700 },   2000,   4, true },
+    { DEEP20,   { 256, 256 },   20000,  1, false },
+    { DEEP20,   { 700, 700 },   20000,  1, false },
+    { DEEP30,   { 256, 256 },   50000,  1, false },
+    { DEEP30,   { 700, 700 },   50000,  1, false },
+    { JULIASET, { 700, 700 },   1000,   1, false },
+    { MULTIBROT3, { 700, 700 }, 1000,   1, false },
+    { BURNINGSHIP, { 700, 700 }, 1000,  1, false },
+};
+
+// Ein zu messendes Backend
+struct variant
+{
+    const char* name;
+    mandelbrot::backend backend;
+    mandelbrot::schedule schedule;
+    bool single;        // float für flache Bilder (siehe mandelbrot::setSingle)
+    bool doubleDouble;  // double-double statt Störungsrechnung (siehe mandelbrot::setDoubleDouble)
+};
+
+static const variant variants[] = {
+    { "opencl",                 mandelbrot::OPENCL, mandelbrot::TILED,      true,   true },
+    { "opencl-double",          mandelbrot::OPENCL, mandelbrot::TILED,      false,  true },
+    { "opencl-persistent",      mandelbrot::OPENCL, mandelbrot::PERSISTENT, true,   true },
+    { "opencl-chunked",         mandelbrot::OPENCL, mandelbrot::CHUNKED,    true,   true },
+    { "opencl-perturbation",    mandelbrot::OPENCL, mandelbrot::TILED,      true,   false },
+    { "native",                 mandelbrot::NATIVE, mandelbrot::TILED,      true,   true },
+    { "native-double",          mandelbrot::NATIVE, mandelbrot::TILED,      false,  true },
+    { "native-perturbation",    mandelbrot::NATIVE, mandelbrot::TILED,      true,   false },
+    { "multi",                  mandelbrot::MULTI,  mandelbrot::TILED,      true,   true },
+};
+
+// Ein früheres Ergebnis (--compare)
+struct previous
+{
+    std::string checksum;
+    double mpixels;
+};
+
+// Gibt die Verwendung aus
+static void usage()
+{
+    std::cout << "Usage: bench [options]\n"
+                << "  --cpu             measure only the native backend\n"
+                << "  --opencl          measure only the OpenCL backends\n"
+                << "  --view NAME       measure only this view of the catalogue\n"
+                << "  --frames N        frames per measurement (default " << BENCH_FRAMES << ")\n"
+                << "  --json FILE       write the results to FILE (default " << DEF_JSON << ")\n"
+                << "  --compare FILE    compare speed and checksums with an earlier result\n";
+}
+
+// Gibt die Fläche einer Einstellung zurück
+static mandelbrot::deep areaOf(const setting& s)
+{
+    const view& v = views[s.view];
+    mandelbrot::deep area;
+
+    area.w = floatexp(v.width);
+    area.h = floatexp(-v.width * s.res.y / s.res.x);
+    size_t limbs = bigfloat::limbsFor(area.w / floatexp((double)s.res.x));
+    area.x = bigfloat::fromString(v.x, limbs);
+    area.y = bigfloat::fromString(v.y, limbs);
+    return area;
+}
+
+// Gibt einen eindeutigen Namen einer Messung zurück (Schlüssel für --compare)
+static std::string idOf(const variant& v, const setting& s)
+{
+    return std::string(v.name) + "/" + views[s.view].name + "/" + std::to_string(s.res.x) + "x" + std::to_string(s.res.y)
+            + "/i" + std::to_string(s.iterationen) + "/s" + std::to_string(s.samples) + (s.adaptive ? "/adaptive" : "");
+}
+
+// Prüfsumme (FNV-1a) über die Farben eines Bildes, ohne das Padding
+static std::string checksum(const mandelbrot::color* image, size_t size)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    char hex[17];
+
+    for(size_t p = 0; p < size; p++)
+    {
+        const unsigned char bytes[3] = { image[p].r, image[p].g, image[p].b };
+        for(unsigned char b : bytes)
+        {
+            h ^= b;
+            h *= 0x100000001b3ULL;
+        }
+    }
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)h);
+    return hex;
+}
+
+// Gibt den Wert eines Schlüssels in einer Zeile des JSON zurück (ohne Anführungszeichen), "" falls er fehlt
+static std::string jsonValue(const std::string& line, const char* key)
+{
+    std::string pattern = std::string("\"") + key + "\": ";
+    size_t p = line.find(pattern);
+    if(p == std::string::npos)
+        return "";
+    p += pattern.size();
+    if(line[p] == '"')
+        return line.substr(p + 1, line.find('"', p + 1) - p - 1);
+    return line.substr(p, line.find_first_of(",}", p) - p);
+}
+
+/* Liest die Ergebnisse eines früheren Laufs. Jedes Ergebnis steht in einer eigenen Zeile (siehe main).
+ * @param path Die Datei
+ * @param results Die Ergebnisse nach ihrem Namen
+ * @return false falls die Datei nicht gelesen werden konnte
+ */
+static bool loadResults(const char* path, std::map<std::string, previous>& results)
+{
+    std::ifstream file(path);
+    std::string line;
+
+    if(!file)
+        return false;
+    while(std::getline(file, line))
+    {
+        std::string id = jsonValue(line, "id");
+        if(!id.empty())
+            results[id] = { jsonValue(line, "checksum"), atof(jsonValue(line, "mpixels_per_s").c_str()) };
+    }
+    return true;
+}
+
+/* Misst ein Backend mit einer Einstellung
+ * @param brot Das Mandelbrot-Modul
+ * @param s Die Einstellung
+ * @param area Die Fläche der Einstellung
+ * @param buffer Buffer für das Bild
+ * @param frames Die Anzahl gemessener Bilder
+ * @return Die Zeit pro Bild in Millisekunden
+ */
+static double measure(mandelbrot* brot, const setting& s, const mandelbrot::deep& area, mandelbrot::color* buffer, int frames)
+{
+    // Aufwärmen (Kernel laden, Threads starten)
+    brot->setAdaptive(s.adaptive);
+    brot->setFormula(views[s.view].formula);
+    brot->reset();
+    brot->computeImage(buffer, s.res, area, s.iterationen, s.samples);
+
+    // Jedes Bild wird von vorne berechnet, sonst würde nur neu gefärbt
+    auto start = std::chrono::steady_clock::now();
+    for(int f = 0; f < frames; f++)
+    {
+        brot->reset();
+        brot->computeImage(buffer, s.res, area, s.iterationen, s.samples);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count() / frames;
+}
+
+int main(int argc, char** argv)
+{
+    bool useOpenCL = true;
+    bool useNative = true;
+    const char* only = nullptr;
+    const char* output = DEF_JSON;
+    const char* compare = nullptr;
+    int frames = BENCH_FRAMES;
+    size_t numSettings = sizeof(settings) / sizeof(settings[0]);
+    size_t numVariants = sizeof(variants) / sizeof(variants[0]);
+
+    // Auswerten der Argumente
+    for(int a = 1; a < argc; a++)
+    {
+        if(strcmp(argv[a], "--cpu") == 0)
+            useOpenCL = false;
+        else if(strcmp(argv[a], "--opencl") == 0)
+            useNative = false;
+        else if(strcmp(argv[a], "--view") == 0 && a + 1 < argc)
+            only = argv[++a];
+        else if(strcmp(argv[a], "--frames") == 0 && a + 1 < argc)
+            frames = atoi(argv[++a]);
+        else if(strcmp(argv[a], "--json") == 0 && a + 1 < argc)
+            output = argv[++a];
+        else if(strcmp(argv[a], "--compare") == 0 && a + 1 < argc)
+            compare = argv[++a];
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if(frames <= 0)
+    {
+        usage();
+        return 1;
+    }
+
+    std::map<std::string, previous> before;
+    if(compare != nullptr && !loadResults(compare, before))
+    {
+        std::cerr << "Failed to read " << compare << "\n";
+        return 1;
+    }
+
+    FILE* json = fopen(output, "w");
+    if(json == nullptr)
+    {
+        std::cerr << "Failed to open " << output << "\n";
+        return 1;
+    }
+    fprintf(json, "{\n  \"frames\": %d,\n  \"results\": [", frames);
+
+    /* Das erste Backend ist die Referenz für die Bilder der anderen. Die Arbeit eines Bildes (siehe
+     * mandelbrot::countWork) hängt nicht vom Backend ab, MULTI übernimmt sie von einem anderen.
+     */
+    std::vector<std::vector<mandelbrot::color>> ref(numSettings);
+    std::vector<uint64_t> work(numSettings, 0);
+    std::vector<mandelbrot::color> buffer;
+    bool first = true;
+
+    std::cout.precision(4);
+
+    for(size_t b = 0; b < numVariants; b++)
+    {
+        const variant& v = variants[b];
+        if((v.backend != mandelbrot::NATIVE && !useOpenCL) || (v.backend != mandelbrot::OPENCL && !useNative))
+            continue;
+
+        mandelbrot* brot = new mandelbrot(v.backend);
+        brot->setSchedule(v.schedule);
+        brot->setSingle(v.single);
+        brot->setDoubleDouble(v.doubleDouble);
+        brot->listDevices();
+
+        for(size_t s = 0; s < numSettings; s++)
+        {
+            const setting& set = settings[s];
+            if(only != nullptr && strcmp(only, views[set.view].name) != 0)
+                continue;
+
+            size_t size = set.res.x * set.res.y;
+            buffer.resize(size);
+            brot->createBuffer(set.res);
+            double ms = measure(brot, set, areaOf(set), buffer.data(), frames);
+            double mpixels = size / ms / 1000;
+            uint64_t w = brot->countWork(set.iterationen).iterations;
+            if(w == 0)
+                w = work[s];
+            else if(work[s] == 0)
+                work[s] = w;
+            std::string id = idOf(v, set);
+            std::string sum = checksum(buffer.data(), size);
+            const char* precision = mandelbrot::precisionName(brot->precisionOf(areaOf(set), set.res, set.samples));
+
+            std::cout << v.name << " " << views[set.view].name << " " << set.res.x << "x" << set.res.y
+                        << " i = " << set.iterationen << ", s = " << set.samples
+                        << (set.adaptive ? " adaptive" : "") << " (" << precision << ")"
+                        << ": " << ms << " ms, " << mpixels << " Mpixel/s";
+            if(w > 0)
+                std::cout << ", " << w / ms / 1e6 << " Giter/s";
+
+            // Vergleich mit dem Ergebnis des ersten Backends
+            long diff = -1;
+            if(ref[s].empty())
+                ref[s] = buffer;
+            else
+            {
+                diff = 0;
+                for(size_t p = 0; p < size; p++)
+                {
+                    mandelbrot::color c = buffer[p];
+                    mandelbrot::color r = ref[s][p];
+                    if(abs(c.r - r.r) > 2 || abs(c.g - r.g) > 2 || abs(c.b - r.b) > 2)
+                        diff++;
+                }
+                std::cout << ", " << diff << " pixels differ";
+            }
+
+            // Vergleich mit dem früheren Lauf
+            std::map<std::string, previous>::const_iterator old = before.find(id);
+            if(old != before.end())
+            {
+                std::cout << ", x" << mpixels / old->second.mpixels << " speed";
+                if(old->second.checksum != sum)
+                    std::cout << ", CHECKSUM CHANGED";
+            }
+            std::cout << "\n";
+
+            // Jedes Ergebnis in einer Zeile, so liest es loadResults ohne JSON-Parser
+            fprintf(json, "%s\n    { \"id\": \"%s\", \"backend\": \"%s\", \"view\": \"%s\", \"width\": %zu, \"height\": %zu, "
+                            "\"iterations\": %zu, \"samples\": %zu, \"adaptive\": %s, \"precision\": \"%s\", \"ms\": %.4f, \"mpixels_per_s\": %.4f, "
+                            "\"giterations_per_s\": %.4f, \"checksum\": \"%s\", \"differing_pixels\": %ld }",
+                    first ? "" : ",", id.c_str(), v.name, views[set.view].name, set.res.x, set.res.y,
+                    set.iterationen, set.samples, set.adaptive ? "true" : "false", precision, ms, mpixels,
+                    w / ms / 1e6, sum.c_str(), diff);
+            first = false;
+        }
+
+        brot->deleteBuffer();
+        delete brot;
+    }
+
+    fprintf(json, "\n  ]\n}\n");
+    if(fclose(json) != 0)
+    {
+        std::cerr << "Failed to write " << output << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,275 @@
+/*  bigfloat.cpp
+ * Name Bigfloat-Modul
+ * Festkommazahl mit beliebiger Genauigkeit für die Referenz-Orbits bei tiefen Zooms
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#include "bigfloat.hpp"
+#include <ctype.h>
+#include <stdlib.h>
+
+// Anzahl zusätzlicher Bits die limbsFor() über die Pixelgrösse hinaus reserviert
+#define RESERVE_BITS 64
+
+bigfloat::bigfloat(size_t limbs)
+{
+    _limbs.assign(limbs < 1 ? 1 : limbs, 0);
+}
+
+bigfloat::bigfloat(floatexp v, size_t limbs)
+{
+    _limbs.assign(limbs < 1 ? 1 : limbs, 0);
+    if(v.m == 0)
+        return;
+
+    // Die Mantisse als 53-bit Ganzzahl, verschoben an die richtige Stelle der Festkommazahl
+    unsigned __int128 mant = (uint64_t)ldexp(fabs(v.m), 53);
+    long shift = v.e - 53 + 32*(long)(_limbs.size() - 1);
+    if(shift < 0)
+    {
+        if(-shift >= 64)
+            return;
+        mant >>= -shift;
+        shift = 0;
+    }
+    size_t index = shift / 32;
+    mant <<= shift % 32;
+    for(size_t i = index; i < _limbs.size() && mant != 0; i++)
+    {
+        _limbs[i] = (uint32_t)mant;
+        mant >>= 32;
+    }
+
+    if(v.m < 0)
+        negate();
+}
+
+void bigfloat::negate()
+{
+    uint64_t carry = 1;
+    for(uint32_t& l : _limbs)
+    {
+        carry += (uint32_t)~l;
+        l = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+void bigfloat::mulSmall(uint32_t f)
+{
+    uint64_t carry = 0;
+    for(uint32_t& l : _limbs)
+    {
+        carry += (uint64_t)l * f;
+        l = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+void bigfloat::divSmall(uint32_t d)
+{
+    uint64_t rem = 0;
+    for(size_t i = _limbs.size(); i-- > 0;)
+    {
+        rem = (rem << 32) | _limbs[i];
+        _limbs[i] = (uint32_t)(rem / d);
+        rem %= d;
+    }
+}
+
+void bigfloat::setLimbs(size_t limbs)
+{
+    if(limbs < 1)
+        limbs = 1;
+    // Es werden nur Nachkommastellen hinzugefügt oder entfernt
+    if(limbs > _limbs.size())
+        _limbs.insert(_limbs.begin(), limbs - _limbs.size(), 0);
+    else
+        _limbs.erase(_limbs.begin(), _limbs.begin() + (_limbs.size() - limbs));
+}
+
+size_t bigfloat::limbsFor(floatexp delta)
+{
+    double bits = -delta.log2() + RESERVE_BITS;
+    if(bits < 32)
+        bits = 32;
+    return 1 + (size_t)ceil(bits / 32);
+}
+
+double bigfloat::toDouble() const
+{
+    if(negative())
+    {
+        bigfloat t = *this;
+        t.negate();
+        return -t.toDouble();
+    }
+
+    double ret = 0;
+    long top = _limbs.size() - 1;
+    for(size_t i = 0; i < _limbs.size(); i++)
+        ret += ldexp((double)_limbs[i], 32*((long)i - top));
+    return ret;
+}
+
+floatexp bigfloat::toFloatexp() const
+{
+    if(negative())
+    {
+        bigfloat t = *this;
+        t.negate();
+        return -t.toFloatexp();
+    }
+
+    // Ab dem obersten von 0 verschiedenen Limb reichen drei Limbs für die Mantisse
+    long top = _limbs.size() - 1;
+    for(long i = top; i >= 0; i--)
+        if(_limbs[i] != 0)
+        {
+            double m = 0;
+            for(long j = i; j >= 0 && j > i - 3; j--)
+                m += ldexp((double)_limbs[j], 32*(j - i));
+            return floatexp(m, 32*(i - top));
+        }
+    return floatexp();
+}
+
+bigfloat bigfloat::operator+(const bigfloat& o) const
+{
+    if(o.limbs() != limbs())
+    {
+        // Beide Zahlen werden auf die grössere Genauigkeit gebracht
+        bigfloat a = *this;
+        bigfloat b = o;
+        a.setLimbs(limbs() > o.limbs() ? limbs() : o.limbs());
+        b.setLimbs(a.limbs());
+        return a + b;
+    }
+
+    bigfloat ret(limbs());
+    uint64_t carry = 0;
+    for(size_t i = 0; i < _limbs.size(); i++)
+    {
+        carry += (uint64_t)_limbs[i] + o._limbs[i];
+        ret._limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    return ret;
+}
+
+bigfloat bigfloat::operator-(const bigfloat& o) const
+{
+    bigfloat n = o;
+    n.negate();
+    return *this + n;
+}
+
+bigfloat bigfloat::operator*(const bigfloat& o) const
+{
+    if(o.limbs() != limbs())
+    {
+        bigfloat a = *this;
+        bigfloat b = o;
+        a.setLimbs(limbs() > o.limbs() ? limbs() : o.limbs());
+        b.setLimbs(a.limbs());
+        return a * b;
+    }
+
+    // Multipliziert werden die Beträge
+    bool neg = negative() != o.negative();
+    bigfloat a = *this;
+    bigfloat b = o;
+    if(a.negative())
+        a.negate();
+    if(b.negative())
+        b.negate();
+
+    size_t n = limbs();
+    std::vector<uint32_t> prod(2*n, 0);
+    for(size_t i = 0; i < n; i++)
+    {
+        uint64_t carry = 0;
+        for(size_t j = 0; j < n; j++)
+        {
+            carry += (uint64_t)a._limbs[i] * b._limbs[j] + prod[i + j];
+            prod[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        prod[i + n] = (uint32_t)carry;
+    }
+
+    // Das Produkt hat doppelt so viele Nachkommastellen, die untersten n-1 Limbs fallen weg
+    bigfloat ret(n);
+    for(size_t i = 0; i < n; i++)
+        ret._limbs[i] = prod[i + n - 1];
+    if(neg)
+        ret.negate();
+    return ret;
+}
+
+bigfloat bigfloat::fromString(const char* str, size_t limbs)
+{
+    bigfloat ret(limbs);
+    bool neg = false;
+    const char* frac;
+    const char* end;
+    long exp = 0;
+
+    while(isspace(*str))
+        str++;
+    if(*str == '-' || *str == '+')
+        neg = *str++ == '-';
+
+    // Ganzzahliger Teil
+    uint32_t integer = 0;
+    while(isdigit(*str))
+        integer = integer*10 + (*str++ - '0');
+
+    // Nachkommastellen, von hinten mit dem Horner-Schema
+    if(*str == '.')
+        str++;
+    frac = str;
+    while(isdigit(*str))
+        str++;
+    end = str;
+    while(end-- > frac)
+    {
+        ret._limbs.back() += *end - '0';
+        ret.divSmall(10);
+    }
+    ret._limbs.back() += integer;
+
+    // Exponent
+    if(*str == 'e' || *str == 'E')
+        exp = strtol(str + 1, NULL, 10);
+    for(; exp > 0; exp--)
+        ret.mulSmall(10);
+    for(; exp < 0; exp++)
+        ret.divSmall(10);
+
+    if(neg)
+        ret.negate();
+    return ret;
+}
+
+std::string bigfloat::toString(size_t digits) const
+{
+    bigfloat t = *this;
+    std::string ret;
+
+    if(t.negative())
+    {
+        ret += '-';
+        t.negate();
+    }
+    ret += std::to_string(t._limbs.back());
+    ret += '.';
+    for(size_t i = 0; i < digits; i++)
+    {
+        t._limbs.back() = 0;
+        t.mulSmall(10);
+        ret += (char)('0' + t._limbs.back());
+    }
+    return ret;
+}
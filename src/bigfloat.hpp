@@ -0,0 +1,77 @@
+/*  bigfloat.hpp
+ * Name Bigfloat-Modul
+ * Festkommazahl mit beliebiger Genauigkeit für die Referenz-Orbits bei tiefen Zooms
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#ifndef BIGFLOAT_HPP
+#define BIGFLOAT_HPP
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#include "floatexp.hpp"
+
+/* Die Zahl wird im Zweierkomplement in 32-bit Limbs gespeichert (niedrigstes zuerst). Das oberste
+ * Limb ist der ganzzahlige Teil, alle anderen sind Nachkommastellen. Für die Mandelbrot-Menge
+ * reicht der ganzzahlige Teil von -2^31 bis 2^31 bei weitem.
+ */
+class bigfloat
+{
+private:
+    std::vector<uint32_t> _limbs;   // Die Limbs der Zahl
+
+    // Gibt true zurück falls die Zahl negativ ist
+    bool negative() const { return (_limbs.back() & 0x80000000) != 0; }
+    // Negiert die Zahl
+    void negate();
+    // Multipliziert die Zahl mit einer kleinen positiven Zahl
+    void mulSmall(uint32_t f);
+    // Dividiert die Zahl durch eine kleine positive Zahl
+    void divSmall(uint32_t d);
+
+public:
+    /* Erstellt die Zahl 0
+     * @param limbs Die Anzahl der Limbs (1 ganzzahliges + limbs-1 für die Nachkommastellen)
+     */
+    bigfloat(size_t limbs = 2);
+    /* Erstellt die Zahl m * 2^e
+     * @param v Der Wert
+     * @param limbs Die Anzahl der Limbs
+     */
+    bigfloat(floatexp v, size_t limbs);
+
+    // Gibt die Anzahl der Limbs zurück
+    size_t limbs() const { return _limbs.size(); }
+    // Ändert die Genauigkeit, wobei der Wert erhalten bleibt (abgesehen von Rundung)
+    void setLimbs(size_t limbs);
+
+    // Gibt die benötigten Limbs für Abstände der Grösse delta zurück (mit Reserve)
+    static size_t limbsFor(floatexp delta);
+
+    // Gibt die Zahl als double zurück
+    double toDouble() const;
+    // Gibt die Zahl als floatexp zurück (auch für Werte die für double zu klein sind)
+    floatexp toFloatexp() const;
+
+    bigfloat operator+(const bigfloat& o) const;
+    bigfloat operator-(const bigfloat& o) const;
+    bigfloat operator*(const bigfloat& o) const;
+    bigfloat operator+(const floatexp& o) const { return *this + bigfloat(o, limbs()); }
+    bool operator==(const bigfloat& o) const { return _limbs == o._limbs; }
+    bool operator!=(const bigfloat& o) const { return _limbs != o._limbs; }
+
+    /* Liest eine Dezimalzahl ein (z.B. "-0.75", "1.25e-3")
+     * @param str Der Text
+     * @param limbs Die Anzahl der Limbs
+     */
+    static bigfloat fromString(const char* str, size_t limbs);
+    /* Gibt die Zahl als Dezimalzahl aus
+     * @param digits Die Anzahl der Nachkommastellen
+     */
+    std::string toString(size_t digits) const;
+};
+
+#endif
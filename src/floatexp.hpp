@@ -0,0 +1,106 @@
+/*  floatexp.hpp
+ * Name Floatexp-Modul
+ * Gleitkommazahl mit erweitertem Exponenten für Werte ausserhalb des Bereiches von double
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#ifndef FLOATEXP_HPP
+#define FLOATEXP_HPP
+
+#include <math.h>
+#include <stdio.h>
+#include <string>
+
+// Speichern einer Zahl als m * 2^e, wobei |m| in [0.5, 1) liegt oder m = 0 ist
+struct floatexp
+{
+    double m;   // Mantisse
+    long e;     // Exponent
+
+    floatexp() : m(0), e(0) { }
+
+    floatexp(double v)
+    {
+        int ex;
+        m = frexp(v, &ex);
+        e = m == 0 ? 0 : ex;
+    }
+
+    floatexp(double mant, long ex)
+    {
+        int norm;
+        m = frexp(mant, &norm);
+        e = m == 0 ? 0 : ex + norm;
+    }
+
+    // Gibt den Wert als double zurück (0 oder inf falls er nicht darstellbar ist)
+    double toDouble() const
+    {
+        if(e < -1100)
+            return 0;
+        if(e > 1100)
+            return m * INFINITY;
+        return ldexp(m, e);
+    }
+
+    // Gibt log2(|x|) zurück
+    double log2() const
+    {
+        return m == 0 ? -INFINITY : ::log2(fabs(m)) + e;
+    }
+
+    // Gibt die Zahl in wissenschaftlicher Schreibweise zurück (z.B. "1.5e-400")
+    std::string toString() const
+    {
+        char buffer[64];
+        if(m == 0)
+            return "0";
+        double l = log10(fabs(m)) + e * 0.30102999566398119521;
+        double ex = floor(l);
+        snprintf(buffer, sizeof(buffer), "%.6fe%.0f", (m < 0 ? -1 : 1) * pow(10, l - ex), ex);
+        return buffer;
+    }
+
+    floatexp operator-() const
+    {
+        floatexp r = *this;
+        r.m = -r.m;
+        return r;
+    }
+
+    floatexp operator*(const floatexp& o) const
+    {
+        return floatexp(m * o.m, e + o.e);
+    }
+
+    floatexp operator/(const floatexp& o) const
+    {
+        return floatexp(m / o.m, e - o.e);
+    }
+
+    floatexp operator+(const floatexp& o) const
+    {
+        if(m == 0)
+            return o;
+        if(o.m == 0)
+            return *this;
+        // Die kleinere Zahl wird an den Exponenten der grösseren angepasst
+        if(e >= o.e)
+            return floatexp(m + (e - o.e > 1100 ? 0 : ldexp(o.m, o.e - e)), e);
+        else
+            return floatexp(o.m + (o.e - e > 1100 ? 0 : ldexp(m, e - o.e)), o.e);
+    }
+
+    floatexp operator-(const floatexp& o) const
+    {
+        return *this + (-o);
+    }
+
+    bool operator<(const floatexp& o) const
+    {
+        return (*this - o).m < 0;
+    }
+};
+
+#endif
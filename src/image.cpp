@@ -0,0 +1,292 @@
+/*  image.cpp
+ * Name Bild-Modul
+ * Schreibt Bilder zeilenweise in eine Datei (PPM, PNG oder TIFF), ohne das ganze Bild im Speicher
+ * zu halten. So können auch Bilder geschrieben werden, die viel grösser als der RAM sind.
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#include "image.hpp"
+#include <string.h>
+
+// Typen der Einträge im TIFF-IFD
+#define TIFF_SHORT 3
+#define TIFF_LONG 4
+#define TIFF_LONG8 16
+
+imageWriter::imageWriter()
+{
+    _file = nullptr;
+    _format = PPM;
+    _res.x = 0;
+    _res.y = 0;
+    _rows = 0;
+    _ok = false;
+}
+
+imageWriter::~imageWriter()
+{
+    if(_file != nullptr)
+        close();
+}
+
+imageWriter::format imageWriter::formatOf(const char* path)
+{
+    const char* ext = strrchr(path, '.');
+
+    if(ext == nullptr)
+        return PPM;
+    if(strcasecmp(ext, ".png") == 0)
+        return PNG;
+    if(strcasecmp(ext, ".tif") == 0 || strcasecmp(ext, ".tiff") == 0)
+        return TIFF;
+    return PPM;
+}
+
+void imageWriter::write(const void* data, size_t n)
+{
+    if(n > 0 && fwrite(data, 1, n, _file) != n)
+        _ok = false;
+}
+
+void imageWriter::writeInt(uint64_t v, int bytes)
+{
+    unsigned char buffer[8];
+
+    for(int b = 0; b < bytes; b++)
+    {
+        int shift = _format == PNG ? 8*(bytes - 1 - b) : 8*b;
+        buffer[b] = (v >> shift) & 0xff;
+    }
+    write(buffer, bytes);
+}
+
+void imageWriter::writeChunk(const char* type, const unsigned char* data, size_t n)
+{
+    uLong crc = crc32(0, (const Bytef*)type, 4);
+    if(n > 0)
+        crc = crc32(crc, data, n);
+
+    writeInt(n, 4);
+    write(type, 4);
+    write(data, n);
+    writeInt(crc, 4);
+}
+
+void imageWriter::writeEntry(uint16_t tag, uint16_t type, uint64_t count, uint64_t value, bool big)
+{
+    // Werte die ins Feld passen stehen Little-Endian am Anfang, so auch mehrere SHORTs
+    writeInt(tag, 2);
+    writeInt(type, 2);
+    writeInt(count, big ? 8 : 4);
+    writeInt(value, big ? 8 : 4);
+}
+
+void imageWriter::compress(const unsigned char* data, size_t n, int flush)
+{
+    int ret;
+
+    _zip.next_in = (Bytef*)data;
+    _zip.avail_in = n;
+    do
+    {
+        ret = ::deflate(&_zip, flush);
+        // Volle Buffer werden sofort als Chunk geschrieben, so bleibt der Speicher beschränkt
+        if(_zip.avail_out == 0 || (flush == Z_FINISH && ret == Z_STREAM_END))
+        {
+            writeChunk("IDAT", _out.data(), _out.size() - _zip.avail_out);
+            _zip.next_out = _out.data();
+            _zip.avail_out = _out.size();
+        }
+        if(ret == Z_STREAM_ERROR)
+        {
+            _ok = false;
+            return;
+        }
+    } while(_zip.avail_in > 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+}
+
+void imageWriter::headerPPM()
+{
+    fprintf(_file, "P6\n%zu %zu\n255\n", _res.x, _res.y);
+}
+
+void imageWriter::headerPNG()
+{
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    unsigned char ihdr[13] = { 0 };
+
+    write(signature, sizeof(signature));
+
+    // Breite und Höhe (Big-Endian), 8 Bit pro Kanal, RGB, keine Interlace
+    for(int b = 0; b < 4; b++)
+    {
+        ihdr[b] = (_res.x >> (24 - 8*b)) & 0xff;
+        ihdr[4 + b] = (_res.y >> (24 - 8*b)) & 0xff;
+    }
+    ihdr[8] = 8;
+    ihdr[9] = 2;
+    writeChunk("IHDR", ihdr, sizeof(ihdr));
+
+    _row.resize(1 + 3*_res.x);
+    _out.resize(IMAGE_CHUNK_SIZE);
+    memset(&_zip, 0, sizeof(_zip));
+    if(deflateInit(&_zip, Z_DEFAULT_COMPRESSION) != Z_OK)
+        _ok = false;
+    _zip.next_out = _out.data();
+    _zip.avail_out = _out.size();
+}
+
+void imageWriter::headerTIFF()
+{
+    uint64_t rowBytes = 3*_res.x;
+    uint64_t strips = (_res.y + IMAGE_TIFF_ROWS - 1) / IMAGE_TIFF_ROWS;
+    // Für Daten ab 4 GiB reichen die 32-bit Offsets von TIFF nicht, dann wird BigTIFF geschrieben
+    bool big = rowBytes*_res.y + 16*strips + 512 > 0xffffffffULL;
+    int off = big ? 8 : 4;
+    uint16_t entries = 10;
+    uint16_t stripType = big ? TIFF_LONG8 : TIFF_LONG;
+
+    // Nach dem Header folgen das IFD, BitsPerSample, die Offsets und Längen der Strips und die Daten
+    uint64_t ifd = big ? 16 : 8;
+    uint64_t bits = ifd + (big ? 8 : 2) + entries*(big ? 20 : 12) + off;
+    uint64_t offsets = bits + 8;
+    uint64_t counts = offsets + (strips > 1 ? strips*off : 0);
+    uint64_t data = counts + (strips > 1 ? strips*off : 0);
+
+    write("II", 2);
+    if(big)
+    {
+        writeInt(43, 2);
+        writeInt(8, 2);
+        writeInt(0, 2);
+        writeInt(ifd, 8);
+        writeInt(entries, 8);
+    }
+    else
+    {
+        writeInt(42, 2);
+        writeInt(ifd, 4);
+        writeInt(entries, 2);
+    }
+
+    // Die Einträge müssen nach Tag sortiert sein, ein einzelner Strip steht direkt im Eintrag
+    writeEntry(256, TIFF_LONG, 1, _res.x, big);                         // ImageWidth
+    writeEntry(257, TIFF_LONG, 1, _res.y, big);                         // ImageLength
+    writeEntry(258, TIFF_SHORT, 3, big ? 0x000800080008ULL : bits, big);    // BitsPerSample
+    writeEntry(259, TIFF_SHORT, 1, 1, big);                             // Compression: keine
+    writeEntry(262, TIFF_SHORT, 1, 2, big);                             // Photometric: RGB
+    writeEntry(273, stripType, strips, strips > 1 ? offsets : data, big);   // StripOffsets
+    writeEntry(277, TIFF_SHORT, 1, 3, big);                             // SamplesPerPixel
+    writeEntry(278, TIFF_LONG, 1, IMAGE_TIFF_ROWS, big);                // RowsPerStrip
+    writeEntry(279, stripType, strips, strips > 1 ? counts : rowBytes*_res.y, big); // StripByteCounts
+    writeEntry(284, TIFF_SHORT, 1, 1, big);                             // PlanarConfiguration
+    writeInt(0, off);
+
+    // BitsPerSample (8 Bytes, auch wenn es bei BigTIFF schon im Eintrag steht)
+    for(int c = 0; c < 4; c++)
+        writeInt(c < 3 ? 8 : 0, 2);
+
+    if(strips > 1)
+    {
+        for(uint64_t s = 0; s < strips; s++)
+            writeInt(data + s*IMAGE_TIFF_ROWS*rowBytes, off);
+        for(uint64_t s = 0; s < strips; s++)
+        {
+            uint64_t rows = _res.y - s*IMAGE_TIFF_ROWS;
+            writeInt((rows < IMAGE_TIFF_ROWS ? rows : IMAGE_TIFF_ROWS) * rowBytes, off);
+        }
+    }
+}
+
+bool imageWriter::open(const char* path, mandelbrot::res res, format f)
+{
+    FILE* file = fopen(path, "wb");
+    if(file == nullptr)
+        return false;
+    return open(file, res, f);
+}
+
+bool imageWriter::open(FILE* file, mandelbrot::res res, format f)
+{
+    _file = file;
+    _format = f;
+    _res = res;
+    _rows = 0;
+    _ok = true;
+    _row.resize(3*res.x);
+
+    switch(f)
+    {
+    case PPM:
+        headerPPM();
+        break;
+    case PNG:
+        headerPNG();
+        break;
+    case TIFF:
+        headerTIFF();
+        break;
+    }
+    return _ok;
+}
+
+bool imageWriter::writeRows(const mandelbrot::color* rows, size_t n)
+{
+    if(_file == nullptr || _rows + n > _res.y)
+        _ok = false;
+    if(!_ok)
+        return false;
+
+    for(size_t y = 0; y < n; y++)
+    {
+        const mandelbrot::color* row = rows + y*_res.x;
+
+        if(_format == PNG)
+        {
+            // Filter Sub: Differenz zum Pixel links, das komprimiert die Farbverläufe deutlich besser
+            unsigned char* out = _row.data() + 1;
+            _row[0] = 1;
+            for(size_t x = 0; x < _res.x; x++)
+            {
+                mandelbrot::color left = x > 0 ? row[x - 1] : mandelbrot::color{ 0, 0, 0, 0 };
+                out[3*x] = row[x].r - left.r;
+                out[3*x + 1] = row[x].g - left.g;
+                out[3*x + 2] = row[x].b - left.b;
+            }
+            compress(_row.data(), _row.size(), Z_NO_FLUSH);
+        }
+        else
+        {
+            for(size_t x = 0; x < _res.x; x++)
+            {
+                _row[3*x] = row[x].r;
+                _row[3*x + 1] = row[x].g;
+                _row[3*x + 2] = row[x].b;
+            }
+            write(_row.data(), _row.size());
+        }
+    }
+    _rows += n;
+    return _ok;
+}
+
+bool imageWriter::close()
+{
+    if(_file == nullptr)
+        return false;
+
+    if(_format == PNG)
+    {
+        compress(nullptr, 0, Z_FINISH);
+        deflateEnd(&_zip);
+        writeChunk("IEND", nullptr, 0);
+    }
+
+    if(_rows != _res.y)
+        _ok = false;
+    if(fclose(_file) != 0)
+        _ok = false;
+    _file = nullptr;
+    return _ok;
+}
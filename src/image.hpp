@@ -0,0 +1,98 @@
+/*  image.hpp
+ * Name Bild-Modul
+ * Schreibt Bilder zeilenweise in eine Datei (PPM, PNG oder TIFF), ohne das ganze Bild im Speicher
+ * zu halten. So können auch Bilder geschrieben werden, die viel grösser als der RAM sind.
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <zlib.h>
+
+#include "mandelbrot.hpp"
+
+// Grösse des Buffers für die komprimierten Daten eines IDAT-Chunks (PNG)
+#define IMAGE_CHUNK_SIZE (1 << 16)
+// Anzahl Zeilen pro Strip (TIFF)
+#define IMAGE_TIFF_ROWS 64
+
+class imageWriter
+{
+public:
+    // Mögliche Dateiformate
+    enum format
+    {
+        PPM,    // Binäres PPM (P6), unkomprimiert
+        PNG,    // PNG mit Filter Sub und zlib
+        TIFF    // Unkomprimiertes TIFF, BigTIFF falls die Daten mehr als 4 GiB brauchen
+    };
+
+private:
+    FILE* _file;                        // Die geöffnete Datei (nullptr falls keine)
+    format _format;                     // Das Format der Datei
+    mandelbrot::res _res;               // Die Auflösung des Bildes
+    size_t _rows;                       // Anzahl bereits geschriebener Zeilen
+    bool _ok;                           // false falls ein Fehler aufgetreten ist
+    std::vector<unsigned char> _row;    // Eine Zeile in RGB (bei PNG mit Filter-Byte)
+    std::vector<unsigned char> _out;    // Komprimierte Daten (PNG)
+    z_stream _zip;                      // Der Zustand von zlib (PNG)
+
+    // Schreibt n Bytes in die Datei
+    void write(const void* data, size_t n);
+    // Schreibt eine Zahl mit bytes Bytes (Big-Endian bei PNG, sonst Little-Endian)
+    void writeInt(uint64_t v, int bytes);
+    // Schreibt einen PNG-Chunk mit Typ, Daten und CRC
+    void writeChunk(const char* type, const unsigned char* data, size_t n);
+    // Schreibt einen Eintrag eines TIFF-IFD, value ist der Wert selbst (falls er passt) oder ein Offset
+    void writeEntry(uint16_t tag, uint16_t type, uint64_t count, uint64_t value, bool big);
+    // Komprimiert n Bytes und schreibt volle Buffer als IDAT-Chunks (flush am Ende des Bildes)
+    void compress(const unsigned char* data, size_t n, int flush);
+
+    // Schreiben der Header der einzelnen Formate
+    void headerPPM();
+    void headerPNG();
+    void headerTIFF();
+
+public:
+    imageWriter();
+    // Der Destructor schliesst die Datei, falls sie noch offen ist
+    ~imageWriter();
+
+    // Gibt das Format zur Endung des Dateinamens zurück (PPM falls unbekannt)
+    static format formatOf(const char* path);
+
+    /* Öffnet die Datei und schreibt den Header
+     * @param path Der Dateiname
+     * @param res Die Auflösung des Bildes
+     * @param f Das Format
+     * @return false falls die Datei nicht geöffnet werden konnte
+     */
+    bool open(const char* path, mandelbrot::res res, format f);
+
+    /* Schreibt in eine schon geöffnete Datei (z.B. von open_memstream), close schliesst sie
+     * @param file Die Datei
+     * @param res Die Auflösung des Bildes
+     * @param f Das Format
+     * @return false falls der Header nicht geschrieben werden konnte
+     */
+    bool open(FILE* file, mandelbrot::res res, format f);
+
+    /* Schreibt die nächsten Zeilen des Bildes, von oben nach unten
+     * @param rows Die Pixel der Zeilen (res.x pro Zeile)
+     * @param n Die Anzahl der Zeilen
+     * @return false falls ein Fehler aufgetreten ist
+     */
+    bool writeRows(const mandelbrot::color* rows, size_t n);
+
+    /* Beendet die Datei und schliesst sie
+     * @return false falls ein Fehler aufgetreten ist oder nicht alle Zeilen geschrieben wurden
+     */
+    bool close();
+};
+
+#endif
@@ -11,8 +11,17 @@
 #include <mutex>
 #include <iostream>
 #include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <sstream>
 
 #include "mandelbrot.hpp"
+#include "tilecache.hpp"
+#include "trace.hpp"
 
 // Konstanten
     // Default-Werte
@@ -27,23 +36,193 @@
 #define RES_WIDTH 700
 #define RES_HEIGHT 700
 
+    // Verschiebung mit W/A/S/D als Bruchteil des Fensters (ganze Pixel, damit Samples übernommen werden)
+#define PAN_FRACTION 8
+
+    // Abstand der Samples im ersten, groben Durchgang (1/16 der Pixel)
+#define PREVIEW_STEP 4
+
+    // Fehlt im Cache höchstens 1/TILE_MISSING_FRACTION der Pixel, werden nur die fehlenden Kacheln gerechnet
+#define TILE_MISSING_FRACTION 2
+
+    // Minimaler Abstand zweier Frames in Millisekunden, falls der Renderer kein VSync hat
+#define FRAME_MS 16
+    // Abstand der Ausgaben der Latenz in Millisekunden
+#define LATENCY_REPORT_MS 2000
+    // Abstand der Aktualisierungen des HUD (Titel des Fensters) in Millisekunden
+#define HUD_UPDATE_MS 250
+
 // Variablen zur Synkronsiation
 std::condition_variable calculate;
 std::mutex calcLock;
+std::atomic<bool> pending;      // Neue Fläche angefordert, die laufende Berechnung wird abgebrochen
 bool end;
+std::condition_variable frameDone;  // Ein Bild ist fertig, wurde übernommen oder es soll neu gezeichnet werden
+std::mutex frameLock;               // Schützt ready, readyInput und locked
+std::atomic<bool> redraw;           // Die Anzeige hat sich geändert (Auswahl, Fenster)
+
+// Die Auswahl, wie sie der draw-Thread sieht. Der input-Thread ersetzt sie als Ganzes, ohne Lock.
+struct selection
+{
+    int16_t x0, y0;     // Mausposition am Anfang des Auswählens
+    int16_t x1, y1;     // Momentane Mausposition
+};
+std::atomic<selection> shown;
+
+/* Zeitpunkte für die Latenz von der Eingabe bis zur Anzeige (Nanosekunden der steady_clock, 0 falls
+ * keiner). inputTime ist die älteste noch nicht gezeichnete Eingabe, calcInput die der neuen Fläche.
+ */
+std::atomic<int64_t> inputTime;
+int64_t calcInput;                  // Geschützt durch calcLock
+int64_t readyInput;                 // Eingabe die zum Bild in ready geführt hat (0 falls keine)
 
-// Variablen zum Zeichnen der Mandelbrot-Menge
-mandelbrot::pos mouse;          // Momentane Mausposition
-mandelbrot::pos mouseStart;     // Mausposition am anfang des Auswählens
-SDL_Texture* tex;               // Textur die das Abbild der Mandelbrot-Menge enthält
+/* Die Bilder werden doppelt gepuffert: der calc-Thread färbt direkt in die gesperrte hintere Textur,
+ * während der draw-Thread die vordere anzeigt und das vorherige Bild noch hochlädt
+ */
+SDL_Texture* textures[2];           // Texturen die das Abbild der Mandelbrot-Menge enthalten
+mandelbrot::color* frames[2];       // Die Pixel der Texturen (gesperrt, oder eigene Buffer falls !direct)
+bool locked[2];                     // Die Textur ist gesperrt und frames zeigt auf ihre Pixel
+bool direct;                        // false falls die Zeilen der Texturen nicht lückenlos sind
+int ready;                          // Fertiges, noch nicht übernommenes Bild (-1 falls keines)
+int front;                          // Die angezeigte Textur (nur draw-Thread)
 
 // Variablen zum errechnen der Mandelbrot-Menge
-mandelbrot::color* colorBuffer;     // Buffer zum abspeichern der Farben
 mandelbrot::res res;                // Auflösung in der berechnet werden soll
-mandelbrot::rect calcArea;          // Fläche die berechnet werden soll
-size_t iterationen;                 // Maximale Anzahl an Iterationen der Berechnung
-size_t samples;                     // Anzahl an Samples pro pixel
+mandelbrot::deep calcArea;          // Fläche die berechnet werden soll (geschützt durch calcLock)
+std::atomic<size_t> iterationen;    // Maximale Anzahl an Iterationen der Berechnung
+std::atomic<size_t> samples;        // Anzahl an Samples pro pixel
 mandelbrot* brot;                   // Mandelbrot-Modul
+tileCache* tiles;                   // Cache der fertigen Kacheln (nullptr falls aus, nur calc-Thread)
+
+// Profiling (siehe --profile und --trace)
+trace* tracer;                      // Die Zeiten der Schritte jedes Bildes (nullptr falls aus)
+std::atomic<bool> hud;              // Die Zeiten des letzten Bildes werden im Titel angezeigt
+
+// Gibt die Zeit der steady_clock in Nanosekunden zurück
+int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Weckt den draw-Thread, der Zeitpunkt der Eingabe wird für die Latenz gemerkt
+ * @param time Der Zeitpunkt der Eingabe
+ */
+void requestRedraw(int64_t time)
+{
+    int64_t none = 0;
+    inputTime.compare_exchange_strong(none, time);
+    redraw = true;
+    // Mit dem Lock geht die Benachrichtigung nicht verloren, falls der draw-Thread gerade prüft
+    frameLock.lock();
+    frameLock.unlock();
+    frameDone.notify_all();
+}
+
+/* Ersetzt die angezeigte Auswahl und zeichnet neu
+ * @param start Mausposition am Anfang des Auswählens
+ * @param mouse Momentane Mausposition
+ */
+void showSelection(mandelbrot::pos start, mandelbrot::pos mouse)
+{
+    shown.store({ (int16_t)start.x, (int16_t)start.y, (int16_t)mouse.x, (int16_t)mouse.y });
+    requestRedraw(now());
+}
+
+/* Verschiebt und zoomt die zu berechnende Fläche und startet die Berechnung
+ * @param px Verschiebung in Pixeln (x)
+ * @param py Verschiebung in Pixeln (y)
+ * @param zoom Faktor der neuen Grösse (0.5 == doppelt so nah)
+ * @return Die neue Fläche
+ */
+mandelbrot::deep moveArea(long px, long py, double zoom)
+{
+    mandelbrot::deep area;
+
+    calcLock.lock();
+    area = calcArea;
+    area.w = calcArea.w * floatexp(zoom);
+    area.h = calcArea.h * floatexp(zoom);
+    // Der Mittelpunkt braucht die Genauigkeit der neuen Pixel
+    size_t limbs = bigfloat::limbsFor(area.w / floatexp((double)res.x));
+    area.x.setLimbs(limbs);
+    area.y.setLimbs(limbs);
+    area.x = area.x + calcArea.w * floatexp((double)px / res.x);
+    area.y = area.y + calcArea.h * floatexp((double)py / res.y);
+    calcArea = area;
+    calcInput = now();
+    pending = true;
+    calcLock.unlock();
+
+    calculate.notify_all();
+    return area;
+}
+
+/* Gibt den Buffer für das nächste Bild zurück. Falls möglich wird direkt in die Textur geschrieben,
+ * sie bleibt bis zur Übernahme durch den draw-Thread gesperrt.
+ * @param t Die Textur
+ */
+mandelbrot::color* beginFrame(int t)
+{
+    std::lock_guard<std::mutex> lck(frameLock);
+    if(direct && !locked[t])
+    {
+        void* pixels;
+        int pitch;
+        SDL_LockTexture(textures[t], NULL, &pixels, &pitch);
+        frames[t] = (mandelbrot::color*)pixels;
+        locked[t] = true;
+    }
+    return frames[t];
+}
+
+/* Übergibt ein fertiges Bild an den draw-Thread, nachdem er das vorherige übernommen hat
+ * @param t Die Textur
+ * @param input Zeitpunkt der Eingabe die zu diesem Bild geführt hat (0 falls keine)
+ */
+void submitFrame(int t, int64_t input)
+{
+    traceScope scope(tracer, "submit", "viewer");
+    std::unique_lock<std::mutex> lck(frameLock);
+    frameDone.wait(lck, []() { return ready < 0 || end; });
+    ready = t;
+    readyInput = input;
+    frameDone.notify_all();
+}
+
+/* Speichert die Zähler des letzten Durchgangs im Trace. Liest dazu den ganzen Iterations-Buffer
+ * (siehe countWork), das kostet etwas Zeit und geschieht deshalb nur mit Profiling.
+ * @param iter Die maximale Anzahl an Iterationen
+ */
+void traceWork(size_t iter)
+{
+    mandelbrot::work w = brot->countWork(iter);
+    const mandelbrot::stats& s = brot->lastStats();
+    int64_t time = now();
+
+    tracer->counter("work", time, { { "iterations", (double)w.iterations }, { "samples", (double)w.samples },
+                                     { "escaped", (double)w.escaped }, { "interior", (double)w.interior } });
+    tracer->counter("stats", time, { { "bulb", (double)s.bulb }, { "periodic", (double)s.periodic },
+                                      { "reused", (double)s.reused }, { "refined", (double)s.refined } });
+}
+
+/* Zeigt die Zeiten und Zähler des letzten Bildes im Titel des Fensters an (SDL hat keine Schrift)
+ * @param window Das Fenster
+ */
+void showHud(SDL_Window* window)
+{
+    std::ostringstream title;
+    double samples = std::max(tracer->last("work/samples"), 1.0);
+    double device = tracer->last("device/iterations") + tracer->last("device/perturbation") + tracer->last("device/refine");
+
+    title.precision(3);
+    title << "Mandelbrot | wake " << tracer->last("viewer/wake") << " ms, pass " << tracer->last("viewer/pass")
+          << " ms (kernel " << device << ", color " << tracer->last("device/color") << ", read " << tracer->last("device/read")
+          << "), upload " << tracer->last("viewer/upload") << " ms, present " << tracer->last("viewer/present")
+          << " ms | " << tracer->last("work/iterations") / 1e6 << " M iterations, " << tracer->last("work/samples")
+          << " samples, " << 100 * tracer->last("work/escaped") / samples << "% escaped, "
+          << 100 * tracer->last("work/interior") / samples << "% interior";
+    SDL_SetWindowTitle(window, title.str().c_str());
+}
 
 // Threat zur Abarbeitung von Eingebe
 void inputThread()
@@ -51,9 +230,13 @@ void inputThread()
     bool stay = true;       // False falls das Programm geschlossen wurde
     bool button = false;    // True falls eine taste gedrücht ist, andernfals false
     bool stop = false;      // True falls die mausposition nichtmehr geändert werden soll
-    mandelbrot::rect tmpArea;   // Variable zum Speichern der Ausgewählten Fläche
+    mandelbrot::deep tmpArea;   // Variable zum Speichern der Ausgewählten Fläche
+    mandelbrot::pos mouse = { 0, 0 };       // Momentane Mausposition
+    mandelbrot::pos mouseStart = { 0, 0 };  // Mausposition am anfang des Auswählens
 
     SDL_Event event;        // Das momentan bearbeitete Event
+
+    tmpArea = calcArea;
     while(stay)
     {
         // Lesen des nächsten Events
@@ -93,27 +276,63 @@ void inputThread()
                             samples--;
                         break;
                     case SDL_SCANCODE_RETURN:
+                    {
                         // Die Ausgewählte Fläche wird zur zu berechnenden gemacht
+                        calcLock.lock();
                         calcArea = tmpArea;
+                        calcInput = now();
+                        pending = true;
+                        calcLock.unlock();
                         // Die Maus soll eine neue Fläche auswählen können
                         stop = false;
                         mouse.x = 0;
                         mouse.y = 0;
                         mouseStart.x = 0;
                         mouseStart.y = 0;
+                        showSelection(mouseStart, mouse);
                         // Benachrichtigen des calc-Threads das gerechnet werden muss
                         calculate.notify_all();
-                        // Ausgabe nützlicher informationen
-                        std::cout << "[" << (calcArea.tl.x + calcArea.br.x)/2 << "/" << (calcArea.tl.y + calcArea.br.y)/2
-                                    << ":" << (calcArea.tl.x - calcArea.br.x) << "/" << (calcArea.tl.y - calcArea.br.y)
-                                    << " i = " << iterationen << ", s = " << samples << "]\n";
+                        // Ausgabe nützlicher informationen (so viele Stellen wie die Pixelgrösse braucht)
+                        size_t digits = 3 - (tmpArea.w / floatexp((double)res.x)).log2() * 0.30103;
+                        if(digits < 16)
+                            digits = 16;
+                        std::cout << "[" << tmpArea.x.toString(digits) << "/" << tmpArea.y.toString(digits)
+                                    << ":" << (-tmpArea.w).toString() << "/" << (-tmpArea.h).toString()
+                                    << " i = " << iterationen << ", s = " << samples << ", "
+                                    << mandelbrot::precisionName(brot->precisionOf(tmpArea, res, samples)) << "]\n";
+                        break;
+                    }
+                    case SDL_SCANCODE_W:
+                        // Verschieben um ganze Pixel, nur der neue Streifen wird gerechnet
+                        tmpArea = moveArea(0, -(long)(res.y / PAN_FRACTION), 1);
+                        break;
+                    case SDL_SCANCODE_S:
+                        tmpArea = moveArea(0, res.y / PAN_FRACTION, 1);
+                        break;
+                    case SDL_SCANCODE_A:
+                        tmpArea = moveArea(-(long)(res.x / PAN_FRACTION), 0, 1);
+                        break;
+                    case SDL_SCANCODE_D:
+                        tmpArea = moveArea(res.x / PAN_FRACTION, 0, 1);
+                        break;
+                    case SDL_SCANCODE_PAGEUP:
+                        // Zoomen um die Mitte, jedes zweite Sample wird übernommen
+                        tmpArea = moveArea(0, 0, 0.5);
+                        break;
+                    case SDL_SCANCODE_PAGEDOWN:
+                        tmpArea = moveArea(0, 0, 2);
                         break;
                     case SDL_SCANCODE_BACKSPACE:
                         // Zurüchsetzen auf die Ausgangsposition
-                        tmpArea.tl.x = DEF_X0;
-                        tmpArea.tl.y = DEF_Y0;
-                        tmpArea.br.x = DEF_X1;
-                        tmpArea.br.y = DEF_Y1;
+                        tmpArea = mandelbrot::toDeep({ { DEF_X0, DEF_Y0 }, { DEF_X1, DEF_Y1 } });
+                        break;
+                    case SDL_SCANCODE_H:
+                        // Ein- und Ausschalten des HUD (nur mit Profiling)
+                        if(tracer != nullptr)
+                        {
+                            hud = !hud;
+                            requestRedraw(now());
+                        }
                         break;
                     default:
                         break;
@@ -128,18 +347,31 @@ void inputThread()
                 button = true;
                     // Es soll eine neue Fläche ausgewählt werden können
                 stop = false;
+                showSelection(mouseStart, mouse);
                 break;
             case SDL_MOUSEBUTTONUP:
+            {
                 // Der Mausknopf ist nichtmehr gedrückt
                 button = false;
-                // Die ausgewählte Fläche wird berechnet
-                tmpArea.tl.x = calcArea.tl.x + (calcArea.br.x - calcArea.tl.x)*mouseStart.x/res.x;
-                tmpArea.tl.y = calcArea.tl.y + (calcArea.br.y - calcArea.tl.y)*mouseStart.y/res.y;
-                tmpArea.br.x = calcArea.tl.x + (calcArea.br.x - calcArea.tl.x)*mouse.x/res.x;
-                tmpArea.br.y = calcArea.tl.y + (calcArea.br.y - calcArea.tl.y)*mouse.y/res.y;
+                // Die ausgewählte Fläche wird berechnet, relativ zur Mitte der momentanen Fläche
+                double x0 = mouseStart.x/res.x - 0.5;
+                double y0 = mouseStart.y/res.y - 0.5;
+                double x1 = mouse.x/res.x - 0.5;
+                double y1 = mouse.y/res.y - 0.5;
+                tmpArea.w = calcArea.w * floatexp(x1 - x0);
+                tmpArea.h = calcArea.h * floatexp(y1 - y0);
+                // Der Mittelpunkt braucht die Genauigkeit der neuen Pixel
+                size_t limbs = bigfloat::limbsFor(tmpArea.w / floatexp((double)res.x));
+                tmpArea.x = calcArea.x;
+                tmpArea.y = calcArea.y;
+                tmpArea.x.setLimbs(limbs);
+                tmpArea.y.setLimbs(limbs);
+                tmpArea.x = tmpArea.x + calcArea.w * floatexp((x0 + x1) / 2);
+                tmpArea.y = tmpArea.y + calcArea.h * floatexp((y0 + y1) / 2);
                 // Die Auswahl soll nicht bewegt werden
                 stop = true;
                 break;
+            }
             case SDL_MOUSEMOTION:
                 // Mausbewegung
                 // Falls sich die Auswahl ändern soll
@@ -155,39 +387,234 @@ void inputThread()
                         mouseStart.x = event.motion.x;
                         mouseStart.y = event.motion.y;
                     }
+                    showSelection(mouseStart, mouse);
                 }
                 break;
+            case SDL_WINDOWEVENT:
+                // Das Fenster muss neu gezeichnet werden (z.B. wieder sichtbar)
+                requestRedraw(now());
+                break;
             default:
                 break;
         }
     }
 }
 
+/* Rechnet die im Cache fehlenden Kacheln eines Bildes einzeln, speichert sie und übergibt das aus den
+ * Kacheln zusammengesetzte Bild an den draw-Thread
+ * @param t Die hintere Textur (danach die nächste)
+ * @param input Zeitpunkt der Eingabe zur Fläche (danach 0)
+ * @param area Die Fläche des Bildes
+ * @param grid Die Lage des Bildes auf dem Gitter der Kacheln
+ * @param missing Die fehlenden Kacheln
+ * @param iter Die maximale Anzahl an Iterationen
+ * @param samp Die Anzahl Samples pro Pixel
+ * @return false falls die Berechnung abgebrochen wurde
+ */
+bool calculateTiles(int& t, int64_t& input, const mandelbrot::deep& area, const tileCache::grid& grid,
+                    const std::vector<tileCache::key>& missing, size_t iter, size_t samp)
+{
+    std::vector<mandelbrot::color> tile(TILE_SIZE * TILE_SIZE);
+    mandelbrot::res size = { TILE_SIZE, TILE_SIZE };
+
+    for(const tileCache::key& k : missing)
+    {
+        traceScope scope(tracer, "tile", "viewer");
+        if(!brot->computeImage(tile.data(), size, tiles->tileArea(k), iter, samp))
+            return false;
+        brot->waitImage(tile.data());
+        tiles->put(k, tile.data());
+    }
+
+    // Jetzt sind alle Kacheln im Cache, das Bild ist auch die Vorschau der nächsten Fläche
+    std::vector<tileCache::key> none;
+    mandelbrot::color* frame = beginFrame(t);
+    tiles->assemble(frame, res, grid, iter, samp, brot->getFormula(), none);
+    brot->keepImage(frame, res, area);
+    submitFrame(t, input);
+    t = 1 - t;
+    input = 0;
+    return true;
+}
+
 // Thread zum errechnen der Darstellung mithilfe des Mandelbrot-Moduls
 void calculationThread()
 {
+    mandelbrot::deep area;
+    int t = 0;          // Die hintere Textur, in die das nächste Bild kommt
+    int64_t input;      // Zeitpunkt der Eingabe zur Fläche, bis zu ihrem ersten Bild
+
+    if(tracer != nullptr)
+        tracer->nameThread("calculation");
+
     // Solange nicht beendet werden soll
     while(!end)
     {
-        // Berechnen des Bildes
-        brot->computeImage(colorBuffer, res, calcArea, iterationen, samples);
+        // Kopieren der Fläche, da sie vom input-Thread geändert werden kann
+        calcLock.lock();
+        area = calcArea;
+        input = calcInput;
+        calcInput = 0;
+        pending = false;
+        calcLock.unlock();
+        // Die Zeit von der Eingabe bis der calc-Thread sie übernimmt
+        if(tracer != nullptr && input != 0)
+            tracer->span("wake", "viewer", input, now());
+        // Die Einstellungen gelten für die ganze Fläche
+        size_t iter = iterationen;
+        size_t samp = samples;
+
+        // Sofortige Vorschau aus dem letzten Bild, darüber die Kacheln aus dem Cache
+        tileCache::grid grid;
+        bool aligned = tiles != nullptr && tiles->align(area, res, grid);
+        std::vector<tileCache::key> missing;
+        bool previewed;
+        {
+            traceScope scope(tracer, "preview", "viewer");
+            mandelbrot::color* frame = beginFrame(t);
+            previewed = brot->preview(frame, res, area);
+            if(aligned && tiles->assemble(frame, res, grid, iter, samp, brot->getFormula(), missing) > 0)
+                previewed = true;
+            // Sind alle Kacheln im Cache, ist die Vorschau schon das fertige Bild
+            if(aligned && missing.empty())
+                brot->keepImage(frame, res, area);
+        }
+        if(previewed)
+        {
+            submitFrame(t, input);
+            t = 1 - t;
+            input = 0;
+        }
 
-        // Übertragen des Bildes in die Textur
-        SDL_UpdateTexture(tex, NULL, (void*)colorBuffer, res.x * sizeof(mandelbrot::color));
+        /* Berechnen des Bildes in Durchgängen von grob zu fein, jeder Durchgang rechnet nur die
+         * fehlenden Samples und wird sofort angezeigt. Wird eine neue Fläche angefordert, bricht
+         * computeImage ab und es wird sofort mit der neuen begonnen. Das Bild wird noch übertragen
+         * und hochgeladen während schon der nächste Durchgang rechnet (siehe setAsync).
+         */
+        size_t steps[] = { PREVIEW_STEP * samp, PREVIEW_STEP / 2 * samp, samp, 1 };
+        mandelbrot::stats stats = { 0, 0, 0, 0, 0, 0 };
+        bool complete = true;
+        if(aligned && missing.empty())
+            std::cout << "[all tiles from cache]\n";
+        // Fehlen nur wenige Kacheln, werden nur diese gerechnet
+        else if(aligned && missing.size() * TILE_SIZE * TILE_SIZE * TILE_MISSING_FRACTION <= res.x * res.y)
+        {
+            complete = calculateTiles(t, input, area, grid, missing, iter, samp);
+            if(complete)
+                std::cout << "[computed " << missing.size() << " missing tiles]\n";
+        }
+        else for(size_t p = 0; p < sizeof(steps) / sizeof(steps[0]) && complete; p++)
+        {
+            if(p > 0 && steps[p] == steps[p - 1])
+                continue;
+            {
+                traceScope scope(tracer, "pass", "viewer");
+                complete = brot->computeImage(beginFrame(t), res, area, iter, samp, steps[p]);
+            }
+            if(!complete)
+                break;
+            if(tracer != nullptr)
+                traceWork(iter);
+            // Die fertigen Kacheln kommen in den Cache, bevor der draw-Thread die Textur übernimmt
+            if(aligned && steps[p] == 1)
+            {
+                brot->waitImage(frames[t]);
+                tiles->store(frames[t], res, grid, iter, samp, brot->getFormula());
+            }
+            // Übergeben des Bildes an den draw-Thread
+            submitFrame(t, input);
+            t = 1 - t;
+            input = 0;
+            // Die Statistik wird über alle Durchgänge zusammengezählt
+            const mandelbrot::stats& last = brot->lastStats();
+            stats.skipped = std::max(stats.skipped, last.skipped);
+            stats.bulb += last.bulb;
+            stats.periodic += last.periodic;
+            stats.reused += last.reused;
+            stats.refined += last.refined;
+            stats.filled += last.filled;
+        }
+
+        if(complete)
+        {
+            // Ausgabe der vom letzten Bild übernommenen Samples
+            if(stats.reused > 0)
+                std::cout << "[reused " << stats.reused << " samples]\n";
+
+            // Ausgabe der Pixel die beim adaptiven Supersampling alle Samples bekommen haben
+            if(stats.refined > 0)
+                std::cout << "[refined " << stats.refined << " of " << res.x * res.y << " pixels]\n";
+
+            // Ausgabe des Anteils der Samples die beim Unterteilen gefüllt statt gerechnet wurden
+            if(stats.filled > 0)
+                std::cout << "[filled " << 100.0 * stats.filled / (res.x * res.y * samp * samp) << "% of samples]\n";
+
+            // Ausgabe der übersprungenen Iterationen bei tiefen Zooms
+            if(stats.skipped > 0)
+                std::cout << "[skipped " << stats.skipped << " of " << iter << " iterations]\n";
+
+            // Ausgabe der Samples die als innen erkannt wurden
+            if(stats.bulb + stats.periodic > 0)
+                std::cout << "[interior: " << stats.bulb << " in cardioid/bulb, "
+                            << stats.periodic << " periodic]\n";
+        }
 
         // Warten bis die Berechnung wieder fon nöten ist
         std::unique_lock<std::mutex> lck(calcLock);
-        calculate.wait(lck);
+        calculate.wait(lck, []() { return pending || end; });
     }
 }
 
-/* Thread zum Zeichne der Operfläche mithilfe von SDL
+// Summe der gemessenen Latenzen seit der letzten Ausgabe
+struct latency
+{
+    size_t n;       // Anzahl Messungen
+    double sum;     // Summe in Millisekunden
+    double max;     // Maximum in Millisekunden
+};
+
+/* Fügt eine Messung hinzu
+ * @param l Die Latenzen
+ * @param ns Die gemessene Latenz in Nanosekunden
+ */
+void addLatency(latency& l, int64_t ns)
+{
+    double ms = ns / 1e6;
+    l.n++;
+    l.sum += ms;
+    l.max = std::max(l.max, ms);
+}
+
+/* Gibt den Durchschnitt und das Maximum gerundet auf 0.1 ms aus
+ * @param name Die Bezeichnung
+ * @param l Die Latenzen (mindestens eine Messung)
+ */
+void printLatency(const char* name, const latency& l)
+{
+    std::cout << " " << name << ": " << std::round(l.sum / l.n * 10) / 10
+                << " ms (max " << std::round(l.max * 10) / 10 << " ms)";
+}
+
+/* Thread zum Zeichne der Operfläche mithilfe von SDL. Gezeichnet wird nur wenn sich etwas geändert
+ * hat: ein neues Bild vom calc-Thread, eine neue Auswahl oder ein Ereignis des Fensters.
+ * @param window Das Fenster (für das HUD)
  * @param renderer Der zu nutzende Renderer
+ * @param vsync true falls SDL_RenderPresent auf das nächste Bild des Bildschirms wartet
  */
-void drawingThread(SDL_Renderer* renderer)
+void drawingThread(SDL_Window* window, SDL_Renderer* renderer, bool vsync)
 {
     // Rect zum temporären speichern eines Rechtecks -> Auswahl
     SDL_Rect rect;
+    // Latenzen von der Eingabe bis zur angezeigten Auswahl bzw. bis zum ersten Bild der neuen Fläche
+    latency shownInput = { 0, 0, 0 };
+    latency shownArea = { 0, 0, 0 };
+    int64_t lastReport = now();
+    int64_t lastPresent = 0;
+    int64_t lastHud = 0;
+    bool hudShown = false;
+
+    if(tracer != nullptr)
+        tracer->nameThread("draw");
 
     // Setzt den Blend-Mode des Renderers für transparente Auswahl
     SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
@@ -195,30 +622,102 @@ void drawingThread(SDL_Renderer* renderer)
     // Solange nicht beendet werden soll
     while(!end)
     {
+        // Warten bis es etwas neues zu zeichnen gibt
+        std::unique_lock<std::mutex> lck(frameLock);
+        frameDone.wait(lck, []() { return ready >= 0 || redraw || end; });
+        redraw = false;
+        int64_t frameInput = 0;
+        bool newFrame = ready >= 0;
+        if(ready >= 0)
+        {
+            // Warten bis das Bild im RAM ist, dann hochladen und anzeigen
+            brot->waitImage(frames[ready]);
+            traceScope scope(tracer, "upload", "viewer");
+            if(direct)
+            {
+                SDL_UnlockTexture(textures[ready]);
+                locked[ready] = false;
+            }
+            else
+                SDL_UpdateTexture(textures[ready], NULL, (void*)frames[ready], res.x * sizeof(mandelbrot::color));
+            front = ready;
+            frameInput = readyInput;
+            ready = -1;
+            frameDone.notify_all();
+        }
+        lck.unlock();
+        // Alle bis hierher eingegangenen Eingaben sind in diesem Frame
+        int64_t input = inputTime.exchange(0);
+        selection sel = shown.load();
+
         // Rendern der Textur
-        SDL_RenderCopy(renderer, tex, NULL, NULL);
+        SDL_RenderCopy(renderer, textures[front], NULL, NULL);
         // Einstellung des Rects für die Auswahl
-        rect.x = mouseStart.x;
-        rect.y = mouseStart.y;
-        rect.w = mouse.x - mouseStart.x;
-        rect.h = mouse.y - mouseStart.y;
+        rect.x = sel.x0;
+        rect.y = sel.y0;
+        rect.w = sel.x1 - sel.x0;
+        rect.h = sel.y1 - sel.y0;
         // Renderen der Auswahl
         SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
         SDL_RenderDrawRect(renderer, &rect);
         SDL_SetRenderDrawColor(renderer, 255, 0, 0, 125);
         SDL_RenderFillRect(renderer, &rect);
-        // Anzeigen des Framebuffers
+        // Ohne VSync liegen mindestens FRAME_MS zwischen zwei Frames
+        if(!vsync && lastPresent != 0)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(lastPresent + FRAME_MS * 1000000LL - now()));
+        // Anzeigen des Framebuffers (mit VSync inklusive Warten auf den Bildschirm)
+        int64_t present = now();
         SDL_RenderPresent(renderer);
-        // 50 ms Sleep
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        lastPresent = now();
+
+        if(tracer != nullptr)
+        {
+            tracer->span("present", "viewer", present, lastPresent);
+            // Ein Bild im Trace reicht von einem neuen Bild des calc-Threads zum nächsten
+            if(newFrame)
+                tracer->endFrame();
+            if(hud && lastPresent - lastHud >= HUD_UPDATE_MS * 1000000LL)
+            {
+                showHud(window);
+                lastHud = lastPresent;
+            }
+            else if(!hud && hudShown)
+                SDL_SetWindowTitle(window, "Mandelbrot");
+            hudShown = hud;
+        }
+
+        // Messen und regelmässige Ausgabe der Latenz
+        if(input != 0)
+            addLatency(shownInput, lastPresent - input);
+        if(frameInput != 0)
+            addLatency(shownArea, lastPresent - frameInput);
+        if(lastPresent - lastReport >= LATENCY_REPORT_MS * 1000000LL && shownInput.n + shownArea.n > 0)
+        {
+            std::cout << "[latency";
+            if(shownInput.n > 0)
+                printLatency("input to present", shownInput);
+            if(shownArea.n > 0)
+                printLatency("input to new area", shownArea);
+            std::cout << "]\n";
+            shownInput = { 0, 0, 0 };
+            shownArea = { 0, 0, 0 };
+            lastReport = lastPresent;
+        }
     }
 }
 
-int main()
+int main(int argc, char** argv)
 {
     // Any infringment of the given Copyright might result in legal actions
     std::cout << "(C) Copyright 2018 by Roland Bernard. All rights reserved.\n";
     end = false;
+    pending = false;
+    redraw = true;
+    ready = -1;
+    front = 0;
+    inputTime = 0;
+    calcInput = 0;
+    shown.store({ 0, 0, 0, 0 });
     std::cout.precision(16);
 
     // Setzen der Fenstergröse
@@ -228,10 +727,7 @@ int main()
     // Setzen der Default-Werte
     iterationen = DEF_ITERATIONEN;
     samples = DEF_SAMPLES;
-    calcArea.tl.x = DEF_X0;
-    calcArea.tl.y = DEF_Y0;
-    calcArea.br.x = DEF_X1;
-    calcArea.br.y = DEF_Y1;
+    calcArea = mandelbrot::toDeep({ { DEF_X0, DEF_Y0 }, { DEF_X1, DEF_Y1 } });
 
     // Initzialisieren von SDL
     SDL_Init(SDL_INIT_EVERYTHING);
@@ -240,23 +736,107 @@ int main()
     SDL_Window* window = SDL_CreateWindow("Mandelbrot", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, res.x, res.y, 0);
 
     // Erstellen eines neuen Renderers für des eben erstelte Fenster
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, 0);
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
+    // Nicht jeder Renderer kann VSync, dann begrenzt der draw-Thread selbst (FRAME_MS)
+    SDL_RendererInfo info;
+    bool vsync = SDL_GetRendererInfo(renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC) != 0;
+
+    // Erstellen der Texturen
+    for(int t = 0; t < 2; t++)
+    {
+        textures[t] = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, res.x, res.y);
+        locked[t] = false;
+    }
 
-    // Erstellen der Textur und des Buffers
-    tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, res.x, res.y);
-    colorBuffer = new mandelbrot::color[res.x * res.y];
+    // Direkt in die Texturen geschrieben wird nur, wenn ihre Zeilen ohne Lücken aufeinander folgen
+    void* pixels;
+    int pitch;
+    SDL_LockTexture(textures[0], NULL, &pixels, &pitch);
+    SDL_UnlockTexture(textures[0]);
+    direct = (size_t)pitch == res.x * sizeof(mandelbrot::color);
+    for(int t = 0; t < 2; t++)
+        frames[t] = direct ? nullptr : new mandelbrot::color[res.x * res.y];
+
+    /* Auswahl des Backends (--cpu für das native Backend, --multi für alle Devices), des Supersamplings
+     * (--adaptive), des Unterteilens (--subdivide, --subdivide-check mit Kontrolle) und der Genauigkeit
+     * (--double rechnet auch flache Bilder in double, --no-dd tiefe immer mit Störungsrechnung) und der
+     * Formel (--julia X Y, --power N, --burning-ship). --no-cache schaltet
+     * den Cache der Kacheln aus, dessen Wurzel die Ausgangsposition ist. Mit --profile
+     * werden die Zeiten jedes Bildes gemessen (HUD mit H), --trace FILE schreibt sie am Ende als
+     * Chrome-Trace.
+     */
+    mandelbrot::backend backend = mandelbrot::OPENCL;
+    bool adaptive = false;
+    bool subdivide = false;
+    bool check = false;
+    bool single = true;
+    bool doubleDouble = true;
+    mandelbrot::formula formula = { mandelbrot::MANDELBROT, 2, false, 0, 0 };
+    const char* traceFile = nullptr;
+    bool cache = true;
+    tracer = nullptr;
+    hud = false;
+    for(int a = 1; a < argc; a++)
+    {
+        if(strcmp(argv[a], "--cpu") == 0)
+            backend = mandelbrot::NATIVE;
+        else if(strcmp(argv[a], "--multi") == 0)
+            backend = mandelbrot::MULTI;
+        else if(strcmp(argv[a], "--adaptive") == 0)
+            adaptive = true;
+        else if(strcmp(argv[a], "--subdivide") == 0)
+            subdivide = true;
+        else if(strcmp(argv[a], "--subdivide-check") == 0)
+            subdivide = check = true;
+        else if(strcmp(argv[a], "--double") == 0)
+            single = false;
+        else if(strcmp(argv[a], "--no-dd") == 0)
+            doubleDouble = false;
+        else if(strcmp(argv[a], "--julia") == 0 && a + 2 < argc)
+        {
+            formula.julia = true;
+            formula.jx = atof(argv[++a]);
+            formula.jy = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--power") == 0 && a + 1 < argc)
+        {
+            formula.type = mandelbrot::MULTIBROT;
+            formula.power = atoi(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--burning-ship") == 0)
+            formula.type = mandelbrot::BURNING_SHIP;
+        else if(strcmp(argv[a], "--no-cache") == 0)
+            cache = false;
+        else if(strcmp(argv[a], "--profile") == 0 && tracer == nullptr)
+            tracer = new trace();
+        else if(strcmp(argv[a], "--trace") == 0 && a + 1 < argc)
+        {
+            traceFile = argv[++a];
+            if(tracer == nullptr)
+                tracer = new trace();
+        }
+    }
 
-    // Initialisierung des Mandelbrot-Moduls
-    brot = new mandelbrot();
+    // Initialisierung des Mandelbrot-Moduls, neue Flächen brechen die laufende Berechnung ab
+    brot = new mandelbrot(backend);
+    brot->setCancel(&pending);
+    brot->setAdaptive(adaptive);
+    brot->setSubdivide(subdivide, check);
+    brot->setSingle(single);
+    brot->setDoubleDouble(doubleDouble);
+    brot->setFormula(formula);
+    brot->setAsync(true);
+    brot->setTrace(tracer);
     brot->listDevices();
 
     // Erstellen des OpenCL-Buffers mit der benötigten größe
-    brot->createBuffer(res, (void*)colorBuffer);
+    brot->createBuffer(res);
+    tiles = cache ? new tileCache(calcArea, res) : nullptr;
 
     // Starten der drei Threats
     std::thread* input = new std::thread(inputThread);
     std::thread* calc = new std::thread(calculationThread);
-    std::thread* draw = new std::thread(drawingThread, renderer);
+    std::thread* draw = new std::thread(drawingThread, window, renderer, vsync);
 
     // Warten bis der Input Thread beendet ist => Das Programm soll schliesen
     input->join();
@@ -266,6 +846,10 @@ int main()
 
     // Entsperren des calc-Threads
     calculate.notify_all();
+    // Entsperren des draw-Threads (mit dem Lock, siehe requestRedraw)
+    frameLock.lock();
+    frameLock.unlock();
+    frameDone.notify_all();
 
     // Beenden der beiden übrigen Threads
     calc->join();
@@ -275,6 +859,20 @@ int main()
     brot->deleteBuffer();
     // Sicheres beenden des Mandelbrots
     delete brot;
+    delete tiles;
+
+    // Schreiben des Traces, nachdem das Mandelbrot-Modul die Zeiten der letzten Befehle gespeichert hat
+    if(traceFile != nullptr && !tracer->write(traceFile))
+        std::cerr << "Failed to write " << traceFile << "\n";
+    delete tracer;
+
+    // Zerstören der Texturen
+    for(int t = 0; t < 2; t++)
+    {
+        SDL_DestroyTexture(textures[t]);
+        if(!direct)
+            delete[] frames[t];
+    }
 
     // Zerstören des Fensters
     SDL_DestroyWindow(window);
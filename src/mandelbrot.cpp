@@ -6,9 +6,22 @@
  * */
 
 #include "mandelbrot.hpp"
+#include "native.hpp"
+#include "perturbation.hpp"
+#include "trace.hpp"
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+#include <chrono>
+#include <string>
+
+// Der Quelltext von mandelbrot.cl als kernelSource, wird vom makefile erzeugt
+#include "mandelbrot_cl.hpp"
 
 //#define DEBUG
 
@@ -17,9 +30,33 @@
 #define caseHelper(x, y) case x: fprintf(stderr, y); break;
 #endif
 
-// Maximale Länge der Datei mandelbrot.cl und der Fehlerberichte
+// Maximale Länge der Fehlerberichte
 #define MAX_STRING_SIZE 65536
 
+// Umgebungsvariable für das Verzeichnis der compilierten Programme (leer um den Cache abzuschalten)
+#define PROGRAM_CACHE_ENV "MANDELBROT_CACHE"
+// Kennung am Anfang einer Datei im Cache
+#define PROGRAM_CACHE_MAGIC "MBCL"
+
+// Anzahl an Zeilen (von Samples) pro Aufruf von computeIterations bei CHUNKED
+#define CHUNK_ROWS 32
+// Größe der Kacheln von computeIterationsPersistent (siehe mandelbrot.cl)
+#define TILE_WIDTH 16
+#define TILE_HEIGHT 16
+// Gewünschte Größe einer Work-Group und Anzahl Work-Groups pro Compute-Unit bei PERSISTENT
+#define PERSISTENT_GROUP_SIZE 64
+#define PERSISTENT_GROUPS_PER_UNIT 8
+// Bis zu dieser Anzahl Samples pro Pixel gibt es eigene Varianten der Kernel (siehe kernels)
+#define KERNEL_FIXED_SAMPLES 4
+// Kalibrier-Bild des Auto-Tuners (siehe tune): Seepferdchen-Tal, viel Rand mit sehr unterschiedlichen Iterationen
+#define TUNE_RES 512
+#define TUNE_ITERATIONS 2000
+#define TUNE_X -0.745
+#define TUNE_Y 0.105
+#define TUNE_WIDTH 0.03
+// Anzahl Messungen pro Kandidat des Auto-Tuners, die schnellste zählt
+#define TUNE_RUNS 3
+
 // Funktion überprüft ob ein Fehler forliegt
 void error(cl_int res, const char* err)
 {
@@ -45,43 +82,94 @@ void error(cl_int res, const char* err)
     }
 }
 
-mandelbrot::mandelbrot()
+mandelbrot::mandelbrot(backend b, cl_device_id device)
 {
     cl_int res;
 
-    // String für mögliche Buildfehler
-    char *info = (char*)malloc(MAX_STRING_SIZE);
+    _backend = b;
+    _schedule = TILED;
+    _tuning.local[0] = 16;
+    _tuning.local[1] = 8;
+    _tuning.per = 1;
+    _tuned = false;
+    _adaptive = false;
+    _subdivide = false;
+    _subdivideCheck = false;
+    _single = true;
+    _singleUsed = false;
+    _doubleDouble = true;
+    _formula = { MANDELBROT, 2, false, 0, 0 };
+    _native = nullptr;
+    _reference = new reference();
+    _stats.skipped = 0;
+    _stats.bulb = 0;
+    _stats.periodic = 0;
+    _stats.reused = 0;
+    _stats.refined = 0;
+    _stats.filled = 0;
+    _view.samples = 0;
+    _lastRes.x = 0;
+    _lastRes.y = 0;
+    _keepTarget = nullptr;
+    _cancel = nullptr;
+    _trace = nullptr;
+    _track = 0;
+    _profiled = nullptr;
+    _clockOffset = 0;
+    _async = false;
+    _imageNext = 0;
+    for(size_t k = 0; k < IMAGE_BUFFERS; k++)
+    {
+        _image[k] = nullptr;
+        _transfers[k].event = nullptr;
+        _transfers[k].target = nullptr;
+    }
 
-    FILE *fp;
-    char fileName[] = "./kernel/mandelbrot.cl";
-    char *source_str;
-    size_t source_size;
+    // Das native Backend benötigt kein OpenCL
+    if(_backend == NATIVE)
+    {
+        _native = new native();
+        return;
+    }
 
-    /* Laden der Kernel*/
-    fp = fopen(fileName, "r");
-    if (!fp) {
-        fprintf(stderr, "Failed to load kernel.\n");
-        exit(1);
+    // Bei MULTI rechnet je ein eigenes Mandelbrot-Modul pro OpenCL-Device und eines nativ
+    if(_backend == MULTI)
+    {
+        for(cl_device_id id : devices())
+            _devices.push_back({ new mandelbrot(OPENCL, id), 0 });
+        _devices.push_back({ new mandelbrot(NATIVE), 0 });
+        return;
     }
-    source_str = (char*)malloc(MAX_STRING_SIZE);
-    source_size = fread(source_str, 1, MAX_STRING_SIZE, fp);
-    fclose(fp);
 
-    cl_uint num_platforms;
+    if(device != nullptr)
+    {
+        // Das gewählte Device und seine Platform
+        _device_id = device;
+        res = clGetDeviceInfo(_device_id, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &_platform_id, NULL);
+        error(res, "Failed to get PlatformID.");
+    }
+    else
+    {
+        cl_uint num_platforms;
 
-    // Abrufen der Platform
-    res = clGetPlatformIDs(1, &_platform_id, &num_platforms);
-    error(res, "Failed to get PlatformID.");
+        // Abrufen der Platform
+        res = clGetPlatformIDs(1, &_platform_id, &num_platforms);
+        error(res, "Failed to get PlatformID.");
 
-    cl_uint num_devices;
+        cl_uint num_devices;
 
-    // Abrufen des Devices
-    res = clGetDeviceIDs(_platform_id, CL_DEVICE_TYPE_ALL, 1, &_device_id, &num_devices);
-    error(res, "Failed to get DeviceID.");
+        // Abrufen des Devices
+        res = clGetDeviceIDs(_platform_id, CL_DEVICE_TYPE_ALL, 1, &_device_id, &num_devices);
+        error(res, "Failed to get DeviceID.");
+    }
 
     // Laden von Command Queue Eigenschaften
     cl_command_queue_properties queueProp;
     clGetDeviceInfo(_device_id, CL_DEVICE_QUEUE_PROPERTIES, sizeof(cl_command_queue_properties), &queueProp, NULL);
+    // Die Befehle einer Queue hängen voneinander ab und müssen in Reihenfolge ausgeführt werden
+    queueProp &= ~(cl_command_queue_properties)CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+    // Die Zeiten der Befehle für setTrace (jedes Device kann das, es kostet ohne Events nichts)
+    queueProp |= CL_QUEUE_PROFILING_ENABLE;
 
     // Erstellen des Centexts
     _context = clCreateContext(NULL, 1, &_device_id, NULL, NULL, &res);
@@ -90,41 +178,503 @@ mandelbrot::mandelbrot()
     // Erstellen des Command Queues
     _command_queue = clCreateCommandQueue(_context, _device_id, queueProp, &res);
     error(res, "Failed to create Command Queue.");
+    // Die Bilder werden in einer eigenen Queue übertragen, so überlappt das mit der nächsten Berechnung
+    _transfer_queue = clCreateCommandQueue(_context, _device_id, queueProp, &res);
+    error(res, "Failed to create Command Queue.");
+
+    // Erstellen des Programmes (aus dem Cache falls möglich), die Varianten folgen bei Bedarf
+    _program = buildProgram("");
+
+    // Erstellen der Kernel
+    _kernelPerturbation = clCreateKernel(_program, "computePerturbation", &res);
+    error(res, "Failed to create Kernal.");
+    _kernelDD = clCreateKernel(_program, "computeIterationsDD", &res);
+    error(res, "Failed to create Kernal.");
+    _kernelReproject = clCreateKernel(_program, "reprojectSamples", &res);
+    error(res, "Failed to create Kernal.");
+    _kernelClassify = clCreateKernel(_program, "classifyRects", &res);
+    error(res, "Failed to create Kernal.");
+    _kernelFill = clCreateKernel(_program, "fillRects", &res);
+    error(res, "Failed to create Kernal.");
+
+    // Die Buffer für den Referenz-Orbit und die Iterationen werden erst bei Bedarf erstellt
+    _orbit = nullptr;
+    _orbitSize = 0;
+    _smooth = nullptr;
+    _state = nullptr;
+    _count = nullptr;
+    _bufferSize = 0;
+    _oldSmooth = nullptr;
+    _oldState = nullptr;
+    _oldCount = nullptr;
+    _oldBufferSize = 0;
+    _edgeList = nullptr;
+    _edgeListSize = 0;
+    _edgeLength = 0;
+    _sampleList = nullptr;
+    _sampleListSize = 0;
+    _rects = nullptr;
+    _classes = nullptr;
+    _rectsSize = 0;
+    _classesSize = 0;
+
+    // Erstellen des Zählers für computeIterationsPersistent
+    _next = clCreateBuffer(_context, CL_MEM_READ_WRITE, sizeof(cl_uint), nullptr, &res);
+    error(res, "Failed to create Buffer.");
+
+    // Erstellen der Zähler für vorzeitig beendete und gefüllte Samples
+    _counters = clCreateBuffer(_context, CL_MEM_READ_WRITE, 3*sizeof(cl_uint), nullptr, &res);
+    error(res, "Failed to create Buffer.");
+
+    // Erstellen der Länge der Liste von findEdges
+    _edgeCount = clCreateBuffer(_context, CL_MEM_READ_WRITE, sizeof(cl_uint), nullptr, &res);
+    error(res, "Failed to create Buffer.");
+
+    // Es werden nur so viele Work-Groups gestartet wie das Device gleichzeitig ausführen kann
+    cl_uint computeUnits;
+    clGetDeviceInfo(_device_id, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+    _groups = computeUnits * PERSISTENT_GROUPS_PER_UNIT;
+}
+
+// FNV-1a Hash über n Bytes, h ist der Hash der vorherigen Daten
+static uint64_t hashBytes(const void* data, size_t n, uint64_t h = 0xcbf29ce484222325ULL)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+
+    for(size_t b = 0; b < n; b++)
+    {
+        h ^= bytes[b];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Gibt einen String aus den Informationen des Devices zurück
+static std::string deviceString(cl_device_id device, cl_device_info param)
+{
+    size_t size = 0;
+
+    if(clGetDeviceInfo(device, param, 0, NULL, &size) != CL_SUCCESS || size == 0)
+        return "";
+    std::string value(size, '\0');
+    clGetDeviceInfo(device, param, size, &value[0], NULL);
+    value.resize(strlen(value.c_str()));
+    return value;
+}
+
+std::string mandelbrot::cacheDirectory()
+{
+    std::string dir;
+    const char* env = getenv(PROGRAM_CACHE_ENV);
+
+    if(env != nullptr)
+        dir = env;
+    else if((env = getenv("XDG_CACHE_HOME")) != nullptr && env[0] != '\0')
+        dir = std::string(env) + "/mandelbrot";
+    else if((env = getenv("HOME")) != nullptr && env[0] != '\0')
+        dir = std::string(env) + "/.cache/mandelbrot";
+    if(dir.empty())
+        return dir;
+
+    // Erstellt alle fehlenden Verzeichnisse, Fehler zeigen sich erst beim Schreiben der Datei
+    for(size_t p = dir.find('/', 1); p != std::string::npos; p = dir.find('/', p + 1))
+        mkdir(dir.substr(0, p).c_str(), 0755);
+    mkdir(dir.c_str(), 0755);
+    return dir;
+}
+
+/* Liest ein Binary aus dem Cache
+ * @param path Der Pfad der Datei
+ * @param key Der Schlüssel, muss mit dem in der Datei übereinstimmen
+ * @param binary Das gelesene Binary
+ * @return false falls die Datei fehlt, unvollständig ist oder zu einem anderen Schlüssel gehört
+ */
+static bool loadBinary(const std::string& path, const std::string& key, std::vector<unsigned char>& binary)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if(file == nullptr)
+        return false;
+
+    char magic[4];
+    uint64_t keySize, size;
+    bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, PROGRAM_CACHE_MAGIC, 4) == 0
+                && fread(&keySize, sizeof(keySize), 1, file) == 1 && keySize == key.size();
+    if(ok)
+    {
+        std::string stored(keySize, '\0');
+        ok = fread(&stored[0], 1, keySize, file) == keySize && stored == key
+                && fread(&size, sizeof(size), 1, file) == 1 && size > 0;
+    }
+    if(ok)
+    {
+        binary.resize(size);
+        ok = fread(binary.data(), 1, size, file) == size;
+    }
+    fclose(file);
+    return ok;
+}
+
+/* Schreibt ein Binary in den Cache. Die Datei wird zuerst unter einem anderen Namen geschrieben und
+ * dann umbenannt, so sieht ein gleichzeitig gestartetes Programm nie eine halbe Datei.
+ * @param path Der Pfad der Datei
+ * @param key Der Schlüssel
+ * @param binary Das Binary
+ */
+static void storeBinary(const std::string& path, const std::string& key, const std::vector<unsigned char>& binary)
+{
+    std::string temp = path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "wb");
+    if(file == nullptr)
+        return;
+
+    uint64_t keySize = key.size();
+    uint64_t size = binary.size();
+    bool ok = fwrite(PROGRAM_CACHE_MAGIC, 1, 4, file) == 4
+                && fwrite(&keySize, sizeof(keySize), 1, file) == 1
+                && fwrite(key.data(), 1, keySize, file) == keySize
+                && fwrite(&size, sizeof(size), 1, file) == 1
+                && fwrite(binary.data(), 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    if(!ok || rename(temp.c_str(), path.c_str()) != 0)
+        remove(temp.c_str());
+}
+
+cl_program mandelbrot::buildProgram(const char* options)
+{
+    cl_program program;
+    cl_int res, status;
+
+    /* Der Schlüssel enthält alles was das Binary beeinflusst: Device, Treiber, Optionen und Quelltext.
+     * Der Dateiname ist sein Hash, der ganze Schlüssel steht zur Kontrolle in der Datei.
+     */
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)hashBytes(kernelSource, sizeof(kernelSource) - 1));
+    std::string key = deviceString(_device_id, CL_DEVICE_NAME) + "\n" + deviceString(_device_id, CL_DRIVER_VERSION)
+                        + "\n" + options + "\n" + hash;
+    std::string dir = cacheDirectory();
+    std::string path;
+    if(!dir.empty())
+    {
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)hashBytes(key.data(), key.size()));
+        path = dir + "/" + hash + ".bin";
+    }
+
+    // Laden aus dem Cache, ein Binary das der Treiber nicht mehr annimmt wird neu compiliert
+    std::vector<unsigned char> binary;
+    if(!path.empty() && loadBinary(path, key, binary))
+    {
+        const unsigned char* data = binary.data();
+        size_t size = binary.size();
+        program = clCreateProgramWithBinary(_context, 1, &_device_id, &size, &data, &status, &res);
+        if(res == CL_SUCCESS && status == CL_SUCCESS)
+        {
+            if(clBuildProgram(program, 1, &_device_id, options, NULL, NULL) == CL_SUCCESS)
+                return program;
+            clReleaseProgram(program);
+        }
+        else if(res == CL_SUCCESS)
+            clReleaseProgram(program);
+    }
 
     // Erstellen des Programmes
-    _program = clCreateProgramWithSource(_context, 1, (const char **)&source_str,
-    (const size_t *)&source_size, &res);
+    const char* source = kernelSource;
+    size_t sourceSize = sizeof(kernelSource) - 1;
+    program = clCreateProgramWithSource(_context, 1, &source, &sourceSize, &res);
     error(res, "Failed to create Program.");
 
     // Compilieren des Programmes
-    res = clBuildProgram(_program, 1, &_device_id, NULL, NULL, NULL);
+    res = clBuildProgram(program, 1, &_device_id, options, NULL, NULL);
 
     // Ausgabe möglicher Fehler
     if(res != CL_SUCCESS)
     {
-        clGetProgramBuildInfo(_program, _device_id, CL_PROGRAM_BUILD_LOG, MAX_STRING_SIZE, info, NULL);
+        char* info = (char*)malloc(MAX_STRING_SIZE);
+        clGetProgramBuildInfo(program, _device_id, CL_PROGRAM_BUILD_LOG, MAX_STRING_SIZE, info, NULL);
         fprintf(stderr, "Failed to build Program:\n%s\n", info);
+        free(info);
         exit(1);
     }
 
-    // Erstellen der Kernel
-    _kernel = clCreateKernel(_program, "computeColors", &res);
+    // Speichern des Binarys, ein Fehler dabei kostet nur die Zeit beim nächsten Start
+    if(path.empty())
+        return program;
+    size_t size = 0;
+    if(clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &size, NULL) != CL_SUCCESS || size == 0)
+        return program;
+    binary.resize(size);
+    unsigned char* data = binary.data();
+    if(clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &data, NULL) == CL_SUCCESS)
+        storeBinary(path, key, binary);
+    return program;
+}
+
+const mandelbrot::variant& mandelbrot::kernels(bool single, size_t samples, const mandelbrot::formula& f)
+{
+    cl_int res;
+
+    // Die Optionen sind auch der Schlüssel, ohne Optionen ist es _program selbst
+    std::string options;
+    if(single)
+        options = "-DUSE_FLOAT";
+    if(samples <= KERNEL_FIXED_SAMPLES)
+        options += (options.empty() ? "" : " ") + std::string("-DFIXED_SAMPLES=") + std::to_string(samples);
+    if(f.type == MULTIBROT)
+        options += (options.empty() ? "" : " ") + std::string("-DFORMULA_POWER=") + std::to_string(f.power);
+    else if(f.type == BURNING_SHIP)
+        options += (options.empty() ? "" : " ") + std::string("-DFORMULA_SHIP");
+    if(f.julia)
+    {
+        // Hexadezimal, damit c genau übernommen wird
+        char julia[80];
+        snprintf(julia, sizeof(julia), "-DJULIA_X=%a -DJULIA_Y=%a", f.jx, f.jy);
+        options += (options.empty() ? "" : " ") + std::string(julia);
+    }
+
+    std::map<std::string, variant>::iterator found = _variants.find(options);
+    if(found != _variants.end())
+        return found->second;
+
+    variant v;
+    v.program = options.empty() ? _program : buildProgram(options.c_str());
+    v.iterations = clCreateKernel(v.program, "computeIterations", &res);
+    error(res, "Failed to create Kernal.");
+    v.persistent = clCreateKernel(v.program, "computeIterationsPersistent", &res);
+    error(res, "Failed to create Kernal.");
+    v.tiled = clCreateKernel(v.program, "computeIterationsTiled", &res);
     error(res, "Failed to create Kernal.");
+    v.color = clCreateKernel(v.program, "colorImage", &res);
+    error(res, "Failed to create Kernal.");
+    v.edges = clCreateKernel(v.program, "findEdges", &res);
+    error(res, "Failed to create Kernal.");
+    v.list = clCreateKernel(v.program, "computeSampleList", &res);
+    error(res, "Failed to create Kernal.");
+
+    // float braucht weniger Register, die Grösse der Work-Groups kann sich deshalb unterscheiden
+    clGetKernelWorkGroupInfo(v.persistent, _device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &v.groupSize, NULL);
+    if(v.groupSize > PERSISTENT_GROUP_SIZE)
+        v.groupSize = PERSISTENT_GROUP_SIZE;
+    clGetKernelWorkGroupInfo(v.tiled, _device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &v.tiledSize, NULL);
+
+    return _variants[options] = v;
+}
+
+void mandelbrot::tune()
+{
+    cl_int res;
+
+    if(_tuned)
+        return;
+    _tuned = true;
+
+    // Der Schlüssel wie bei buildProgram, die Datei liegt neben den Binaries
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)hashBytes(kernelSource, sizeof(kernelSource) - 1));
+    std::string key = std::string("tuning\n") + deviceString(_device_id, CL_DEVICE_NAME) + "\n"
+                        + deviceString(_device_id, CL_DEVICE_VENDOR) + "\n" + deviceString(_device_id, CL_DRIVER_VERSION)
+                        + "\n" + hash;
+    std::string dir = cacheDirectory();
+    std::string path;
+    std::vector<unsigned char> binary;
+    if(!dir.empty())
+    {
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)hashBytes(key.data(), key.size()));
+        path = dir + "/" + hash + ".tune";
+        if(loadBinary(path, key, binary) && binary.size() == sizeof(tuning))
+        {
+            memcpy(&_tuning, binary.data(), sizeof(tuning));
+            return;
+        }
+    }
+
+    /* Grenzen des Kernels und des Devices für die Work-Groups. Gemessen wird immer z² + c, unabhängig von
+     * der gewählten Formel, das Ergebnis gilt für alle Varianten (siehe computeIterations).
+     */
+    const variant& v = kernels(false, 1, { MANDELBROT, 2, false, 0, 0 });
+    size_t maxGroup = v.tiledSize;
+    size_t maxItems[3] = { 0, 0, 0 };
+    clGetDeviceInfo(_device_id, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(maxItems), maxItems, NULL);
 
-    // Freigebe der Strings
-    free(source_str);
-    free(info);
+    // Eigene Buffer, der Iterations-Buffer und die Zähler der laufenden Berechnung bleiben erhalten
+    size_t size = TUNE_RES * TUNE_RES;
+    std::vector<cl_float> pending(size, SMOOTH_PENDING);
+    cl_mem smooth = clCreateBuffer(_context, CL_MEM_READ_WRITE, size*sizeof(cl_float), nullptr, &res);
+    error(res, "Failed to create Buffer.");
+    cl_mem state = clCreateBuffer(_context, CL_MEM_READ_WRITE, size*sizeof(cl_double2), nullptr, &res);
+    error(res, "Failed to create Buffer.");
+    cl_mem count = clCreateBuffer(_context, CL_MEM_READ_WRITE, size*sizeof(cl_uint), nullptr, &res);
+    error(res, "Failed to create Buffer.");
+    cl_mem counters = clCreateBuffer(_context, CL_MEM_READ_WRITE, 2*sizeof(cl_uint), nullptr, &res);
+    error(res, "Failed to create Buffer.");
+
+    cl_double2 delta;
+    cl_double2 topLeft;
+    cl_uint2 reso;
+    cl_uint step = 1;
+    cl_uint start = 0;
+    cl_uint iter = TUNE_ITERATIONS;
+
+    delta.s[0] = TUNE_WIDTH / TUNE_RES;
+    delta.s[1] = -TUNE_WIDTH / TUNE_RES;
+    topLeft.s[0] = TUNE_X - TUNE_WIDTH / 2;
+    topLeft.s[1] = TUNE_Y + TUNE_WIDTH / 2;
+    reso.s[0] = TUNE_RES;
+    reso.s[1] = TUNE_RES;
+
+    res = clSetKernelArg(v.tiled, 0, sizeof(cl_mem), (void*)&smooth);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(v.tiled, 1, sizeof(cl_mem), (void*)&state);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(v.tiled, 2, sizeof(cl_mem), (void*)&count);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(v.tiled, 3, sizeof(cl_double2), (void*)&delta);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(v.tiled, 4, sizeof(cl_double2), (void*)&topLeft);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(v.tiled, 5, sizeof(cl_uint2), (void*)&reso);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(v.tiled, 6, sizeof(cl_uint), (void*)&step);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(v.tiled, 7, sizeof(cl_uint), (void*)&start);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(v.tiled, 8, sizeof(cl_uint), (void*)&iter);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(v.tiled, 9, sizeof(cl_mem), (void*)&counters);
+    error(res, "Failed to set Kernel Arguments.");
+
+    // Die Kandidaten: Work-Groups von einer halben Zeile bis zu Quadraten, 1 bis 4 Samples pro Work-Item
+    static const uint32_t sizes[][2] = { { 8, 8 }, { 16, 4 }, { 16, 8 }, { 16, 16 }, { 32, 2 }, { 32, 4 },
+                                         { 32, 8 }, { 64, 1 }, { 64, 2 }, { 64, 4 }, { 128, 1 }, { 256, 1 } };
+    static const uint32_t pers[] = { 1, 2, 4 };
+    double best = 0;
+    for(const uint32_t* s : sizes)
+    {
+        if(s[0]*s[1] > maxGroup || s[0] > maxItems[0] || s[1] > maxItems[1])
+            continue;
+        for(cl_uint per : pers)
+        {
+            size_t local[2] = { s[0], s[1] };
+            size_t global[2] = { (TUNE_RES + s[0]*per - 1) / (s[0]*per) * s[0], (TUNE_RES + s[1] - 1) / s[1] * s[1] };
+            res = clSetKernelArg(v.tiled, 10, sizeof(cl_uint), (void*)&per);
+            error(res, "Failed to set Kernel Arguments.");
+
+            // Ein Kandidat den der Treiber ablehnt wird übersprungen
+            double fastest = 0;
+            for(size_t r = 0; r < TUNE_RUNS && res == CL_SUCCESS; r++)
+            {
+                cl_event event;
+                cl_ulong begin = 0;
+                cl_ulong end = 0;
+                res = clEnqueueWriteBuffer(_command_queue, smooth, CL_TRUE, 0, size*sizeof(cl_float), pending.data(), 0, NULL, NULL);
+                error(res, "Failed to write Buffer.");
+                res = clEnqueueNDRangeKernel(_command_queue, v.tiled, 2, NULL, global, local, 0, NULL, &event);
+                if(res != CL_SUCCESS)
+                    break;
+                clWaitForEvents(1, &event);
+                clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &begin, NULL);
+                clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+                clReleaseEvent(event);
+                double ms = (end - begin) / 1e6;
+                if(r == 0 || ms < fastest)
+                    fastest = ms;
+            }
+            if(res == CL_SUCCESS && (best == 0 || fastest < best))
+            {
+                best = fastest;
+                _tuning.local[0] = s[0];
+                _tuning.local[1] = s[1];
+                _tuning.per = per;
+            }
+        }
+    }
+
+    res = clReleaseMemObject(counters);
+    res = clReleaseMemObject(count);
+    res = clReleaseMemObject(state);
+    res = clReleaseMemObject(smooth);
+
+    // Ohne gültigen Kandidaten eine Zeile so breit wie möglich, das wird nicht gespeichert
+    if(best == 0)
+    {
+        _tuning.local[0] = std::max(std::min(maxGroup, maxItems[0]), (size_t)1);
+        _tuning.local[1] = 1;
+        _tuning.per = 1;
+        return;
+    }
+    if(!path.empty())
+    {
+        binary.assign((const unsigned char*)&_tuning, (const unsigned char*)&_tuning + sizeof(tuning));
+        storeBinary(path, key, binary);
+    }
 }
 
 mandelbrot::~mandelbrot()
 {
     cl_int res;
 
+    delete _reference;
+
+    if(_backend == NATIVE)
+    {
+        delete _native;
+        return;
+    }
+
+    if(_backend == MULTI)
+    {
+        for(device& d : _devices)
+            delete d.brot;
+        return;
+    }
+
     /* Finalization */
     res = clFlush(_command_queue);
     res = clFinish(_command_queue);
-    res = clReleaseKernel(_kernel);
+    deleteBuffer();
+    readProfile(true);
+    if(_orbit != nullptr)
+        res = clReleaseMemObject(_orbit);
+    if(_smooth != nullptr)
+    {
+        res = clReleaseMemObject(_smooth);
+        res = clReleaseMemObject(_state);
+        res = clReleaseMemObject(_count);
+    }
+    if(_oldSmooth != nullptr)
+    {
+        res = clReleaseMemObject(_oldSmooth);
+        res = clReleaseMemObject(_oldState);
+        res = clReleaseMemObject(_oldCount);
+    }
+    if(_edgeList != nullptr)
+        res = clReleaseMemObject(_edgeList);
+    res = clReleaseMemObject(_edgeCount);
+    if(_sampleList != nullptr)
+        res = clReleaseMemObject(_sampleList);
+    if(_rects != nullptr)
+    {
+        res = clReleaseMemObject(_rects);
+        res = clReleaseMemObject(_classes);
+    }
+    for(std::pair<const std::string, variant>& v : _variants)
+    {
+        res = clReleaseKernel(v.second.list);
+        res = clReleaseKernel(v.second.edges);
+        res = clReleaseKernel(v.second.color);
+        res = clReleaseKernel(v.second.persistent);
+        res = clReleaseKernel(v.second.tiled);
+        res = clReleaseKernel(v.second.iterations);
+        if(v.second.program != _program)
+            res = clReleaseProgram(v.second.program);
+    }
+    res = clReleaseKernel(_kernelFill);
+    res = clReleaseKernel(_kernelClassify);
+    res = clReleaseKernel(_kernelReproject);
+    res = clReleaseKernel(_kernelDD);
+    res = clReleaseKernel(_kernelPerturbation);
+    res = clReleaseMemObject(_counters);
+    res = clReleaseMemObject(_next);
     res = clReleaseProgram(_program);
+    res = clReleaseCommandQueue(_transfer_queue);
     res = clReleaseCommandQueue(_command_queue);
     res = clReleaseContext(_context);
 }
@@ -140,7 +690,31 @@ void mandelbrot::listDevices()
     cl_device_id* devices;
     cl_uint maxComputeUnits;
 
+    // print native backend
+    if(_backend == NATIVE)
+        printf("Native: %s, %zu threads\n", _native->isa(), _native->threads());
+
+    // print devices used by the multi backend
+    if(_backend == MULTI)
+    {
+        printf("Multi: %zu devices\n", _devices.size());
+        for(size_t d = 0; d < _devices.size(); d++)
+        {
+            mandelbrot* brot = _devices[d].brot;
+            if(brot->_backend == NATIVE)
+                printf(" %zu. Native: %s, %zu threads\n", d+1, brot->_native->isa(), brot->_native->threads());
+            else
+            {
+                char name[256];
+                clGetDeviceInfo(brot->_device_id, CL_DEVICE_NAME, sizeof(name), name, NULL);
+                printf(" %zu. OpenCL: %s\n", d+1, name);
+            }
+        }
+        return;
+    }
+
     // get all platforms
+    platformCount = 0;
     clGetPlatformIDs(0, NULL, &platformCount);
     platforms = (cl_platform_id*) malloc(sizeof(cl_platform_id) * platformCount);
     clGetPlatformIDs(platformCount, platforms, NULL);
@@ -197,67 +771,1587 @@ void mandelbrot::listDevices()
     free(platforms);
 }
 
-void mandelbrot::createBuffer(mandelbrot::res resolution, void* ptr)
+void mandelbrot::createBuffer(mandelbrot::res resolution)
 {
     cl_int res;
-    // Erstellt den BUffer
-    _image = clCreateBuffer(_context, CL_MEM_WRITE_ONLY, resolution.y*resolution.y*sizeof(cl_char4), nullptr, &res);
-    error(res, "Failed to create Buffer.");
+    // Das native Backend schreibt direkt in den Buffer im RAM
+    if(_backend == NATIVE)
+        return;
+    // Jedes Device braucht einen Buffer für den grösstmöglichen Streifen (das ganze Bild)
+    if(_backend == MULTI)
+    {
+        for(device& d : _devices)
+            d.brot->createBuffer(resolution);
+        return;
+    }
+    deleteBuffer();
+    /* Erstellt die Buffer auf dem Device, der Farb-Kernel schreibt so nicht über den Bus. Gelesen wird
+     * direkt in das Ziel von computeImage (beim Viewer die gesperrte Textur), ohne weiteren Buffer.
+     */
+    for(size_t k = 0; k < IMAGE_BUFFERS; k++)
+    {
+        _image[k] = clCreateBuffer(_context, CL_MEM_WRITE_ONLY, resolution.x*resolution.y*sizeof(cl_char4), nullptr, &res);
+        error(res, "Failed to create Buffer.");
+    }
+    _imageNext = 0;
 }
 
 void mandelbrot::deleteBuffer()
 {
     cl_int res;
-    // Löscht den Buffer
-    res = clReleaseMemObject(_image);
+    if(_backend == NATIVE)
+        return;
+    if(_backend == MULTI)
+    {
+        for(device& d : _devices)
+            d.brot->deleteBuffer();
+        return;
+    }
+    // Löscht die Buffer, sobald nichts mehr aus ihnen übertragen wird
+    std::lock_guard<std::mutex> lock(_imageLock);
+    for(size_t k = 0; k < IMAGE_BUFFERS; k++)
+    {
+        finishTransfer(k);
+        if(_image[k] != nullptr)
+            res = clReleaseMemObject(_image[k]);
+        _image[k] = nullptr;
+    }
+}
+
+void mandelbrot::setSchedule(mandelbrot::schedule s)
+{
+    _schedule = s;
+    for(device& d : _devices)
+        d.brot->setSchedule(s);
+}
+
+void mandelbrot::setAsync(bool async)
+{
+    _async = async && _backend == OPENCL;
+}
+
+void mandelbrot::setTrace(trace* t)
+{
+    // Die Zeiten der noch offenen Befehle gehören zum alten Trace
+    if(_backend == OPENCL)
+        readProfile(true);
+    _trace = t;
+    if(t != nullptr && _backend == OPENCL)
+        _track = t->track("OpenCL " + deviceString(_device_id, CL_DEVICE_NAME));
+    for(device& d : _devices)
+        d.brot->setTrace(t);
+}
+
+void mandelbrot::waitImage(const mandelbrot::color* ret)
+{
+    std::lock_guard<std::mutex> lock(_imageLock);
+    for(size_t k = 0; k < IMAGE_BUFFERS; k++)
+        if(_transfers[k].target == ret)
+            finishTransfer(k);
+}
+
+void mandelbrot::setAdaptive(bool adaptive)
+{
+    _adaptive = adaptive;
+    for(device& d : _devices)
+        d.brot->setAdaptive(adaptive);
+}
+
+void mandelbrot::setSubdivide(bool subdivide, bool check)
+{
+    _subdivide = subdivide;
+    _subdivideCheck = check;
+    for(device& d : _devices)
+        d.brot->setSubdivide(subdivide, check);
+}
+
+void mandelbrot::setSingle(bool allow)
+{
+    _single = allow;
+    if(_native != nullptr)
+        _native->setSingle(allow);
+    for(device& d : _devices)
+        d.brot->setSingle(allow);
+}
+
+void mandelbrot::setFormula(const mandelbrot::formula& f)
+{
+    _formula = f;
+    if(_formula.type == MULTIBROT && (_formula.power < 2 || _formula.power > FORMULA_MAX_POWER))
+        _formula.power = _formula.power < 2 ? 2 : FORMULA_MAX_POWER;
+    // z² + c ist MANDELBROT, so nehmen beide Backends den selben Weg (Test der Hauptkardioide)
+    if(_formula.type == MULTIBROT && _formula.power == 2)
+        _formula.type = MANDELBROT;
+    if(_native != nullptr)
+        _native->setFormula(_formula);
+    for(device& d : _devices)
+        d.brot->setFormula(_formula);
+    reset();
+}
+
+void mandelbrot::setDoubleDouble(bool allow)
+{
+    _doubleDouble = allow;
+    for(device& d : _devices)
+        d.brot->setDoubleDouble(allow);
+}
+
+mandelbrot::precision mandelbrot::precisionOf(const mandelbrot::deep& area, mandelbrot::res resolution, size_t samples) const
+{
+    floatexp dx = area.w / floatexp((double)resolution.x);
+    floatexp dy = area.h / floatexp((double)resolution.y);
+    double pixel = dx.log2() < dy.log2() ? dx.log2() : dy.log2();
+
+    // Wie in computeImage: bei kleinen Zooms und anderen Formeln double oder float (siehe nativeSingle)
+    if(pixel > log2(DEEP_PIXEL_SIZE) || _formula.type != MANDELBROT || _formula.julia)
+    {
+        mandelbrot::rect pos = toRect(area);
+        double sx = (pos.br.x - pos.tl.x) / (resolution.x * samples);
+        double sy = (pos.br.y - pos.tl.y) / (resolution.y * samples);
+        return _single && nativeSingle(pos, sx, sy) ? SINGLE : DOUBLE;
+    }
+    return _doubleDouble && pixel > log2(DD_PIXEL_SIZE) ? DOUBLE_DOUBLE : PERTURBATION;
+}
+
+const char* mandelbrot::precisionName(mandelbrot::precision p)
+{
+    switch(p)
+    {
+    case SINGLE:
+        return "float";
+    case DOUBLE:
+        return "double";
+    case DOUBLE_DOUBLE:
+        return "double-double";
+    default:
+        return "perturbation";
+    }
+}
+
+void mandelbrot::setCancel(const std::atomic<bool>* flag)
+{
+    _cancel = flag;
+    if(_backend == NATIVE)
+        _native->setCancel(flag);
+    for(device& d : _devices)
+        d.brot->setCancel(flag);
+}
+
+void mandelbrot::reset()
+{
+    _view.samples = 0;
+    for(device& d : _devices)
+        d.brot->reset();
+}
+
+bool mandelbrot::computeImage(mandelbrot::color* ret, mandelbrot::res resolution, mandelbrot::rect pos, size_t i, size_t samples, size_t step)
+{
+    bool same = false;
+    bool reuse = false;
+    nativeMap map;
+
+    if(_backend == MULTI)
+        return computeTiles(ret, resolution, toDeep(pos), i, samples, step);
+
+    _stats.skipped = 0;
+    _stats.reused = 0;
+    _stats.refined = 0;
+    resetCounters();
+
+    // Ist der Iterations-Buffer für die selbe Fläche gerechnet, wird dort weitergemacht
+    if(_view.samples == samples && !_view.perturbation && _view.res.x == resolution.x && _view.res.y == resolution.y
+       && _view.area.tl.x == pos.tl.x && _view.area.tl.y == pos.tl.y && _view.area.br.x == pos.br.x && _view.area.br.y == pos.br.y)
+        same = true;
+    /* Sonst werden die Samples der letzten Fläche übernommen. Die übernommenen Samples haben
+     * _view.iter Iterationen, bei weniger Iterationen würde das Fortsetzen falsch zählen.
+     */
+    else if(_view.samples != 0 && !_view.perturbation && i >= _view.iter)
+    {
+        double dxo = (_view.area.br.x - _view.area.tl.x) / (_view.res.x * _view.samples);
+        double dyo = (_view.area.br.y - _view.area.tl.y) / (_view.res.y * _view.samples);
+        map.sx = (pos.br.x - pos.tl.x) / (resolution.x * samples) / dxo;
+        map.sy = (pos.br.y - pos.tl.y) / (resolution.y * samples) / dyo;
+        map.ox = (pos.tl.x - _view.area.tl.x) / dxo;
+        map.oy = (pos.tl.y - _view.area.tl.y) / dyo;
+        reuse = true;
+    }
+
+    if(!same)
+    {
+        reproject(resolution, samples, reuse ? &map : nullptr);
+        if(!reuse)
+            _view.iter = i;
+        _view.perturbation = false;
+        _view.area = pos;
+        _view.res = resolution;
+        _view.samples = samples;
+        _view.step = SIZE_MAX;
+        _view.refined = 0;
+    }
+
+    // Übernommene, nicht entkommene Samples werden zuerst fortgesetzt
+    if(i > _view.iter)
+    {
+        // Ein abgebrochenes Fortsetzen hinterlässt Samples mit verschiedenen Iterationen
+        if(!computeIterations(resolution, pos, samples, _view.iter, i, 1))
+        {
+            reset();
+            return false;
+        }
+        _view.iter = i;
+    }
+
+    /* Fehlende Samples werden mit den Iterationen des Buffers gerechnet, auch wenn weniger verlangt
+     * sind, so haben alle Samples gleich viele Iterationen. Ein Abbruch lässt nur Samples mit
+     * SMOOTH_PENDING zurück, die beim nächsten Aufruf gerechnet werden.
+     */
+    bool refine = _adaptive && step < samples;
+    size_t lattice = refine ? samples : step;
+    if(_view.step > lattice)
+    {
+        // Füllen setzt eine zusammenhängende Menge voraus, das Burning Ship und Julia-Mengen haben Inseln
+        bool fill = _subdivide && _formula.type != BURNING_SHIP && !_formula.julia;
+        bool complete = fill ? subdivide(resolution, pos, samples, _view.iter, lattice)
+                                   : computeIterations(resolution, pos, samples, 0, _view.iter, lattice);
+        if(!complete)
+            return false;
+        _view.step = lattice;
+    }
+
+    /* Beim adaptiven Supersampling bekommen nach dem Durchgang mit einem Sample pro Pixel nur noch
+     * die Kanten alle Samples. Welche Pixel Kanten sind hängt von den Iterationen der Färbung ab.
+     */
+    if(refine && _view.refined != i)
+    {
+        _stats.refined = findEdges(resolution, samples, i);
+        if(!computeIterations(resolution, pos, samples, 0, _view.iter, 1, true))
+            return false;
+        _view.refined = i;
+    }
+
+    colorImage(ret, resolution, samples, i, _view.step);
+    keepImage(ret, resolution, toDeep(pos));
+    return true;
+}
+
+void mandelbrot::createSampleBuffers(size_t size)
+{
+    cl_int res;
+
+    if(size <= _bufferSize)
+        return;
+
+    if(_smooth != nullptr)
+    {
+        clReleaseMemObject(_smooth);
+        clReleaseMemObject(_state);
+        clReleaseMemObject(_count);
+    }
+    _smooth = clCreateBuffer(_context, CL_MEM_READ_WRITE, size * sizeof(cl_float), nullptr, &res);
+    error(res, "Failed to create Buffer.");
+    _state = clCreateBuffer(_context, CL_MEM_READ_WRITE, size * sizeof(cl_double2), nullptr, &res);
+    error(res, "Failed to create Buffer.");
+    _count = clCreateBuffer(_context, CL_MEM_READ_WRITE, size * sizeof(cl_uint), nullptr, &res);
+    error(res, "Failed to create Buffer.");
+    _bufferSize = size;
 }
 
-void mandelbrot::computeImage(mandelbrot::color* ret, mandelbrot::res resolution, mandelbrot::rect pos, size_t i, size_t samples)
+void mandelbrot::reproject(mandelbrot::res resolution, size_t samples, const nativeMap* map)
 {
     cl_int res;
+    mandelbrot::res grid = { resolution.x * samples, resolution.y * samples };
+    traceScope scope(_trace, "reproject");
 
-    // Speicherung der Werte in OpenCL-Datentypen
-    size_t size = resolution.x*resolution.y;
-    cl_double2 delta;
-    cl_double2 topLeft;
-    cl_uint2 reso;
-    cl_uint iter;
-    cl_uint samp;
+    // Die Abbildung ist pro Achse unabhängig, übernommen wird das Produkt der Treffer
+    if(map != nullptr)
+    {
+        size_t hitsX = 0;
+        size_t hitsY = 0;
+        for(size_t x = 0; x < grid.x; x++)
+            hitsX += nativeMapAxis(x, _view.res.x * _view.samples, map->sx, map->ox) >= 0;
+        for(size_t y = 0; y < grid.y; y++)
+            hitsY += nativeMapAxis(y, _view.res.y * _view.samples, map->sy, map->oy) >= 0;
+        _stats.reused = hitsX * hitsY;
+    }
 
-    delta.s[0] = (pos.br.x - pos.tl.x) / resolution.x;
-    delta.s[1] = (pos.br.y - pos.tl.y) / resolution.y;
+    if(_backend == NATIVE)
+    {
+        _native->reproject(resolution, samples, map);
+        return;
+    }
 
-    topLeft.s[0] = pos.tl.x;
-    topLeft.s[1] = pos.tl.y;
+    // Der alte Buffer wird nur getauscht, nicht kopiert
+    std::swap(_smooth, _oldSmooth);
+    std::swap(_state, _oldState);
+    std::swap(_count, _oldCount);
+    std::swap(_bufferSize, _oldBufferSize);
+    createSampleBuffers(grid.x * grid.y);
 
-    reso.s[0] = resolution.x;
-    reso.s[1] = resolution.y;
+    // Speicherung der Werte in OpenCL-Datentypen
+    size_t size = grid.x * grid.y;
+    cl_uint2 reso;
+    cl_uint2 oldReso;
+    cl_double4 mapping;
 
-    iter = i;
-    samp = samples;
+    reso.s[0] = grid.x;
+    reso.s[1] = grid.y;
+    oldReso.s[0] = map != nullptr ? _view.res.x * _view.samples : 0;
+    oldReso.s[1] = map != nullptr ? _view.res.y * _view.samples : 0;
+    mapping.s[0] = map != nullptr ? map->sx : 0;
+    mapping.s[1] = map != nullptr ? map->sy : 0;
+    mapping.s[2] = map != nullptr ? map->ox : 0;
+    mapping.s[3] = map != nullptr ? map->oy : 0;
 
     // Setzen der Kernel-Argumente
-    res = clSetKernelArg(_kernel, 0, sizeof(cl_mem), (void*)&_image);
+    res = clSetKernelArg(_kernelReproject, 0, sizeof(cl_mem), (void*)&_smooth);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelReproject, 1, sizeof(cl_mem), (void*)&_state);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelReproject, 2, sizeof(cl_mem), (void*)&_count);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelReproject, 3, sizeof(cl_mem), (void*)&_oldSmooth);
     error(res, "Failed to set Kernel Arguments.");
-    res = clSetKernelArg(_kernel, 1, sizeof(cl_double2), (void*)&delta);
+    res = clSetKernelArg(_kernelReproject, 4, sizeof(cl_mem), (void*)&_oldState);
     error(res, "Failed to set Kernel Arguments.");
-    res = clSetKernelArg(_kernel, 2, sizeof(cl_double2), (void*)&topLeft);
+    res = clSetKernelArg(_kernelReproject, 5, sizeof(cl_mem), (void*)&_oldCount);
     error(res, "Failed to set Kernel Arguments.");
-    res = clSetKernelArg(_kernel, 3, sizeof(cl_uint2), (void*)&reso);
+    res = clSetKernelArg(_kernelReproject, 6, sizeof(cl_uint2), (void*)&reso);
     error(res, "Failed to set Kernel Arguments.");
-    res = clSetKernelArg(_kernel, 4, sizeof(cl_uint), (void*)&iter);
+    res = clSetKernelArg(_kernelReproject, 7, sizeof(cl_uint2), (void*)&oldReso);
     error(res, "Failed to set Kernel Arguments.");
-    res = clSetKernelArg(_kernel, 5, sizeof(cl_uint), (void*)&samp);
+    res = clSetKernelArg(_kernelReproject, 8, sizeof(cl_double4), (void*)&mapping);
     error(res, "Failed to set Kernel Arguments.");
 
     // Aufrufen der Kernel
-    res = clEnqueueNDRangeKernel(_command_queue, _kernel, 1, NULL, &size, NULL, 0, NULL, NULL);
+    int64_t queued = trace::now();
+    res = clEnqueueNDRangeKernel(_command_queue, _kernelReproject, 1, NULL, &size, NULL, 0, NULL, profileEvent());
     error(res, "Failed to execute Kernel.");
+    profileCommand("reproject", queued);
+}
+
+void mandelbrot::keepImage(const mandelbrot::color* image, mandelbrot::res resolution, const mandelbrot::deep& area)
+{
+    std::lock_guard<std::mutex> lock(_imageLock);
+
+    // Das Bild ist noch nicht in image, es wird von finishTransfer gespeichert
+    for(size_t k = 0; k < IMAGE_BUFFERS; k++)
+    {
+        if(_transfers[k].target == image)
+        {
+            _keepTarget = image;
+            _keepArea = area;
+            _keepRes = resolution;
+            return;
+        }
+    }
+    _keepTarget = nullptr;
+    _lastImage.assign(image, image + resolution.x * resolution.y);
+    _lastArea = area;
+    _lastRes = resolution;
+}
+
+bool mandelbrot::preview(mandelbrot::color* ret, mandelbrot::res resolution, const mandelbrot::deep& area) const
+{
+    std::lock_guard<std::mutex> lock(_imageLock);
+    if(_lastImage.empty())
+        return false;
+
+    /* Pixel i hat die Mitte x + dx*(i + 0.5 - res/2), daraus folgt der Index im letzten Bild.
+     * Die Differenz der Mittelpunkte wird mit voller Genauigkeit gerechnet.
+     */
+    floatexp dxo = _lastArea.w / floatexp((double)_lastRes.x);
+    floatexp dyo = _lastArea.h / floatexp((double)_lastRes.y);
+    double sx = (area.w / floatexp((double)resolution.x) / dxo).toDouble();
+    double sy = (area.h / floatexp((double)resolution.y) / dyo).toDouble();
+    double ox = ((area.x - _lastArea.x).toFloatexp() / dxo).toDouble() + _lastRes.x / 2.0 - sx * resolution.x / 2.0;
+    double oy = ((area.y - _lastArea.y).toFloatexp() / dyo).toDouble() + _lastRes.y / 2.0 - sy * resolution.y / 2.0;
+    std::vector<long> columns(resolution.x);
+
+    for(size_t x = 0; x < resolution.x; x++)
+    {
+        double f = floor(sx * (x + 0.5) + ox);
+        columns[x] = f >= 0 && f < _lastRes.x ? (long)f : -1;
+    }
+
+    for(size_t y = 0; y < resolution.y; y++)
+    {
+        double f = floor(sy * (y + 0.5) + oy);
+        long row = f >= 0 && f < _lastRes.y ? (long)f : -1;
+        for(size_t x = 0; x < resolution.x; x++)
+        {
+            mandelbrot::color& c = ret[y*resolution.x + x];
+            if(row < 0 || columns[x] < 0)
+                c.r = c.g = c.b = c.pad = 0;
+            else
+                c = _lastImage[row*_lastRes.x + columns[x]];
+        }
+    }
+    return true;
+}
+
+bool mandelbrot::computeIterations(mandelbrot::res resolution, mandelbrot::rect pos, size_t samples, size_t start, size_t i, size_t step, bool edges)
+{
+    cl_int res;
+    const char* name = edges ? "refine" : "iterations";
+    traceScope scope(_trace, name);
+
+    if(_backend == NATIVE)
+        return _native->computeIterations(resolution, pos, samples, start, i, step, _stats, edges ? &_edges : nullptr);
+
+    // Die Samples bilden ein Gitter mit samples-facher Auflösung
+    mandelbrot::res grid = { resolution.x * samples, resolution.y * samples };
+    createSampleBuffers(grid.x * grid.y);
+
+    // Speicherung der Werte in OpenCL-Datentypen
+    cl_double2 delta;
+    cl_double2 topLeft;
+    cl_uint2 reso;
+    cl_uint stride = step;
+    cl_uint samp = samples;
+    cl_uint first;
+    cl_uint iter;
+
+    delta.s[0] = (pos.br.x - pos.tl.x) / grid.x;
+    delta.s[1] = (pos.br.y - pos.tl.y) / grid.y;
+
+    topLeft.s[0] = pos.tl.x;
+    topLeft.s[1] = pos.tl.y;
+
+    reso.s[0] = grid.x;
+    reso.s[1] = grid.y;
+
+    first = start;
+    iter = i;
+
+    // Flache Bilder werden in float gerechnet (wie beim nativen Backend, siehe nativeSingle)
+    _singleUsed = _single && nativeSingle(pos, delta.s[0], delta.s[1]);
+    const variant& v = kernels(_singleUsed, samples, _formula);
+    if(_schedule == TILED)
+        tune();
+
+    // Die Liste der Kanten ist schon kompakt, sie braucht keine Kacheln
+    cl_kernel kernel = v.iterations;
+    if(_schedule == PERSISTENT && !edges)
+        kernel = v.persistent;
+    else if(_schedule == TILED && !edges)
+        kernel = v.tiled;
+
+    // Setzen der Kernel-Argumente
+    res = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&_smooth);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&_state);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 2, sizeof(cl_mem), (void*)&_count);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 3, sizeof(cl_double2), (void*)&delta);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 4, sizeof(cl_double2), (void*)&topLeft);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 5, sizeof(cl_uint2), (void*)&reso);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 6, sizeof(cl_uint), (void*)&stride);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 7, sizeof(cl_uint), (void*)&first);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 8, sizeof(cl_uint), (void*)&iter);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 9, sizeof(cl_mem), (void*)&_counters);
+    error(res, "Failed to set Kernel Arguments.");
+
+    if(kernel == v.iterations)
+    {
+        // Ohne Liste (NULL) wird das Gitter jedes step-ten Samples gerechnet
+        res = clSetKernelArg(kernel, 10, sizeof(cl_uint), (void*)&samp);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(kernel, 11, sizeof(cl_mem), edges ? (void*)&_edgeList : NULL);
+        error(res, "Failed to set Kernel Arguments.");
+    }
+    else if(kernel == v.tiled)
+    {
+        cl_uint per = _tuning.per;
+        res = clSetKernelArg(kernel, 10, sizeof(cl_uint), (void*)&per);
+        error(res, "Failed to set Kernel Arguments.");
+    }
+
+    if(edges)
+    {
+        // Ein Work-Item pro Sample der Pixel in der Liste
+        size_t size = _edgeLength * samples * samples;
+        if(cancelled())
+        {
+            readCounters();
+            return false;
+        }
+        if(size > 0)
+        {
+            int64_t queued = trace::now();
+            res = clEnqueueNDRangeKernel(_command_queue, kernel, 1, NULL, &size, NULL, 0, NULL, profileEvent());
+            error(res, "Failed to execute Kernel.");
+            profileCommand(name, queued);
+        }
+    }
+    else if(_schedule == PERSISTENT)
+    {
+        cl_uint zero = 0;
+        size_t global = _groups * v.groupSize;
+
+        // Zurücksetzen des Kachel-Zählers
+        res = clEnqueueWriteBuffer(_command_queue, _next, CL_TRUE, 0, sizeof(cl_uint), &zero, 0, NULL, NULL);
+        error(res, "Failed to write Buffer.");
+        res = clSetKernelArg(kernel, 10, sizeof(cl_mem), (void*)&_next);
+        error(res, "Failed to set Kernel Arguments.");
+
+        // Aufrufen der Kernel
+        int64_t queued = trace::now();
+        res = clEnqueueNDRangeKernel(_command_queue, kernel, 1, NULL, &global, &v.groupSize, 0, NULL, profileEvent());
+        error(res, "Failed to execute Kernel.");
+        profileCommand(name, queued);
+    }
+    else if(_schedule == TILED)
+    {
+        // Ein Aufruf pro Streifen aus ganzen Work-Groups, das Gitter wird auf ganze Work-Groups aufgerundet
+        mandelbrot::res lattice = { (grid.x + step - 1) / step, (grid.y + step - 1) / step };
+        size_t local[2] = { _tuning.local[0], _tuning.local[1] };
+        // Varianten mit mehr Registern (z.B. FORMULA_POWER) erlauben kleinere Work-Groups als die gemessene
+        while(local[0]*local[1] > v.tiledSize && local[0]*local[1] > 1)
+        {
+            if(local[1] > 1)
+                local[1] /= 2;
+            else
+                local[0] /= 2;
+        }
+        size_t columns = (lattice.x + local[0]*_tuning.per - 1) / (local[0]*_tuning.per) * local[0];
+        size_t rows = (CHUNK_ROWS + local[1] - 1) / local[1] * local[1];
+        for(size_t y = 0; y < lattice.y; y += rows)
+        {
+            // Abgebrochen wird zwischen zwei Streifen, dazu wird jeder Streifen abgewartet
+            if(_cancel != nullptr)
+                clFinish(_command_queue);
+            if(cancelled())
+            {
+                readCounters();
+                return false;
+            }
+            size_t offset[2] = { 0, y };
+            size_t global[2] = { columns, std::min(rows, (lattice.y - y + local[1] - 1) / local[1] * local[1]) };
+            int64_t queued = trace::now();
+            res = clEnqueueNDRangeKernel(_command_queue, kernel, 2, offset, global, local, 0, NULL, profileEvent());
+            error(res, "Failed to execute Kernel.");
+            profileCommand(name, queued);
+        }
+    }
+    else
+    {
+        // Aufrufen der Kernel, ein Aufruf pro Streifen von Zeilen des Gitters jedes step-ten Samples
+        mandelbrot::res lattice = { (grid.x + step - 1) / step, (grid.y + step - 1) / step };
+        for(size_t y = 0; y < lattice.y; y += CHUNK_ROWS)
+        {
+            // Abgebrochen wird zwischen zwei Streifen, dazu wird jeder Streifen abgewartet
+            if(_cancel != nullptr)
+                clFinish(_command_queue);
+            if(cancelled())
+            {
+                readCounters();
+                return false;
+            }
+            size_t offset = y * lattice.x;
+            size_t chunk = (y + CHUNK_ROWS < lattice.y ? CHUNK_ROWS : lattice.y - y) * lattice.x;
+            int64_t queued = trace::now();
+            res = clEnqueueNDRangeKernel(_command_queue, kernel, 1, &offset, &chunk, NULL, 0, NULL, profileEvent());
+            error(res, "Failed to execute Kernel.");
+            profileCommand(name, queued);
+        }
+    }
+
+    readCounters();
+    return true;
+}
+
+/* Vergrössert einen Buffer auf dem OpenCL-Device bei Bedarf, der Inhalt geht dabei verloren
+ * @param context Der Context
+ * @param buffer Der Buffer (oder nullptr)
+ * @param capacity Die Grösse des Buffers in Bytes
+ * @param size Die benötigte Grösse in Bytes
+ */
+static void reserveBuffer(cl_context context, cl_mem& buffer, size_t& capacity, size_t size)
+{
+    cl_int res;
+
+    if(size <= capacity)
+        return;
+    if(buffer != nullptr)
+        clReleaseMemObject(buffer);
+    // Die Listen wachsen von Runde zu Runde, so wird nur selten neu erstellt
+    capacity = std::max(size, 2 * capacity);
+    buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, capacity, nullptr, &res);
+    error(res, "Failed to create Buffer.");
+}
+
+bool mandelbrot::subdivide(mandelbrot::res resolution, mandelbrot::rect pos, size_t samples, size_t i, size_t step)
+{
+    cl_int res;
+    traceScope scope(_trace, "subdivide");
+
+    if(_backend == NATIVE)
+        return _native->subdivide(pos, i, step, _subdivideCheck, _stats);
+
+    // Die Samples bilden ein Gitter mit samples-facher Auflösung
+    mandelbrot::res grid = { resolution.x * samples, resolution.y * samples };
+    createSampleBuffers(grid.x * grid.y);
+
+    // Speicherung der Werte in OpenCL-Datentypen
+    cl_double2 delta;
+    cl_double2 topLeft;
+    cl_uint2 reso;
+    cl_uint stride = step;
+    cl_uint iter = i;
+    cl_uint check = _subdivideCheck;
 
-    size_t origin[3] = {0};
-    size_t region[3] = {3, size, 1};
+    delta.s[0] = (pos.br.x - pos.tl.x) / grid.x;
+    delta.s[1] = (pos.br.y - pos.tl.y) / grid.y;
+
+    topLeft.s[0] = pos.tl.x;
+    topLeft.s[1] = pos.tl.y;
+
+    reso.s[0] = grid.x;
+    reso.s[1] = grid.y;
+
+    // Flache Bilder werden in float gerechnet (wie bei computeIterations)
+    _singleUsed = _single && nativeSingle(pos, delta.s[0], delta.s[1]);
+    cl_kernel kernel = kernels(_singleUsed, samples, _formula).list;
+
+    // Grösse des Gitters jedes step-ten Samples
+    cl_uint width = (grid.x + step - 1) / step;
+    cl_uint height = (grid.y + step - 1) / step;
+
+    std::vector<cl_uint> list;          // Die Samples der Runde
+    std::vector<nativeRect> rects;      // Die Rechtecke der Runde, ihre Ränder sind nach list gerechnet
+    std::vector<nativeRect> next;       // Die Rechtecke der nächsten Runde
+    std::vector<cl_int> classes;        // Die Klassen von rects (siehe classifyRects)
+
+    // Kleine Rechtecke werden in der nächsten Runde ganz gerechnet statt weiter geteilt
+    auto add = [&](const nativeRect& h) {
+        if(h.x1 - h.x0 >= SUBDIVIDE_MIN && h.y1 - h.y0 >= SUBDIVIDE_MIN)
+        {
+            next.push_back(h);
+            return;
+        }
+        for(cl_uint y = h.y0 + 1; y < h.y1; y++)
+            for(cl_uint x = h.x0 + 1; x < h.x1; x++)
+                list.push_back(y*step*grid.x + x*step);
+    };
+
+    // Die erste Runde rechnet das Gitter der Blöcke, jedes Sample nur einmal
+    for(cl_uint y = 0; y < height; y++)
+    {
+        bool row = y % SUBDIVIDE_SIZE == 0 || y == height - 1;
+        for(cl_uint x = 0; x < width; x++)
+            if(row || x % SUBDIVIDE_SIZE == 0 || x == width - 1)
+                list.push_back(y*step*grid.x + x*step);
+    }
+    for(cl_uint y = 0; y + 1 < height; y += SUBDIVIDE_SIZE)
+        for(cl_uint x = 0; x + 1 < width; x += SUBDIVIDE_SIZE)
+            add({ x, y, std::min<cl_uint>(x + SUBDIVIDE_SIZE, width - 1), std::min<cl_uint>(y + SUBDIVIDE_SIZE, height - 1) });
+    rects.swap(next);
+
+    for(;;)
+    {
+        // Abgebrochen wird zwischen zwei Runden
+        if(_cancel != nullptr)
+            clFinish(_command_queue);
+        if(cancelled())
+        {
+            readCounters();
+            return false;
+        }
+
+        // Die Proben der Kontrolle werden mit den Rändern gerechnet
+        for(const nativeRect& r : rects)
+            for(cl_uint k = 0; k < SUBDIVIDE_PROBES && check; k++)
+            {
+                unsigned x, y;
+                nativeProbe(r, k, x, y);
+                list.push_back(y*step*grid.x + x*step);
+            }
+
+        // Ein Work-Item pro Sample der Liste
+        if(!list.empty())
+        {
+            size_t size = list.size();
+            reserveBuffer(_context, _sampleList, _sampleListSize, size * sizeof(cl_uint));
+            res = clEnqueueWriteBuffer(_command_queue, _sampleList, CL_TRUE, 0, size * sizeof(cl_uint), list.data(), 0, NULL, NULL);
+            error(res, "Failed to write Buffer.");
+
+            res = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&_smooth);
+            error(res, "Failed to set Kernel Arguments.");
+            res = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&_state);
+            error(res, "Failed to set Kernel Arguments.");
+            res = clSetKernelArg(kernel, 2, sizeof(cl_mem), (void*)&_count);
+            error(res, "Failed to set Kernel Arguments.");
+            res = clSetKernelArg(kernel, 3, sizeof(cl_double2), (void*)&delta);
+            error(res, "Failed to set Kernel Arguments.");
+            res = clSetKernelArg(kernel, 4, sizeof(cl_double2), (void*)&topLeft);
+            error(res, "Failed to set Kernel Arguments.");
+            res = clSetKernelArg(kernel, 5, sizeof(cl_uint2), (void*)&reso);
+            error(res, "Failed to set Kernel Arguments.");
+            res = clSetKernelArg(kernel, 6, sizeof(cl_uint), (void*)&iter);
+            error(res, "Failed to set Kernel Arguments.");
+            res = clSetKernelArg(kernel, 7, sizeof(cl_mem), (void*)&_counters);
+            error(res, "Failed to set Kernel Arguments.");
+            res = clSetKernelArg(kernel, 8, sizeof(cl_mem), (void*)&_sampleList);
+            error(res, "Failed to set Kernel Arguments.");
+
+            int64_t queued = trace::now();
+            res = clEnqueueNDRangeKernel(_command_queue, kernel, 1, NULL, &size, NULL, 0, NULL, profileEvent());
+            error(res, "Failed to execute Kernel.");
+            profileCommand("borders", queued);
+        }
+        if(rects.empty())
+            break;
+
+        // Die Rechtecke der Runde werden geprüft und die gleichförmigen gefüllt
+        size_t count = rects.size();
+        size_t rows = 0;
+        for(const nativeRect& r : rects)
+            rows = std::max<size_t>(rows, r.y1 - r.y0 - 1);
+        reserveBuffer(_context, _rects, _rectsSize, count * sizeof(cl_uint4));
+        reserveBuffer(_context, _classes, _classesSize, count * sizeof(cl_int));
+        res = clEnqueueWriteBuffer(_command_queue, _rects, CL_TRUE, 0, count * sizeof(cl_uint4), rects.data(), 0, NULL, NULL);
+        error(res, "Failed to write Buffer.");
+
+        res = clSetKernelArg(_kernelClassify, 0, sizeof(cl_mem), (void*)&_smooth);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(_kernelClassify, 1, sizeof(cl_mem), (void*)&_count);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(_kernelClassify, 2, sizeof(cl_mem), (void*)&_rects);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(_kernelClassify, 3, sizeof(cl_mem), (void*)&_classes);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(_kernelClassify, 4, sizeof(cl_uint2), (void*)&reso);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(_kernelClassify, 5, sizeof(cl_uint), (void*)&stride);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(_kernelClassify, 6, sizeof(cl_uint), (void*)&iter);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(_kernelClassify, 7, sizeof(cl_uint), (void*)&check);
+        error(res, "Failed to set Kernel Arguments.");
+
+        int64_t queued = trace::now();
+        res = clEnqueueNDRangeKernel(_command_queue, _kernelClassify, 1, NULL, &count, NULL, 0, NULL, profileEvent());
+        error(res, "Failed to execute Kernel.");
+        profileCommand("classify", queued);
+
+        // Ein Work-Item pro Zeile des Inneren jedes Rechtecks, nicht gleichförmige kehren sofort zurück
+        res = clSetKernelArg(_kernelFill, 0, sizeof(cl_mem), (void*)&_smooth);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(_kernelFill, 1, sizeof(cl_mem), (void*)&_count);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(_kernelFill, 2, sizeof(cl_mem), (void*)&_rects);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(_kernelFill, 3, sizeof(cl_mem), (void*)&_classes);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(_kernelFill, 4, sizeof(cl_uint2), (void*)&reso);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(_kernelFill, 5, sizeof(cl_uint), (void*)&stride);
+        error(res, "Failed to set Kernel Arguments.");
+        res = clSetKernelArg(_kernelFill, 6, sizeof(cl_mem), (void*)&_counters);
+        error(res, "Failed to set Kernel Arguments.");
+
+        size_t global[2] = { count, rows };
+        queued = trace::now();
+        res = clEnqueueNDRangeKernel(_command_queue, _kernelFill, 2, NULL, global, NULL, 0, NULL, profileEvent());
+        error(res, "Failed to execute Kernel.");
+        profileCommand("fill", queued);
+
+        // Die Klassen entscheiden welche Rechtecke geteilt werden
+        classes.resize(count);
+        res = clEnqueueReadBuffer(_command_queue, _classes, CL_TRUE, 0, count * sizeof(cl_int), classes.data(), 0, NULL, NULL);
+        error(res, "Failed to read Buffer.");
+
+        // Geteilt wird entlang der längeren Seite (wie native::subdivideRect), die Linie kommt in die nächste Runde
+        list.clear();
+        next.clear();
+        for(size_t r = 0; r < count; r++)
+        {
+            if(classes[r] != SUBDIVIDE_MIXED)
+                continue;
+            nativeRect half[2] = { rects[r], rects[r] };
+            if(rects[r].x1 - rects[r].x0 >= rects[r].y1 - rects[r].y0)
+            {
+                cl_uint m = (rects[r].x0 + rects[r].x1) / 2;
+                for(cl_uint y = rects[r].y0 + 1; y < rects[r].y1; y++)
+                    list.push_back(y*step*grid.x + m*step);
+                half[0].x1 = m;
+                half[1].x0 = m;
+            }
+            else
+            {
+                cl_uint m = (rects[r].y0 + rects[r].y1) / 2;
+                for(cl_uint x = rects[r].x0 + 1; x < rects[r].x1; x++)
+                    list.push_back(m*step*grid.x + x*step);
+                half[0].y1 = m;
+                half[1].y0 = m;
+            }
+            add(half[0]);
+            add(half[1]);
+        }
+        rects.swap(next);
+    }
+
+    readCounters();
+    return true;
+}
+
+void mandelbrot::colorImage(mandelbrot::color* ret, mandelbrot::res resolution, size_t samples, size_t i, size_t step)
+{
+    cl_int res;
+    traceScope scope(_trace, "color");
+
+    if(_backend == NATIVE)
+    {
+        _native->colorImage(ret, resolution, samples, i, step);
+        return;
+    }
+
+    size_t size = resolution.x*resolution.y;
+    cl_uint2 reso;
+    cl_uint samp = samples;
+    cl_uint stride = step;
+    cl_uint iter = i;
+
+    reso.s[0] = resolution.x;
+    reso.s[1] = resolution.y;
+
+    // Die Variante der letzten Berechnung, so wird kein weiteres Programm erstellt
+    cl_kernel kernel = kernels(_singleUsed, samples, _formula).color;
+
+    // Der nächste Buffer, ein Bild wird frühestens IMAGE_BUFFERS Bilder später überschrieben
+    size_t buffer = _imageNext;
+    _imageNext = (_imageNext + 1) % IMAGE_BUFFERS;
+    {
+        std::lock_guard<std::mutex> lock(_imageLock);
+        finishTransfer(buffer);
+    }
+
+    // Setzen der Kernel-Argumente
+    res = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&_image[buffer]);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&_smooth);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 2, sizeof(cl_mem), (void*)&_count);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 3, sizeof(cl_uint2), (void*)&reso);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 4, sizeof(cl_uint), (void*)&samp);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 5, sizeof(cl_uint), (void*)&stride);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 6, sizeof(cl_uint), (void*)&iter);
+    error(res, "Failed to set Kernel Arguments.");
+
+    // Aufrufen der Kernel
+    cl_event colored;
+    int64_t queued = trace::now();
+    res = clEnqueueNDRangeKernel(_command_queue, kernel, 1, NULL, &size, NULL, 0, NULL, &colored);
+    error(res, "Failed to execute Kernel.");
+    res = clFlush(_command_queue);
+    if(_trace != nullptr)
+    {
+        res = clRetainEvent(colored);
+        addCommand("color", colored, queued);
+    }
+
+    readImage(ret, size, buffer, colored);
+    // Die Zeiten der beendeten Befehle, die laufende Übertragung folgt beim nächsten Bild
+    readProfile();
+}
+
+void mandelbrot::readImage(mandelbrot::color* ret, size_t size, size_t buffer, cl_event colored)
+{
+    cl_int res;
+    cl_event done;
+    traceScope scope(_trace, "read");
+
+    // Auslesen des Buffers am Stück (uchar3 hat wie color 4 Bytes), sobald er gefärbt ist
+    int64_t queued = trace::now();
+    res = clEnqueueReadBuffer(_transfer_queue, _image[buffer], _async ? CL_FALSE : CL_TRUE, 0, size*sizeof(mandelbrot::color), (void*)ret, 1, &colored, _async ? &done : profileEvent());
+    error(res, "Failed to read Buffer.");
+    res = clReleaseEvent(colored);
+    if(!_async)
+        profileCommand("read", queued);
+
+    if(_async)
+    {
+        res = clFlush(_transfer_queue);
+        std::lock_guard<std::mutex> lock(_imageLock);
+        _transfers[buffer].event = done;
+        _transfers[buffer].target = ret;
+    }
+}
+
+void mandelbrot::finishTransfer(size_t buffer)
+{
+    cl_int res;
+    transfer& t = _transfers[buffer];
+
+    if(t.event == nullptr)
+        return;
+    {
+        traceScope scope(_trace, "wait transfer");
+        res = clWaitForEvents(1, &t.event);
+        error(res, "Failed to read Buffer.");
+    }
+    // Die Zeit des Einreihens ist hier nicht bekannt, die Uhr des Devices wird wie zuletzt umgerechnet
+    addCommand("read", t.event, 0);
+
+    if(_keepTarget == t.target)
+    {
+        _lastImage.assign(t.target, t.target + _keepRes.x * _keepRes.y);
+        _lastArea = _keepArea;
+        _lastRes = _keepRes;
+        _keepTarget = nullptr;
+    }
+    t.event = nullptr;
+    t.target = nullptr;
+}
+
+void mandelbrot::resetCounters()
+{
+    cl_int res;
+    cl_uint zero[3] = { 0, 0, 0 };
+
+    _stats.bulb = 0;
+    _stats.periodic = 0;
+    _stats.filled = 0;
+    if(_backend == NATIVE)
+        return;
+
+    res = clEnqueueWriteBuffer(_command_queue, _counters, CL_TRUE, 0, sizeof(zero), zero, 0, NULL, NULL);
+    error(res, "Failed to write Buffer.");
+}
+
+mandelbrot::work mandelbrot::countWork(size_t i)
+{
+    cl_int res;
+    mandelbrot::work work = { 0, 0, 0, 0 };
+
+    if(_backend == NATIVE)
+        return _native->work(i);
+    if(_backend == MULTI || _view.samples == 0)
+        return work;
+
+    size_t size = _view.res.x * _view.res.y * _view.samples * _view.samples;
+    std::vector<cl_float> smooth(size);
+    std::vector<cl_uint> count(size);
+    res = clEnqueueReadBuffer(_command_queue, _smooth, CL_TRUE, 0, size*sizeof(cl_float), smooth.data(), 0, NULL, NULL);
+    error(res, "Failed to read Buffer.");
+    res = clEnqueueReadBuffer(_command_queue, _count, CL_TRUE, 0, size*sizeof(cl_uint), count.data(), 0, NULL, NULL);
+    error(res, "Failed to read Buffer.");
+    for(size_t s = 0; s < size; s++)
+        nativeWork(work, smooth[s], count[s], i);
+    return work;
+}
+
+void mandelbrot::profileCommand(const char* name, int64_t queued)
+{
+    if(_trace != nullptr)
+        addCommand(name, _profiled, queued);
+}
+
+void mandelbrot::addCommand(const char* name, cl_event event, int64_t queued)
+{
+    if(_trace == nullptr)
+    {
+        clReleaseEvent(event);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_commandLock);
+    _commands.push_back({ event, name, queued });
+}
+
+void mandelbrot::readProfile(bool wait)
+{
+    size_t open = 0;
+
+    std::lock_guard<std::mutex> lock(_commandLock);
+    for(command& c : _commands)
+    {
+        cl_int status = CL_COMPLETE;
+        cl_int res = wait ? clWaitForEvents(1, &c.event)
+                          : clGetEventInfo(c.event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, NULL);
+        /* Noch nicht beendete Befehle bleiben in der Liste. Von fehlgeschlagenen (negativer Status) und
+         * solchen, deren Status nicht abgefragt werden kann, werden keine Zeiten gelesen.
+         */
+        if(res == CL_SUCCESS && status > CL_COMPLETE)
+        {
+            _commands[open++] = c;
+            continue;
+        }
+
+        cl_ulong queued;
+        cl_ulong start;
+        cl_ulong end;
+        bool ok = res == CL_SUCCESS && status == CL_COMPLETE
+                  && clGetEventProfilingInfo(c.event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued, NULL) == CL_SUCCESS
+                  && clGetEventProfilingInfo(c.event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL) == CL_SUCCESS
+                  && clGetEventProfilingInfo(c.event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL) == CL_SUCCESS;
+        if(ok && _trace != nullptr)
+        {
+            if(c.queued != 0)
+                _clockOffset = c.queued - (int64_t)queued;
+            _trace->span(c.name, "device", start + _clockOffset, end + _clockOffset, _track);
+        }
+        clReleaseEvent(c.event);
+    }
+    _commands.resize(open);
+}
+
+void mandelbrot::readCounters()
+{
+    cl_int res;
+    cl_uint counters[3];
+
+    res = clEnqueueReadBuffer(_command_queue, _counters, CL_TRUE, 0, sizeof(counters), counters, 0, NULL, NULL);
+    error(res, "Failed to read Buffer.");
+    _stats.bulb = counters[0];
+    _stats.periodic = counters[1];
+    _stats.filled = counters[2];
+}
+
+mandelbrot::rect mandelbrot::toRect(const mandelbrot::deep& area)
+{
+    mandelbrot::rect ret;
+    double x = area.x.toDouble();
+    double y = area.y.toDouble();
+    double w = area.w.toDouble();
+    double h = area.h.toDouble();
+
+    ret.tl.x = x - w/2;
+    ret.tl.y = y - h/2;
+    ret.br.x = x + w/2;
+    ret.br.y = y + h/2;
+    return ret;
+}
+
+mandelbrot::deep mandelbrot::toDeep(const mandelbrot::rect& area)
+{
+    mandelbrot::deep ret;
+    double w = area.br.x - area.tl.x;
+    double h = area.br.y - area.tl.y;
+    size_t limbs = bigfloat::limbsFor(floatexp(fabs(w) < fabs(h) ? w : h));
+
+    ret.x = bigfloat(floatexp(area.tl.x + w/2), limbs);
+    ret.y = bigfloat(floatexp(area.tl.y + h/2), limbs);
+    ret.w = w;
+    ret.h = h;
+    return ret;
+}
+
+mandelbrot::deep mandelbrot::tileArea(const mandelbrot::deep& area, mandelbrot::res resolution, size_t x, size_t y, mandelbrot::res tile)
+{
+    mandelbrot::deep ret;
+
+    ret.w = area.w * floatexp((double)tile.x / resolution.x);
+    ret.h = area.h * floatexp((double)tile.y / resolution.y);
+    // Der Mittelpunkt braucht die Genauigkeit der Pixel
+    size_t limbs = bigfloat::limbsFor(area.w / floatexp((double)resolution.x));
+    ret.x = area.x;
+    ret.y = area.y;
+    ret.x.setLimbs(limbs);
+    ret.y.setLimbs(limbs);
+    ret.x = ret.x + area.w * floatexp((x + tile.x / 2.0) / resolution.x - 0.5);
+    ret.y = ret.y + area.h * floatexp((y + tile.y / 2.0) / resolution.y - 0.5);
+    return ret;
+}
+
+std::vector<cl_device_id> mandelbrot::devices()
+{
+    std::vector<cl_device_id> ret;
+    cl_uint platformCount = 0;
+
+    // Ohne OpenCL-Treiber gibt es keine Devices
+    if(clGetPlatformIDs(0, NULL, &platformCount) != CL_SUCCESS || platformCount == 0)
+        return ret;
+    std::vector<cl_platform_id> platforms(platformCount);
+    clGetPlatformIDs(platformCount, platforms.data(), NULL);
+
+    for(cl_platform_id platform : platforms)
+    {
+        cl_uint deviceCount = 0;
+        if(clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, NULL, &deviceCount) != CL_SUCCESS || deviceCount == 0)
+            continue;
+        size_t first = ret.size();
+        ret.resize(first + deviceCount);
+        clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, deviceCount, ret.data() + first, NULL);
+    }
+    return ret;
+}
+
+bool mandelbrot::computeTiles(mandelbrot::color* ret, mandelbrot::res resolution, const mandelbrot::deep& area, size_t i, size_t samples, size_t step)
+{
+    std::vector<std::thread> threads;
+    size_t next = 0;
+    bool complete = true;
+
+    _stats.skipped = 0;
+    _stats.bulb = 0;
+    _stats.periodic = 0;
+    _stats.reused = 0;
+    _stats.refined = 0;
+    _stats.filled = 0;
+
+    for(device& d : _devices)
+        threads.emplace_back([&]() {
+            for(;;)
+            {
+                // Der nächste Streifen, so hoch wie das Device in MULTI_TILE_MS schafft
+                _tileLock.lock();
+                size_t left = resolution.y - next;
+                size_t rows = d.throughput * MULTI_TILE_MS / resolution.x;
+                rows = std::min(rows, left / (2 * _devices.size()));
+                rows = std::min(std::max(rows, (size_t)MULTI_MIN_ROWS), left);
+                size_t y = next;
+                next += rows;
+                _tileLock.unlock();
+                if(rows == 0)
+                    return;
+
+                mandelbrot::res tile = { resolution.x, rows };
+                auto start = std::chrono::steady_clock::now();
+                bool ok = d.brot->computeImage(ret + y * resolution.x, tile, tileArea(area, resolution, 0, y, tile), i, samples, step);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                // Der Durchsatz wird geglättet, da die Streifen verschieden aufwendig sind
+                const mandelbrot::stats& s = d.brot->lastStats();
+                _tileLock.lock();
+                double throughput = resolution.x * rows / std::max(ms, 0.01);
+                d.throughput = d.throughput == 0 ? throughput : (d.throughput + throughput) / 2;
+                _stats.skipped = std::max(_stats.skipped, s.skipped);
+                _stats.bulb += s.bulb;
+                _stats.periodic += s.periodic;
+                _stats.reused += s.reused;
+                _stats.refined += s.refined;
+                _stats.filled += s.filled;
+                if(!ok)
+                {
+                    // Die übrigen Streifen werden nicht mehr verteilt
+                    complete = false;
+                    next = resolution.y;
+                }
+                _tileLock.unlock();
+            }
+        });
+    for(std::thread& t : threads)
+        t.join();
+
+    if(!complete)
+        return false;
+    keepImage(ret, resolution, area);
+    return true;
+}
+
+bool mandelbrot::computeImage(mandelbrot::color* ret, mandelbrot::res resolution, const mandelbrot::deep& area, size_t i, size_t samples, size_t step)
+{
+    perturbParams p;
+
+    if(_backend == MULTI)
+        return computeTiles(ret, resolution, area, i, samples, step);
+
+    floatexp dx = area.w / floatexp((double)resolution.x);
+    floatexp dy = area.h / floatexp((double)resolution.y);
+    double pixel = dx.log2() < dy.log2() ? dx.log2() : dy.log2();
+    precision tier = precisionOf(area, resolution, samples);
+
+    // Bei kleinen Zooms reicht double, andere Formeln gibt es nur in double
+    if(tier == SINGLE || tier == DOUBLE)
+    {
+        if(!computeImage(ret, resolution, toRect(area), i, samples, step))
+            return false;
+        keepImage(ret, resolution, area);
+        return true;
+    }
+
+    _stats.skipped = 0;
+    _stats.reused = 0;
+    _stats.refined = 0;
+    resetCounters();
+
+    // Beim adaptiven Supersampling wird höchstens ein Sample pro Pixel gerechnet, dann die Kanten
+    bool refine = _adaptive && step < samples;
+    size_t lattice = refine ? samples : step;
+
+    /* Ist der Iterations-Buffer für die selbe Fläche mit genug Iterationen gerechnet, werden nur
+     * fehlende Samples gerechnet, sonst wird nur neu gefärbt. Die Samples haben in double-double die
+     * selben Punkte wie mit Störungsrechnung, sie dürfen gemischt werden.
+     */
+    const mandelbrot::deep& last = _view.deepArea;
+    bool same = _view.samples == samples && _view.perturbation && _view.res.x == resolution.x && _view.res.y == resolution.y
+                && i <= _view.iter && last.x == area.x && last.y == area.y
+                && last.w.m == area.w.m && last.w.e == area.w.e && last.h.m == area.h.m && last.h.e == area.h.e;
+    if(same && _view.step <= lattice && (!refine || _view.refined == i))
+    {
+        colorImage(ret, resolution, samples, i, _view.step);
+        keepImage(ret, resolution, area);
+        return true;
+    }
+
+    // Die Samples bilden ein Gitter mit samples-facher Auflösung
+    size_t iter = same ? _view.iter : i;
+    p.dx = dx / floatexp((double)samples);
+    p.dy = dy / floatexp((double)samples);
+    p.width = resolution.x * samples;
+    p.height = resolution.y * samples;
+    p.iter = iter;
+    p.step = lattice;
+
+    // In double-double braucht es weder den Referenz-Orbit noch die Reihenentwicklung
+    if(tier == PERTURBATION)
+    {
+        // Der Referenzpunkt in der Mitte braucht die Genauigkeit der Pixel
+        size_t limbs = bigfloat::limbsFor(floatexp(1.0, (long)floor(pixel)));
+        bigfloat x = area.x;
+        bigfloat y = area.y;
+        x.setLimbs(limbs);
+        y.setLimbs(limbs);
+        {
+            traceScope scope(_trace, "reference");
+            _reference->compute(x, y, iter);
+        }
+        if(cancelled())
+            return false;
+        p.cx = _reference->x();
+        p.cy = _reference->y();
+
+        // Die ersten Iterationen werden mit einer Reihenentwicklung übersprungen
+        {
+            traceScope scope(_trace, "series");
+            approximate(*_reference, p);
+        }
+        _stats.skipped = p.skip;
+    }
+
+    /* Samples der letzten Fläche werden übernommen, falls sie genug Iterationen haben. Sample j hat
+     * den Punkt x + dx*(j - width/2), die Differenz der Mittelpunkte wird mit voller Genauigkeit
+     * gerechnet. Bei weniger Iterationen werden später entkommene Samples von colorImage schwarz
+     * gefärbt, da mit Störungsrechnung nicht fortgesetzt wird.
+     */
+    if(!same)
+    {
+        bool reuse = _view.samples != 0 && _view.perturbation && i <= _view.iter;
+        nativeMap map;
+        if(reuse)
+        {
+            floatexp dxo = _view.deepArea.w / floatexp((double)(_view.res.x * _view.samples));
+            floatexp dyo = _view.deepArea.h / floatexp((double)(_view.res.y * _view.samples));
+            map.sx = (p.dx / dxo).toDouble();
+            map.sy = (p.dy / dyo).toDouble();
+            map.ox = ((area.x - _view.deepArea.x).toFloatexp() / dxo).toDouble() + _view.res.x * _view.samples / 2.0 - map.sx * p.width / 2.0;
+            map.oy = ((area.y - _view.deepArea.y).toFloatexp() / dyo).toDouble() + _view.res.y * _view.samples / 2.0 - map.sy * p.height / 2.0;
+        }
+        reproject(resolution, samples, reuse ? &map : nullptr);
+
+        _view.perturbation = true;
+        _view.deepArea = area;
+        _view.res = resolution;
+        _view.samples = samples;
+        _view.iter = i;
+        _view.step = SIZE_MAX;
+        _view.refined = 0;
+    }
+
+    // Ein Abbruch lässt nur Samples mit SMOOTH_PENDING zurück, die beim nächsten Aufruf gerechnet werden
+    if(_view.step > lattice)
+    {
+        if(!(tier == PERTURBATION ? computePerturbation(p, samples, false) : computeDoubleDouble(area, p, samples, false)))
+            return false;
+        _view.step = lattice;
+    }
+
+    // Verfeinern der Kanten beim adaptiven Supersampling, wie ohne Störungsrechnung
+    if(refine && _view.refined != i)
+    {
+        _stats.refined = findEdges(resolution, samples, i);
+        if(!(tier == PERTURBATION ? computePerturbation(p, samples, true) : computeDoubleDouble(area, p, samples, true)))
+            return false;
+        _view.refined = i;
+    }
+
+    colorImage(ret, resolution, samples, i, _view.step);
+    keepImage(ret, resolution, area);
+    return true;
+}
+
+bool mandelbrot::computePerturbation(const perturbParams& p, size_t samples, bool edges)
+{
+    cl_int res;
+    const char* name = edges ? "refine" : "perturbation";
+    traceScope scope(_trace, name);
+
+    if(_backend == NATIVE)
+        return _native->computePerturbation(*_reference, p, _stats, samples, edges ? &_edges : nullptr);
+
+    // Hochladen des Orbits, der Buffer wird bei Bedarf vergrössert
+    size_t orbitSize = _reference->length() * sizeof(cl_double2);
+    if(orbitSize > _orbitSize)
+    {
+        if(_orbit != nullptr)
+            clReleaseMemObject(_orbit);
+        _orbit = clCreateBuffer(_context, CL_MEM_READ_ONLY, orbitSize, nullptr, &res);
+        error(res, "Failed to create Buffer.");
+        _orbitSize = orbitSize;
+    }
+    int64_t queued = trace::now();
+    res = clEnqueueWriteBuffer(_command_queue, _orbit, CL_TRUE, 0, orbitSize, _reference->orbit(), 0, NULL, profileEvent());
+    error(res, "Failed to write Buffer.");
+    profileCommand("orbit", queued);
+
+    // Speicherung der Werte in OpenCL-Datentypen, ein Work-Item pro gerechnetem Sample
+    size_t size = edges ? _edgeLength * samples * samples : ((p.width + p.step - 1) / p.step) * ((p.height + p.step - 1) / p.step);
+    cl_uint orbitLength = _reference->length();
+    cl_double2 deltaM;
+    cl_int2 deltaE;
+    cl_double2 refC;
+    cl_uint2 reso;
+    cl_uint stride = p.step;
+    cl_uint samp = samples;
+    cl_uint maxIter = p.iter;
+    cl_uint skip = p.skip;
+    cl_double2 series[3];
+    cl_int4 seriesE;
+    const complexexp* coeffs[3] = { &p.a, &p.b, &p.c };
+
+    for(int c = 0; c < 3; c++)
+    {
+        series[c].s[0] = coeffs[c]->x;
+        series[c].s[1] = coeffs[c]->y;
+        seriesE.s[c] = coeffs[c]->e;
+    }
+    seriesE.s[3] = 0;
+
+    deltaM.s[0] = p.dx.m;
+    deltaM.s[1] = p.dy.m;
+    deltaE.s[0] = p.dx.e;
+    deltaE.s[1] = p.dy.e;
+    refC.s[0] = p.cx;
+    refC.s[1] = p.cy;
+    reso.s[0] = p.width;
+    reso.s[1] = p.height;
+
+    // Setzen der Kernel-Argumente
+    res = clSetKernelArg(_kernelPerturbation, 0, sizeof(cl_mem), (void*)&_smooth);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelPerturbation, 1, sizeof(cl_mem), (void*)&_count);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelPerturbation, 2, sizeof(cl_mem), (void*)&_orbit);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelPerturbation, 3, sizeof(cl_uint), (void*)&orbitLength);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelPerturbation, 4, sizeof(cl_double2), (void*)&deltaM);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelPerturbation, 5, sizeof(cl_int2), (void*)&deltaE);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelPerturbation, 6, sizeof(cl_double2), (void*)&refC);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelPerturbation, 7, sizeof(cl_uint2), (void*)&reso);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelPerturbation, 8, sizeof(cl_uint), (void*)&stride);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelPerturbation, 9, sizeof(cl_uint), (void*)&maxIter);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelPerturbation, 10, sizeof(cl_uint), (void*)&skip);
+    error(res, "Failed to set Kernel Arguments.");
+    for(int c = 0; c < 3; c++)
+    {
+        res = clSetKernelArg(_kernelPerturbation, 11 + c, sizeof(cl_double2), (void*)&series[c]);
+        error(res, "Failed to set Kernel Arguments.");
+    }
+    res = clSetKernelArg(_kernelPerturbation, 14, sizeof(cl_int4), (void*)&seriesE);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelPerturbation, 15, sizeof(cl_mem), (void*)&_counters);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelPerturbation, 16, sizeof(cl_uint), (void*)&samp);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelPerturbation, 17, sizeof(cl_mem), edges ? (void*)&_edgeList : NULL);
+    error(res, "Failed to set Kernel Arguments.");
+
+    // Aufrufen der Kernel
+    if(size > 0)
+    {
+        queued = trace::now();
+        res = clEnqueueNDRangeKernel(_command_queue, _kernelPerturbation, 1, NULL, &size, NULL, 0, NULL, profileEvent());
+        error(res, "Failed to execute Kernel.");
+        profileCommand(name, queued);
+    }
+
+    readCounters();
+    return true;
+}
+
+/* Teilt eine Zahl in double-double auf: hi ist der gerundete Wert, lo der Rest
+ * @param v Die Zahl
+ * @param ret hi und lo
+ */
+static void splitDD(const bigfloat& v, double* ret)
+{
+    ret[0] = v.toDouble();
+    ret[1] = (v - bigfloat(floatexp(ret[0]), v.limbs())).toDouble();
+}
+
+/* Teilt den Abstand zweier Samples w / n in double-double auf, der Rest der Division wird mit fma
+ * exakt gerechnet
+ * @param w Die Breite oder Höhe der Fläche
+ * @param n Die Anzahl Samples
+ * @param ret hi und lo
+ */
+static void splitDD(const floatexp& w, double n, double* ret)
+{
+    double m = w.m / n;
+    ret[0] = ldexp(m, w.e);
+    ret[1] = ldexp(fma(-m, n, w.m) / n, w.e);
+}
+
+bool mandelbrot::computeDoubleDouble(const mandelbrot::deep& area, const perturbParams& p, size_t samples, bool edges)
+{
+    cl_int res;
+    const char* name = edges ? "refine" : "double-double";
+    traceScope scope(_trace, name);
+    nativeDD dd;
+
+    // Sample j hat den Punkt x + dx*(j - width/2), wie bei der Störungsrechnung
+    splitDD(area.w, p.width, dd.dx);
+    splitDD(area.h, p.height, dd.dy);
+    bigfloat x = area.x;
+    bigfloat y = area.y;
+    x.setLimbs(bigfloat::limbsFor(p.dx.log2() < p.dy.log2() ? p.dx : p.dy));
+    y.setLimbs(x.limbs());
+    splitDD(x + p.dx * floatexp(-(double)p.width / 2), dd.x0);
+    splitDD(y + p.dy * floatexp(-(double)p.height / 2), dd.y0);
+
+    if(_backend == NATIVE)
+        return _native->computeDoubleDouble(dd, p.iter, p.step, _stats, samples, edges ? &_edges : nullptr);
+
+    // Speicherung der Werte in OpenCL-Datentypen, ein Work-Item pro gerechnetem Sample
+    size_t size = edges ? _edgeLength * samples * samples : ((p.width + p.step - 1) / p.step) * ((p.height + p.step - 1) / p.step);
+    cl_double4 delta;
+    cl_double4 topLeft;
+    cl_uint2 reso;
+    cl_uint stride = p.step;
+    cl_uint maxIter = p.iter;
+    cl_uint samp = samples;
+
+    delta.s[0] = dd.dx[0];
+    delta.s[1] = dd.dx[1];
+    delta.s[2] = dd.dy[0];
+    delta.s[3] = dd.dy[1];
+    topLeft.s[0] = dd.x0[0];
+    topLeft.s[1] = dd.x0[1];
+    topLeft.s[2] = dd.y0[0];
+    topLeft.s[3] = dd.y0[1];
+    reso.s[0] = p.width;
+    reso.s[1] = p.height;
+
+    // Der Kernel ist aus _program, in double
+    _singleUsed = false;
+
+    // Setzen der Kernel-Argumente
+    res = clSetKernelArg(_kernelDD, 0, sizeof(cl_mem), (void*)&_smooth);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelDD, 1, sizeof(cl_mem), (void*)&_count);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelDD, 2, sizeof(cl_double4), (void*)&delta);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelDD, 3, sizeof(cl_double4), (void*)&topLeft);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelDD, 4, sizeof(cl_uint2), (void*)&reso);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelDD, 5, sizeof(cl_uint), (void*)&stride);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelDD, 6, sizeof(cl_uint), (void*)&maxIter);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelDD, 7, sizeof(cl_mem), (void*)&_counters);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelDD, 8, sizeof(cl_uint), (void*)&samp);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(_kernelDD, 9, sizeof(cl_mem), edges ? (void*)&_edgeList : NULL);
+    error(res, "Failed to set Kernel Arguments.");
+
+    // Aufrufen der Kernel
+    if(size > 0)
+    {
+        int64_t queued = trace::now();
+        res = clEnqueueNDRangeKernel(_command_queue, _kernelDD, 1, NULL, &size, NULL, 0, NULL, profileEvent());
+        error(res, "Failed to execute Kernel.");
+        profileCommand(name, queued);
+    }
+
+    readCounters();
+    return true;
+}
+
+size_t mandelbrot::findEdges(mandelbrot::res resolution, size_t samples, size_t i)
+{
+    cl_int res;
+    traceScope scope(_trace, "edges");
+
+    if(_backend == NATIVE)
+    {
+        _native->findEdges(resolution, samples, i, _edges);
+        return _edges.size();
+    }
+
+    // Die Liste wird bei Bedarf vergrössert, sie enthält höchstens jedes Pixel einmal
+    size_t size = resolution.x * resolution.y;
+    if(size > _edgeListSize)
+    {
+        if(_edgeList != nullptr)
+            clReleaseMemObject(_edgeList);
+        _edgeList = clCreateBuffer(_context, CL_MEM_READ_WRITE, size * sizeof(cl_uint), nullptr, &res);
+        error(res, "Failed to create Buffer.");
+        _edgeListSize = size;
+    }
+
+    // Speicherung der Werte in OpenCL-Datentypen
+    cl_uint zero = 0;
+    cl_uint length;
+    cl_uint2 reso;
+    cl_uint samp = samples;
+    cl_uint iter = i;
+
+    reso.s[0] = resolution.x;
+    reso.s[1] = resolution.y;
+
+    // Zurücksetzen der Länge der Liste
+    res = clEnqueueWriteBuffer(_command_queue, _edgeCount, CL_TRUE, 0, sizeof(cl_uint), &zero, 0, NULL, NULL);
+    error(res, "Failed to write Buffer.");
+
+    // Die Variante der letzten Berechnung (siehe colorImage)
+    cl_kernel kernel = kernels(_singleUsed, samples, _formula).edges;
+
+    // Setzen der Kernel-Argumente
+    res = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&_smooth);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&_count);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 2, sizeof(cl_uint2), (void*)&reso);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 3, sizeof(cl_uint), (void*)&samp);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 4, sizeof(cl_uint), (void*)&iter);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 5, sizeof(cl_mem), (void*)&_edgeList);
+    error(res, "Failed to set Kernel Arguments.");
+    res = clSetKernelArg(kernel, 6, sizeof(cl_mem), (void*)&_edgeCount);
+    error(res, "Failed to set Kernel Arguments.");
+
+    // Aufrufen der Kernel
+    int64_t queued = trace::now();
+    res = clEnqueueNDRangeKernel(_command_queue, kernel, 1, NULL, &size, NULL, 0, NULL, profileEvent());
+    error(res, "Failed to execute Kernel.");
+    profileCommand("edges", queued);
 
-    // Auslesen des Buffers
-    res =  clEnqueueReadBufferRect (_command_queue, _image, CL_TRUE, origin, origin, region, sizeof(cl_uchar3), 0, sizeof(mandelbrot::color), 0, (void*)ret, 0, NULL, NULL);
+    // Die Länge bestimmt die Anzahl Work-Items beim Rechnen der Liste
+    res = clEnqueueReadBuffer(_command_queue, _edgeCount, CL_TRUE, 0, sizeof(cl_uint), &length, 0, NULL, NULL);
     error(res, "Failed to read Buffer.");
+    _edgeLength = length;
+    return length;
 }
@@ -5,12 +5,90 @@
  * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
  * */
 
+#ifndef MANDELBROT_HPP
+#define MANDELBROT_HPP
+
+// Pixelgröße unter der mit Störungsrechnung gerechnet wird (double reicht dann nicht mehr)
+#define DEEP_PIXEL_SIZE 1e-12
+/* Pixelgröße bis zu der unter DEEP_PIXEL_SIZE in double-double gerechnet wird (siehe setDoubleDouble). Tiefer
+ * reichen die 106 Bit für lange Orbits nahe am Rand nicht mehr, und die Reihenentwicklung überspringt
+ * so viele Iterationen, dass die Störungsrechnung schneller ist.
+ */
+#define DD_PIXEL_SIZE 1e-24
+// Abstand relativ zur Grösse eines Samples, unter dem ein Orbit als periodisch gilt
+#define PERIOD_TOLERANCE 1e-3
+// Gewünschte Dauer einer Kachel beim Backend MULTI (Millisekunden) und minimale Höhe in Zeilen
+#define MULTI_TILE_MS 20
+#define MULTI_MIN_ROWS 8
+// Grösster Exponent von MULTIBROT (für jeden gibt es eigene Kernel)
+#define FORMULA_MAX_POWER 8
+// Anzahl Bild-Buffer auf dem OpenCL-Device (ein Bild wird übertragen während das nächste gefärbt wird)
+#define IMAGE_BUFFERS 2
+
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #include <CL/cl.h>
 
+#include <vector>
+#include <map>
+#include <string>
+#include <atomic>
+#include <mutex>
+
+#include "bigfloat.hpp"
+#include "floatexp.hpp"
+
+class native;
+class reference;
+class trace;
+struct nativeMap;
+struct perturbParams;
+
 class mandelbrot
 {
 public:
+    // Mögliche Backends zur Berechnung
+    enum backend
+    {
+        OPENCL,     // OpenCL Kernel computeIterations
+        NATIVE,     // SIMD-Code auf allen CPU-Kernen (native.hpp)
+        MULTI       // Alle OpenCL-Devices und NATIVE, Kacheln werden dynamisch verteilt (computeTiles)
+    };
+    // Mögliche Aufteilungen eines Bildes auf dem OpenCL-Device
+    enum schedule
+    {
+        CHUNKED,    // Ein Aufruf von computeIterations pro Streifen von Zeilen
+        PERSISTENT, // computeIterationsPersistent holt sich Kacheln über einen atomaren Zähler
+        TILED       // computeIterationsTiled mit 2D-Work-Groups pro Streifen, Grösse vom Auto-Tuner (siehe tune)
+    };
+    // Die Formeln der Familie (siehe setFormula)
+    enum fractal
+    {
+        MANDELBROT,     // z² + c
+        MULTIBROT,      // z^n + c mit ganzzahligem n
+        BURNING_SHIP    // (|Re z| + i|Im z|)² + c
+    };
+    // Eine Formel, jede wird in eigene Kernel übersetzt (Templates bzw. Optionen von mandelbrot.cl)
+    struct formula
+    {
+        fractal type;       // Die Formel
+        unsigned power;     // Der Exponent n bei MULTIBROT (2 bis FORMULA_MAX_POWER)
+        bool julia;         // Julia-Menge: c ist fest (jx, jy) und z beginnt beim Punkt des Samples
+        double jx;          // c der Julia-Menge (x)
+        double jy;          // c der Julia-Menge (y)
+
+        bool operator==(const formula& o) const
+        {
+            return type == o.type && power == o.power && julia == o.julia && jx == o.jx && jy == o.jy;
+        }
+    };
+    // Die Genauigkeit einer Berechnung, nach Tiefe des Zooms (siehe precisionOf)
+    enum precision
+    {
+        SINGLE,         // float (siehe setSingle)
+        DOUBLE,         // double
+        DOUBLE_DOUBLE,  // double-double mit etwa 106 Bit (siehe setDoubleDouble)
+        PERTURBATION    // Störungsrechnung mit einem Referenz-Orbit (siehe perturbation.hpp)
+    };
     // Speichern einer Farbe
     struct color
     {
@@ -37,40 +115,502 @@ public:
         pos tl;
         pos br;
     };
+    // Statistik der letzten Berechnung
+    struct stats
+    {
+        size_t skipped;     // Durch die Reihenentwicklung übersprungene Iterationen pro Sample
+        size_t bulb;        // Samples in der Hauptkardioide oder im Kreis der Periode 2
+        size_t periodic;    // Samples deren Orbit als periodisch erkannt wurde
+        size_t reused;      // Vom letzten Bild übernommene Samples (Verschieben und Zoomen)
+        size_t refined;     // Pixel an Kanten, die beim adaptiven Supersampling alle Samples bekommen
+        size_t filled;      // Samples die beim Unterteilen gefüllt statt gerechnet wurden (siehe setSubdivide)
+    };
+    // Arbeit im Iterations-Buffer (siehe countWork)
+    struct work
+    {
+        uint64_t iterations;    // Summe der Iterationen
+        size_t samples;         // Gerechnete Samples
+        size_t escaped;         // Davon entkommen
+        size_t interior;        // Davon nicht entkommen (innen oder nach i Iterationen noch nicht entkommen)
+    };
+    // Speichern eines Bereiches mit beliebiger Genauigkeit (für tiefe Zooms)
+    struct deep
+    {
+        bigfloat x;     // Mittelpunkt (x)
+        bigfloat y;     // Mittelpunkt (y)
+        floatexp w;     // Breite (br.x - tl.x)
+        floatexp h;     // Höhe (br.y - tl.y)
+    };
 
 private:
+    // Inhalt des Iterations-Buffers
+    struct view
+    {
+        bool perturbation;          // true falls mit Störungsrechnung oder double-double gerechnet wurde
+        mandelbrot::rect area;      // Die Fläche (ohne Störungsrechnung)
+        mandelbrot::deep deepArea;  // Die Fläche (mit Störungsrechnung)
+        mandelbrot::res res;        // Die Auflösung des Bildes
+        size_t samples;             // Die Anzahl Samples pro Pixel (0 falls der Buffer ungültig ist)
+        size_t iter;                // Die Anzahl gerechneter Iterationen
+        size_t step;                // Jedes step-te Sample ist gerechnet (SIZE_MAX falls keines sicher)
+        size_t refined;             // Iterationen mit denen die Kanten verfeinert sind (0 falls nicht)
+    };
+
+    // Ein spezialisiertes Programm mit seinen Kerneln (siehe kernels)
+    struct variant
+    {
+        cl_program program;         // Das Programm (_program ohne Optionen)
+        cl_kernel iterations;       // computeIterations
+        cl_kernel persistent;       // computeIterationsPersistent
+        cl_kernel tiled;            // computeIterationsTiled
+        cl_kernel color;            // colorImage
+        cl_kernel edges;            // findEdges
+        cl_kernel list;             // computeSampleList
+        size_t groupSize;           // Größe einer Work-Group für computeIterationsPersistent
+        size_t tiledSize;           // Maximale Grösse einer Work-Group für computeIterationsTiled
+    };
+
+    // Aufteilung für computeIterationsTiled (siehe tune)
+    struct tuning
+    {
+        uint32_t local[2];          // Grösse einer Work-Group in Samples (x, y)
+        uint32_t per;               // Samples pro Work-Item (in x, im Abstand local[0])
+    };
+
+    // Eine laufende Übertragung eines Bildes in den RAM (siehe setAsync)
+    struct transfer
+    {
+        cl_event event;                     // Ende der Übertragung (nullptr falls keine läuft)
+        const mandelbrot::color* target;    // Der Buffer im RAM
+    };
+
+    // Ein profilierter Befehl auf dem OpenCL-Device (siehe setTrace)
+    struct command
+    {
+        cl_event event;             // Das Event des Befehls
+        const char* name;           // Der Name im Trace
+        int64_t queued;             // Host-Zeit beim Einreihen (trace::now, 0 falls unbekannt)
+    };
+
+    // Ein Device des Backends MULTI
+    struct device
+    {
+        mandelbrot* brot;           // Das Mandelbrot-Modul des Devices
+        double throughput;          // Gemessene Pixel pro Millisekunde (0 falls noch nicht gemessen)
+    };
+
+    backend _backend;                   // Das benutzte Backend
+    std::vector<device> _devices;       // Die Devices (nur bei MULTI)
+    std::mutex _tileLock;               // Schützt die Verteilung der Kacheln und die Statistik bei MULTI
+    schedule _schedule;                 // Die Aufteilung auf dem OpenCL-Device
+    bool _adaptive;                     // Adaptives Supersampling (siehe setAdaptive)
+    bool _subdivide;                    // Unterteilen statt jedes Sample zu rechnen (siehe setSubdivide)
+    bool _subdivideCheck;               // Gefüllte Rechtecke werden mit Proben kontrolliert
+    bool _single;                       // float erlaubt (siehe setSingle)
+    bool _singleUsed;                   // Die letzte Berechnung war in float (Variante für colorImage und findEdges)
+    bool _doubleDouble;                 // double-double erlaubt (siehe setDoubleDouble)
+    formula _formula;                   // Die Formel (siehe setFormula)
+    native* _native;                    // Natives Backend (nur bei NATIVE)
     cl_platform_id _platform_id;        // OpenCL Platform (Treiber)
     cl_device_id _device_id;            // OpenCL Device (GPU)
     cl_context _context;                // OpenCL Context
     cl_command_queue _command_queue;    // OpenCL Command Queue
-    cl_program _program;                // OpenCL Programm (mandelbrot.cl)
-    cl_kernel _kernel;                  // OpenCL Kernel (computeColors)
-    cl_mem _image;                      // OpenCL Buffer zum speichern des Bildes
+    cl_command_queue _transfer_queue;   // OpenCL Command Queue für die Übertragung der Bilder
+    cl_program _program;                // OpenCL Programm (mandelbrot.cl ohne Optionen, siehe buildProgram)
+    std::map<std::string, variant> _variants;   // Die bereits erstellten Varianten nach ihren Optionen
+    cl_kernel _kernelReproject;         // OpenCL Kernel (reprojectSamples)
+    cl_mem _image[IMAGE_BUFFERS];       // OpenCL Buffer zum speichern der Bilder (auf dem Device)
+    transfer _transfers[IMAGE_BUFFERS]; // Die laufenden Übertragungen aus _image
+    size_t _imageNext;                  // Index des nächsten Buffers in _image
+    bool _async;                        // computeImage wartet nicht auf die Übertragung (siehe setAsync)
+    mutable std::mutex _imageLock;      // Schützt _transfers und das letzte Bild (waitImage aus anderen Threads)
+    cl_mem _smooth;                     // Iterations-Buffer: geglättete Iterationswerte der Samples
+    cl_mem _state;                      // Iterations-Buffer: z der nicht entkommenen Samples
+    cl_mem _count;                      // Iterations-Buffer: Anzahl Iterationen der Samples
+    size_t _bufferSize;                 // Anzahl Samples im Iterations-Buffer
+    cl_mem _oldSmooth;                  // Iterations-Buffer des letzten Bildes (für reprojectSamples)
+    cl_mem _oldState;
+    cl_mem _oldCount;
+    size_t _oldBufferSize;              // Anzahl Samples im alten Iterations-Buffer
+    cl_mem _next;                       // Zähler der nächsten Kachel für computeIterationsPersistent
+    cl_mem _counters;                   // Zähler der vorzeitig beendeten Samples (bulb, periodic)
+    cl_mem _edgeList;                   // Liste der zu verfeinernden Pixel (von findEdges)
+    size_t _edgeListSize;               // Anzahl Pixel die _edgeList fassen kann
+    cl_mem _edgeCount;                  // Länge der Liste in _edgeList (auf dem Device)
+    size_t _edgeLength;                 // Länge der Liste in _edgeList
+    std::vector<unsigned> _edges;       // Liste der zu verfeinernden Pixel beim nativen Backend
+    cl_kernel _kernelPerturbation;      // OpenCL Kernel (computePerturbation)
+    cl_kernel _kernelDD;                // OpenCL Kernel (computeIterationsDD)
+    cl_kernel _kernelClassify;          // OpenCL Kernel (classifyRects)
+    cl_kernel _kernelFill;              // OpenCL Kernel (fillRects)
+    cl_mem _sampleList;                 // Liste der Samples einer Runde beim Unterteilen
+    size_t _sampleListSize;             // Grösse von _sampleList in Bytes
+    cl_mem _rects;                      // Rechtecke einer Runde beim Unterteilen
+    size_t _rectsSize;                  // Grösse von _rects in Bytes
+    cl_mem _classes;                    // Klassen der Rechtecke in _rects
+    size_t _classesSize;                // Grösse von _classes in Bytes
+    cl_mem _orbit;                      // OpenCL Buffer des Referenz-Orbits
+    size_t _orbitSize;                  // Größe von _orbit in Bytes
+    reference* _reference;              // Referenz-Orbit für tiefe Zooms
+    stats _stats;                       // Statistik der letzten Berechnung
+    size_t _groups;                     // Anzahl der gleichzeitig gestarteten Work-Groups
+    tuning _tuning;                     // Aufteilung bei TILED
+    bool _tuned;                        // _tuning ist gemessen oder aus dem Cache gelesen
+    view _view;                         // Inhalt des Iterations-Buffers
+    std::vector<mandelbrot::color> _lastImage;  // Das letzte gefärbte Bild (für preview)
+    mandelbrot::deep _lastArea;         // Die Fläche von _lastImage
+    mandelbrot::res _lastRes;           // Die Auflösung von _lastImage
+    const mandelbrot::color* _keepTarget;   // Bild das nach seiner Übertragung gespeichert wird (oder nullptr)
+    mandelbrot::deep _keepArea;         // Die Fläche von _keepTarget
+    mandelbrot::res _keepRes;           // Die Auflösung von _keepTarget
+    const std::atomic<bool>* _cancel;   // Abbruch der laufenden Berechnung falls true (oder nullptr)
+    trace* _trace;                      // Zeiten der Schritte werden hier gespeichert (oder nullptr)
+    int _track;                         // Die Spur des OpenCL-Devices in _trace
+    cl_event _profiled;                 // Das Event des zuletzt eingereihten Befehls (siehe profileEvent)
+    std::vector<command> _commands;     // Profilierte Befehle, deren Zeiten noch nicht gelesen sind
+    std::mutex _commandLock;            // Schützt _commands (finishTransfer aus anderen Threads)
+    int64_t _clockOffset;               // Host-Zeit minus Device-Zeit in Nanosekunden
+
+    // Gibt true zurück falls die laufende Berechnung abgebrochen werden soll
+    bool cancelled() const { return _cancel != nullptr && *_cancel; }
+
+    /* Gibt das Event für den nächsten Befehl zurück falls profiliert wird, sonst nullptr (dann
+     * entsteht kein Event). Nach dem Einreihen übernimmt profileCommand das Event aus _profiled.
+     */
+    cl_event* profileEvent() { return _trace != nullptr ? &_profiled : nullptr; }
+
+    /* Merkt sich den zuletzt mit profileEvent eingereihten Befehl (nichts falls nicht profiliert wird)
+     * @param name Der Name im Trace
+     * @param queued Host-Zeit vor dem Einreihen (trace::now)
+     */
+    void profileCommand(const char* name, int64_t queued);
+
+    /* Merkt sich einen Befehl, seine Zeiten auf dem Device liest readProfile. Das Event gehört danach
+     * dem Mandelbrot-Modul (ohne Trace wird es sofort freigegeben).
+     * @param name Der Name im Trace
+     * @param event Das Event des Befehls
+     * @param queued Host-Zeit vor dem Einreihen (trace::now, 0 falls unbekannt)
+     */
+    void addCommand(const char* name, cl_event event, int64_t queued);
+
+    /* Speichert die Zeiten aller beendeten Befehle aus _commands in der Spur des Devices. Die Uhr des
+     * Devices wird über den Zeitpunkt des Einreihens auf die des Hosts umgerechnet.
+     * @param wait true um auf alle Befehle zu warten
+     */
+    void readProfile(bool wait = false);
+
+    /* Liest das Bild aus _image in den Buffer ret, auf _transfer_queue und ohne zu warten falls _async
+     * @param ret Ein Zeiger zum Buffer im RAM
+     * @param size Die Anzahl der Pixel
+     * @param buffer Der Index des Buffers in _image
+     * @param colored Das Ende von colorImage, die Übertragung wartet darauf
+     */
+    void readImage(mandelbrot::color* ret, size_t size, size_t buffer, cl_event colored);
+
+    /* Wartet auf das Ende einer Übertragung und speichert das Bild falls keepImage darauf wartet.
+     * _imageLock muss gesperrt sein.
+     * @param buffer Der Index des Buffers in _image
+     */
+    void finishTransfer(size_t buffer);
+
+    /* Erstellt ein Programm aus dem eingebetteten mandelbrot.cl. Das Binary des Devices wird im Cache
+     * gespeichert (siehe PROGRAM_CACHE_ENV) und beim nächsten Start geladen statt neu compiliert.
+     * @param options Die Optionen für clBuildProgram (Teil des Schlüssels im Cache)
+     * @return Das Programm
+     */
+    cl_program buildProgram(const char* options);
+
+    /* Gibt die für eine Berechnung spezialisierten Kernel zurück. Jede Variante ist ein eigenes
+     * Programm (USE_FLOAT, FIXED_SAMPLES und die Formel in mandelbrot.cl), es wird erst beim ersten
+     * Gebrauch erstellt.
+     * @param single true falls die Iterationen in float gerechnet werden
+     * @param samples Die Anzahl Samples pro Pixel (bis KERNEL_FIXED_SAMPLES als Konstante)
+     * @param f Die Formel (meist _formula)
+     */
+    const variant& kernels(bool single, size_t samples, const mandelbrot::formula& f);
+
+    /* Bestimmt beim ersten Aufruf die Aufteilung für TILED: Für jede Grösse der Work-Groups und Anzahl
+     * Samples pro Work-Item wird ein Kalibrier-Bild (in double und immer mit z² + c, mit eigenen Buffern)
+     * gerechnet und die schnellste gewählt. Varianten die nur kleinere Work-Groups erlauben, verkleinern sie. Das Ergebnis gilt für Device, Treiber und Quelltext der Kernel und wird im
+     * Cache gespeichert (siehe cacheDirectory), spätere Programme lesen es nur noch.
+     */
+    void tune();
+
+    // Setzt die Zähler in _counters und _stats auf 0
+    void resetCounters();
+    // Liest die Zähler aus _counters in _stats
+    void readCounters();
+
+    /* Vergrössert den Iterations-Buffer auf dem OpenCL-Device bei Bedarf
+     * @param size Die Anzahl der Samples
+     */
+    void createSampleBuffers(size_t size);
+
+    /* Tauscht den Iterations-Buffer mit dem des letzten Bildes und übernimmt daraus alle Samples
+     * die genau auf dem neuen Gitter liegen. Alle anderen werden mit SMOOTH_PENDING markiert und
+     * von der nächsten Berechnung mit start 0 gerechnet. Setzt _stats.reused.
+     * @param res Die Auflösung des Bildes
+     * @param samples Die Anzahl Samples pro Pixel
+     * @param map Die Abbildung auf das Gitter von _view (nullptr falls nichts übernommen wird)
+     */
+    void reproject(mandelbrot::res res, size_t samples, const nativeMap* map);
+
+    /* Berechnet die Iterationen der Samples im Iterations-Buffer
+     * @param res Die Auflösung des Bildes
+     * @param pos Die Fläche die berechnet werden soll
+     * @param samples Die Anzahl Samples pro Pixel
+     * @param start Bereits gerechnete Iterationen, nicht entkommene Samples werden ab hier
+     *              fortgesetzt (0 um die Samples mit SMOOTH_PENDING zu rechnen)
+     * @param i Die maximale Anzahl an Iterationen
+     * @param step Nur jedes step-te Sample (in x und y) wird gerechnet
+     * @param edges true um statt jedem step-ten Sample alle Samples der Pixel von findEdges zu rechnen
+     * @return false falls die Berechnung abgebrochen wurde
+     */
+    bool computeIterations(mandelbrot::res res, mandelbrot::rect pos, size_t samples, size_t start, size_t i, size_t step, bool edges = false);
+
+    /* Berechnet die Samples mit SMOOTH_PENDING auf dem Gitter jedes step-ten Samples durch Unterteilen
+     * (siehe native::subdivide). Auf dem OpenCL-Device in Runden: computeSampleList rechnet die Ränder
+     * aller Rechtecke der Runde in einem Aufruf, classifyRects prüft sie, fillRects füllt die
+     * gleichförmigen und die übrigen werden auf dem Host geteilt. Setzt _stats.filled.
+     * Parameter und Rückgabe wie bei computeIterations mit start 0.
+     */
+    bool subdivide(mandelbrot::res res, mandelbrot::rect pos, size_t samples, size_t i, size_t step);
+
+    /* Berechnet die Samples mit SMOOTH_PENDING mithilfe der Störungsrechnung
+     * @param p Die Parameter (siehe perturbation.hpp), der Referenz-Orbit ist _reference
+     * @param samples Die Anzahl Samples pro Pixel
+     * @param edges true um statt jedem p.step-ten Sample alle Samples der Pixel von findEdges zu rechnen
+     * @return false falls die Berechnung abgebrochen wurde
+     */
+    bool computePerturbation(const perturbParams& p, size_t samples, bool edges);
+
+    /* Berechnet die Samples mit SMOOTH_PENDING in double-double (siehe native::computeDoubleDouble)
+     * @param area Die Fläche, die Samples haben die Punkte wie bei der Störungsrechnung
+     * @param p Die Parameter, nur die Auflösung, der Abstand der Samples, iter und step werden benutzt
+     * @param samples Die Anzahl Samples pro Pixel
+     * @param edges true um statt jedem p.step-ten Sample alle Samples der Pixel von findEdges zu rechnen
+     * @return false falls die Berechnung abgebrochen wurde
+     */
+    bool computeDoubleDouble(const mandelbrot::deep& area, const perturbParams& p, size_t samples, bool edges);
+
+    /* Sucht die Pixel deren erstes Sample sich sichtbar von dem eines Nachbarn unterscheidet und
+     * speichert sie als kompakte Liste (_edges bzw. _edgeList)
+     * @param res Die Auflösung des Bildes
+     * @param samples Die Anzahl Samples pro Pixel
+     * @param i Die maximale Anzahl an Iterationen
+     * @return Die Anzahl der gefundenen Pixel
+     */
+    size_t findEdges(mandelbrot::res res, size_t samples, size_t i);
+
+    /* Färbt das Bild aus dem Iterations-Buffer und speichert es in ret
+     * @param ret Ein Zeiger zum Buffer im RAM
+     * @param res Die Auflösung des Bildes
+     * @param samples Die Anzahl Samples pro Pixel
+     * @param i Die maximale Anzahl an Iterationen, später entkommene Samples sind schwarz
+     * @param step Jedes step-te Sample ist sicher gerechnet. Jedes Pixel ist der Durchschnitt seiner
+     *             gerechneten Samples, Pixel ohne eines übernehmen das vorherige (siehe nativeLattice).
+     */
+    void colorImage(mandelbrot::color* ret, mandelbrot::res res, size_t samples, size_t i, size_t step);
+
+    /* Berechnet das Bild mit allen Devices (Backend MULTI). Das Bild wird in Streifen aufgeteilt,
+     * jedes Device holt sich den nächsten, sobald es fertig ist. Die Höhe eines Streifens richtet
+     * sich nach dem gemessenen Durchsatz des Devices, so dass er etwa MULTI_TILE_MS dauert, gegen
+     * Ende aber höchstens einen Teil der restlichen Zeilen (damit alle etwa gleichzeitig fertig sind).
+     * Parameter und Rückgabe wie bei computeImage.
+     */
+    bool computeTiles(mandelbrot::color* ret, mandelbrot::res res, const mandelbrot::deep& area, size_t i, size_t samples, size_t step);
 
 public:
-    // Der Konstruktor initialisiert die OpenCL umgebung
-    mandelbrot();
+    /* Der Konstruktor initialisiert das gewählte Backend
+     * @param b Das zu benutzende Backend
+     * @param device Das OpenCL-Device (nullptr für das erste Device der ersten Platform)
+     */
+    mandelbrot(backend b = OPENCL, cl_device_id device = nullptr);
     // Der Destructor beendet alles sicher
     ~mandelbrot();
 
     // Listet alle verfügbaren Devices in allen Platformen auf, und gibt sie aus.
     void listDevices();
 
-    /* Erstellt den Buffer für das Image in _image
+    // Gibt alle OpenCL-Devices aller Platformen zurück
+    static std::vector<cl_device_id> devices();
+
+    /* Gibt das Verzeichnis des Caches zurück (Programme, Kacheln) und erstellt es falls nötig. Das ist
+     * der Wert von PROGRAM_CACHE_ENV, sonst $XDG_CACHE_HOME/mandelbrot oder ~/.cache/mandelbrot.
+     * @return Das Verzeichnis oder "" falls es keinen Cache gibt
+     */
+    static std::string cacheDirectory();
+
+    /* Erstellt die Buffer für das Image in _image
      * @param res Die auflösung des Bildes
-     * @param ptr Ein Zeiger zum Buffer im RAM
      */
-    void createBuffer(mandelbrot::res res, void* ptr);
+    void createBuffer(mandelbrot::res res);
 
-    // Löscht den Buffer _image
+    // Löscht die Buffer in _image, nachdem alle Übertragungen beendet sind
     void deleteBuffer();
 
-    /* Berechnet die Abbildung der Mandelbrot-Menge und speichet das ergebnis in ret
+    /* Setzt die Aufteilung des Bildes auf dem OpenCL-Device
+     * @param s Die Aufteilung
+     */
+    void setSchedule(schedule s);
+
+    /* Setzt das Flag mit dem eine laufende Berechnung abgebrochen wird. computeImage gibt dann so
+     * bald wie möglich false zurück, ohne das Bild zu färben.
+     * @param flag Das Flag (nullptr falls nie abgebrochen wird)
+     */
+    void setCancel(const std::atomic<bool>* flag);
+
+    /* Schaltet das adaptive Supersampling ein oder aus. Dabei wird zuerst nur ein Sample pro Pixel
+     * gerechnet, alle samples² Samples nur für Pixel die sich sichtbar von einem Nachbarn
+     * unterscheiden (Kanten). Das kostet nur einen Bruchteil und sieht fast gleich aus.
+     * @param adaptive true für adaptives Supersampling
+     */
+    void setAdaptive(bool adaptive);
+
+    /* Schaltet das Unterteilen ein oder aus (Mariani-Silver, siehe native::subdivide). Rechtecke mit
+     * gleichförmigem Rand (ganz innen oder die selbe Iteration des Entkommens) werden gefüllt statt
+     * gerechnet, das spart bei grossen inneren Flächen und breiten Bändern viel Arbeit, kann aber
+     * dünne Strukturen im Inneren eines Rechtecks übersehen. Nur ohne Störungsrechnung und nur für
+     * zusammenhängende Mengen (nicht beim Burning Ship und bei Julia-Mengen, siehe setFormula).
+     * @param subdivide true zum Unterteilen
+     * @param check true um vor jedem Füllen einige Samples im Inneren zu kontrollieren
+     */
+    void setSubdivide(bool subdivide, bool check = false);
+
+    /* Erlaubt float statt double für Bilder, deren Samples weit genug auseinander liegen (siehe
+     * nativeSingle). Viele GPUs rechnen float 16 bis 64 mal schneller, die CPU doppelt so schnell.
+     * @param allow false um immer in double zu rechnen (Standard ist true)
+     */
+    void setSingle(bool allow);
+
+    /* Erlaubt double-double (etwa 106 Bit, mit SIMD bzw. auf dem OpenCL-Device) statt der Störungsrechnung
+     * für Pixel zwischen DD_PIXEL_SIZE und DEEP_PIXEL_SIZE. Dort ist es schneller, da kein Referenz-Orbit
+     * gebraucht wird und keine Glitches entstehen können.
+     * @param allow false um dort mit Störungsrechnung zu rechnen (Standard ist true)
+     */
+    void setDoubleDouble(bool allow);
+
+    /* Wählt die Formel. Jede Formel hat eigene Kernel ohne Verzweigung in der Schleife (Templates beim
+     * nativen Backend, eine Variante von mandelbrot.cl für OpenCL), die erst beim ersten Gebrauch erstellt
+     * werden. Der Test der Hauptkardioide, double-double und die Störungsrechnung gibt es nur für
+     * MANDELBROT ohne Julia, sonst wird auch bei tiefen Zooms in double gerechnet. MULTIBROT mit n = 2
+     * wird zu MANDELBROT. Verwirft den Iterations-Buffer (siehe reset).
+     * @param f Die Formel (Standard ist MANDELBROT)
+     */
+    void setFormula(const mandelbrot::formula& f);
+
+    // Gibt die gewählte Formel zurück (nach den Anpassungen von setFormula)
+    const mandelbrot::formula& getFormula() const { return _formula; }
+
+    /* Gibt die Genauigkeit zurück, mit der computeImage eine Fläche rechnen würde
+     * @param area Die Fläche
+     * @param res Die Auflösung des Bildes
+     * @param samples Die Anzahl Samples pro Pixel
+     */
+    precision precisionOf(const mandelbrot::deep& area, mandelbrot::res res, size_t samples) const;
+
+    // Gibt den Namen einer Genauigkeit zurück (z.B. "double-double")
+    static const char* precisionName(precision p);
+
+    /* Schaltet die asynchrone Übertragung der Bilder ein oder aus (nur beim Backend OPENCL). computeImage
+     * gibt dann zurück sobald das Bild gefärbt ist, während es noch in ret übertragen wird, und die
+     * nächste Berechnung kann schon beginnen. ret ist erst nach waitImage(ret) gültig.
+     * @param async true für asynchrone Übertragung
+     */
+    void setAsync(bool async);
+
+    /* Schaltet das Profiling ein oder aus. Die Schritte jeder Berechnung werden mit ihrer Dauer im
+     * Thread des Aufrufers gespeichert, die Befehle auf dem OpenCL-Device mit ihren Zeiten aus den
+     * Events (CL_QUEUE_PROFILING_ENABLE) in einer eigenen Spur pro Device. Befehle deren Event noch
+     * nicht beendet ist (z.B. die asynchrone Übertragung) erscheinen erst nach der nächsten Berechnung.
+     * @param t Der Trace (nullptr um das Profiling auszuschalten), muss das Modul überleben
+     */
+    void setTrace(trace* t);
+
+    /* Wartet bis die Übertragung eines Bildes in ret beendet ist (sofort falls keine läuft). Darf auch
+     * von einem anderen Thread als computeImage aufgerufen werden.
+     * @param ret Ein Zeiger zum Buffer im RAM
+     */
+    void waitImage(const mandelbrot::color* ret);
+
+    /* Berechnet die Abbildung der Mandelbrot-Menge und speichet das ergebnis in ret. Wurde zuvor
+     * die selbe Fläche mit den selben Samples berechnet, werden bei mehr Iterationen nur die nicht
+     * entkommenen Samples fortgesetzt, bei weniger Iterationen wird nur neu gefärbt. Sonst werden
+     * die Samples des letzten Bildes übernommen, die genau auf dem neuen Gitter liegen (z.B. beim
+     * Verschieben um ganze Pixel oder beim Zoomen um Faktor 2), falls nicht weniger Iterationen
+     * verlangt sind.
+     * Mit step > 1 wird nur jedes step-te Sample (in x und y) gerechnet, für eine schnelle grobe
+     * Vorschau. Weitere Aufrufe mit kleinerem step für die selbe Fläche rechnen nur die fehlenden.
+     * Beim adaptiven Supersampling verfeinert step < samples die Kanten (siehe setAdaptive).
      * @param ret Ein Zeiger zum Buffer im RAM
      * @param res Die Auflösung des Bildes
      * @param pos Die Fläche die berechnet werden soll
      * @param i Die maximale Anzahl an Iterationen
      * @param i Die Anzahl Samples pro Pixel
+     * @param step Der Abstand der gerechneten Samples
+     * @return false falls die Berechnung abgebrochen wurde (siehe setCancel)
+     */
+    bool computeImage(mandelbrot::color* ret, mandelbrot::res res, mandelbrot::rect pos, size_t i, size_t samples, size_t step = 1);
+
+    /* Wie computeImage, aber mit beliebiger Genauigkeit. Ist ein Pixel kleiner als DEEP_PIXEL_SIZE,
+     * wird in double-double oder mit Störungsrechnung gerechnet (siehe precisionOf), sonst wie gewohnt.
+     * Dann wird bei weniger Iterationen nur neu gefärbt, bei mehr aber neu gerechnet.
+     * Samples des letzten Bildes werden nur übernommen, falls nicht mehr Iterationen verlangt sind.
+     * @param ret Ein Zeiger zum Buffer im RAM
+     * @param res Die Auflösung des Bildes
+     * @param area Die Fläche die berechnet werden soll
+     * @param i Die maximale Anzahl an Iterationen
+     * @param samples Die Anzahl Samples pro Pixel
+     * @param step Der Abstand der gerechneten Samples
+     * @return false falls die Berechnung abgebrochen wurde (siehe setCancel)
+     */
+    bool computeImage(mandelbrot::color* ret, mandelbrot::res res, const mandelbrot::deep& area, size_t i, size_t samples, size_t step = 1);
+
+    /* Erstellt sofort eine Vorschau der Fläche area aus dem letzten gefärbten Bild, indem jedes Pixel
+     * vom nächsten alten Pixel übernommen wird. Pixel ausserhalb des letzten Bildes sind schwarz.
+     * @param ret Ein Zeiger zum Buffer im RAM
+     * @param res Die Auflösung des Bildes
+     * @param area Die Fläche der Vorschau
+     * @return false falls noch kein Bild gefärbt wurde
+     */
+    bool preview(mandelbrot::color* ret, mandelbrot::res res, const mandelbrot::deep& area) const;
+
+    // Verwirft den Iterations-Buffer, die nächste Berechnung beginnt von vorne
+    void reset();
+
+    /* Speichert ein Bild für preview, nach dem Ende seiner Übertragung falls sie noch läuft. computeImage
+     * macht das selbst, von aussen nur für Bilder die anders entstanden sind (z.B. aus Kacheln).
+     * @param image Das Bild
+     * @param res Die Auflösung des Bildes
+     * @param area Die Fläche des Bildes
      */
-    void computeImage(mandelbrot::color* ret, mandelbrot::res res, mandelbrot::rect pos, size_t i, size_t samples);
+    void keepImage(const mandelbrot::color* image, mandelbrot::res res, const mandelbrot::deep& area);
+
+    // Gibt die Statistik der letzten Berechnung zurück
+    const mandelbrot::stats& lastStats() const { return _stats; }
+
+    /* Zählt die Samples im Iterations-Buffer der letzten Berechnung und die Summe ihrer Iterationen,
+     * als hätte jedes Sample bis zum Entkommen bzw. bis i iteriert (ohne die Abkürzungen für innere
+     * Samples). Das ist die Arbeit des Bildes, unabhängig vom Backend. Liest den ganzen
+     * Iterations-Buffer, nur für Messungen.
+     * @param i Die maximale Anzahl an Iterationen
+     * @return Die Arbeit (0 beim Backend MULTI, dort hat jedes Device nur seinen letzten Streifen)
+     */
+    mandelbrot::work countWork(size_t i);
+
+    // Wandelt einen Bereich mit beliebiger Genauigkeit in einen mit double um
+    static mandelbrot::rect toRect(const mandelbrot::deep& area);
+    // Wandelt einen Bereich mit double in einen mit beliebiger Genauigkeit um
+    static mandelbrot::deep toDeep(const mandelbrot::rect& area);
+
+    /* Gibt die Fläche einer Kachel eines Bildes zurück
+     * @param area Die Fläche des ganzen Bildes
+     * @param res Die Auflösung des ganzen Bildes
+     * @param x Die Position der Kachel in Pixeln (x)
+     * @param y Die Position der Kachel in Pixeln (y)
+     * @param tile Die Auflösung der Kachel
+     */
+    static mandelbrot::deep tileArea(const mandelbrot::deep& area, mandelbrot::res res, size_t x, size_t y, mandelbrot::res tile);
 };
+
+#endif
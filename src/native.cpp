@@ -0,0 +1,572 @@
+/*  native.cpp
+ * Name Native-Modul
+ * Modul zum berechnen der Mandelbrot-Menge auf allen CPU-Kernen mithilfe von SIMD-Befehlen
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#include "native.hpp"
+#include "pool.hpp"
+#include "perturbation.hpp"
+#include <algorithm>
+#include <atomic>
+
+native::native()
+{
+    // Auswahl des breitesten vom Prozessor unterstützten Befehlssatzes
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+    {
+        _kernel = avx512::computeSpan;
+        _kernelPixels = avx512::computePixels;
+        _isa = "AVX-512";
+    }
+    else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        _kernel = avx2::computeSpan;
+        _kernelPixels = avx2::computePixels;
+        _isa = "AVX2";
+    }
+    else
+    {
+        _kernel = sse2::computeSpan;
+        _kernelPixels = sse2::computePixels;
+        _isa = "SSE2";
+    }
+
+    // Ein Thread pro Kern
+    _threads = std::thread::hardware_concurrency();
+    if(_threads == 0)
+        _threads = 1;
+    _pool = new pool(_threads);
+    _width = 0;
+    _height = 0;
+    _single = true;
+    _formula = { mandelbrot::MANDELBROT, 2, false, 0, 0 };
+    _cancel = nullptr;
+}
+
+native::~native()
+{
+    delete _pool;
+}
+
+nativeBuffer native::buffer()
+{
+    nativeBuffer b;
+
+    b.width = _width;
+    b.height = _height;
+    b.smooth = _smooth.data();
+    b.count = _count.data();
+    b.z = _z.data();
+    return b;
+}
+
+void native::reproject(mandelbrot::res resolution, size_t samples, const nativeMap* map)
+{
+    size_t oldWidth = _width;
+    size_t oldHeight = _height;
+
+    // Der alte Buffer wird nur getauscht, nicht kopiert
+    _smooth.swap(_oldSmooth);
+    _count.swap(_oldCount);
+    _z.swap(_oldZ);
+
+    // Die Grösse ändert sich nur mit der Auflösung oder den Samples, z wird nur beim Fortsetzen gelesen
+    _width = resolution.x * samples;
+    _height = resolution.y * samples;
+    _smooth.resize(_width * _height);
+    _count.resize(_width * _height);
+    _z.resize(2 * _width * _height);
+
+    // Die Abbildung ist pro Achse unabhängig, die Spalten werden nur einmal berechnet
+    std::vector<long> columns(_width, -1);
+    if(map != nullptr)
+        for(size_t x = 0; x < _width; x++)
+            columns[x] = nativeMapAxis(x, oldWidth, map->sx, map->ox);
+
+    for(size_t ty = 0; ty < _height; ty += NATIVE_TILE_HEIGHT)
+    {
+        _pool->submit([=, &columns]() {
+            size_t h = std::min<size_t>(NATIVE_TILE_HEIGHT, _height - ty);
+            for(size_t y = ty; y < ty + h; y++)
+            {
+                long row = map == nullptr ? -1 : nativeMapAxis(y, oldHeight, map->sy, map->oy);
+                for(size_t x = 0; x < _width; x++)
+                {
+                    size_t g = y*_width + x;
+                    if(row < 0 || columns[x] < 0)
+                    {
+                        _smooth[g] = SMOOTH_PENDING;
+                        continue;
+                    }
+                    size_t o = row*oldWidth + columns[x];
+                    _smooth[g] = _oldSmooth[o];
+                    _count[g] = _oldCount[o];
+                    _z[2*g] = _oldZ[2*o];
+                    _z[2*g + 1] = _oldZ[2*o + 1];
+                }
+            }
+        });
+    }
+
+    _pool->wait();
+}
+
+nativeParams native::params(mandelbrot::rect pos, size_t start, size_t i, size_t step)
+{
+    nativeParams p;
+
+    // Die Samples bilden ein Gitter mit samples-facher Auflösung
+    p.buffer = buffer();
+    p.dx = (pos.br.x - pos.tl.x) / p.buffer.width;
+    p.dy = (pos.br.y - pos.tl.y) / p.buffer.height;
+    p.x0 = pos.tl.x;
+    p.y0 = pos.tl.y;
+    p.start = start;
+    p.iter = i;
+    p.step = step;
+    // Die Toleranz der Periodizität skaliert mit der Grösse eines Samples
+    double tolerance = std::min(fabs(p.dx), fabs(p.dy)) * PERIOD_TOLERANCE;
+    p.period = tolerance * tolerance;
+    // Flache Bilder werden in float gerechnet, das verdoppelt die Anzahl der Lanes
+    p.single = _single && nativeSingle(pos, p.dx, p.dy);
+    p.formula = _formula;
+    p.dd = nullptr;
+    return p;
+}
+
+bool native::computeIterations(mandelbrot::res resolution, mandelbrot::rect pos, size_t samples, size_t start, size_t i, size_t step, mandelbrot::stats& stats,
+                               const std::vector<unsigned>* pixels)
+{
+    nativeParams p = params(pos, start, i, step);
+    return run(p, samples, stats, pixels);
+}
+
+bool native::computeDoubleDouble(const nativeDD& dd, size_t i, size_t step, mandelbrot::stats& stats, size_t samples,
+                                 const std::vector<unsigned>* pixels)
+{
+    nativeParams p;
+
+    // Die gerundeten Werte bestimmen nur noch die Toleranz der Periodizität
+    p.buffer = buffer();
+    p.dx = dd.dx[0];
+    p.dy = dd.dy[0];
+    p.x0 = dd.x0[0];
+    p.y0 = dd.y0[0];
+    p.start = 0;
+    p.iter = i;
+    p.step = step;
+    double tolerance = std::min(fabs(p.dx), fabs(p.dy)) * PERIOD_TOLERANCE;
+    p.period = tolerance * tolerance;
+    p.single = false;
+    p.formula = _formula;
+    p.dd = &dd;
+    return run(p, samples, stats, pixels);
+}
+
+bool native::run(nativeParams& p, size_t samples, mandelbrot::stats& stats, const std::vector<unsigned>* pixels)
+{
+    std::atomic<size_t> bulb(0);
+    std::atomic<size_t> periodic(0);
+    std::atomic<bool> complete(true);
+    size_t step = p.step;
+
+    // Die Liste der Pixel wird in gleich grosse Stücke zerlegt, da sie schon nur Arbeit enthält
+    if(pixels != nullptr)
+    {
+        p.step = 1;
+        for(size_t c = 0; c < pixels->size(); c += NATIVE_PIXEL_CHUNK)
+        {
+            _pool->submit([=, &p, &bulb, &periodic, &complete]() {
+                if(cancelled())
+                {
+                    complete = false;
+                    return;
+                }
+                mandelbrot::stats s = { 0, 0, 0, 0, 0, 0 };
+                _kernelPixels(p, pixels->data() + c, std::min<size_t>(NATIVE_PIXEL_CHUNK, pixels->size() - c), samples, s);
+                bulb += s.bulb;
+                periodic += s.periodic;
+            });
+        }
+    }
+
+    /* Das Bild wird in Kacheln zerlegt. Die Kacheln werden reihum auf die Warteschlangen verteilt,
+     * so dass jeder Thread Kacheln aus allen Teilen des Bildes bekommt. Threads die früher fertig
+     * sind (z.B. weil sie nur Pixel ausserhalb der Menge hatten) stehlen den anderen Arbeit.
+     * Bei step > 1 werden nur die Zeilen und Spalten gerechnet, die durch step teilbar sind.
+     */
+    for(size_t ty = 0; ty < p.buffer.height && pixels == nullptr; ty += NATIVE_TILE_HEIGHT)
+        for(size_t tx = 0; tx < p.buffer.width; tx += NATIVE_TILE_WIDTH)
+        {
+            _pool->submit([=, &p, &bulb, &periodic, &complete]() {
+                if(cancelled())
+                {
+                    complete = false;
+                    return;
+                }
+                mandelbrot::stats s = { 0, 0, 0, 0, 0, 0 };
+                size_t end = std::min<size_t>(tx + NATIVE_TILE_WIDTH, p.buffer.width);
+                size_t x = (tx + step - 1) / step * step;
+                size_t n = x < end ? (end - x + step - 1) / step : 0;
+                size_t h = std::min<size_t>(NATIVE_TILE_HEIGHT, p.buffer.height - ty);
+                for(size_t y = (ty + step - 1) / step * step; y < ty + h && n > 0; y += step)
+                    _kernel(p, x, y, n, s);
+                // Die Zähler werden pro Kachel zusammengezählt
+                bulb += s.bulb;
+                periodic += s.periodic;
+            });
+        }
+
+    _pool->wait();
+    stats.bulb += bulb;
+    stats.periodic += periodic;
+    return complete;
+}
+
+bool native::computePerturbation(const reference& ref, const perturbParams& p, mandelbrot::stats& stats, size_t samples,
+                                 const std::vector<unsigned>* pixels)
+{
+    std::atomic<size_t> bulb(0);
+    std::atomic<size_t> periodic(0);
+    std::atomic<bool> complete(true);
+    nativeBuffer b = buffer();
+    size_t step = p.step;
+
+    // Die Samples eines Pixels liegen in samples Zeilen von je samples Samples
+    if(pixels != nullptr)
+    {
+        size_t width = p.width / samples;
+        for(size_t c = 0; c < pixels->size(); c += NATIVE_PIXEL_CHUNK)
+        {
+            _pool->submit([=, &ref, &bulb, &periodic, &complete]() {
+                if(cancelled())
+                {
+                    complete = false;
+                    return;
+                }
+                mandelbrot::stats s = { 0, 0, 0, 0, 0, 0 };
+                perturbParams q = p;
+                q.step = 1;
+                for(size_t i = c; i < std::min<size_t>(c + NATIVE_PIXEL_CHUNK, pixels->size()); i++)
+                    for(size_t sy = 0; sy < samples; sy++)
+                        perturbSpan(b, ref, q, (*pixels)[i] % width * samples, (*pixels)[i] / width * samples + sy, samples, s);
+                bulb += s.bulb;
+                periodic += s.periodic;
+            });
+        }
+    }
+
+    for(size_t ty = 0; ty < p.height && pixels == nullptr; ty += NATIVE_TILE_HEIGHT)
+        for(size_t tx = 0; tx < p.width; tx += NATIVE_TILE_WIDTH)
+        {
+            _pool->submit([=, &ref, &p, &bulb, &periodic, &complete]() {
+                if(cancelled())
+                {
+                    complete = false;
+                    return;
+                }
+                mandelbrot::stats s = { 0, 0, 0, 0, 0, 0 };
+                size_t end = std::min<size_t>(tx + NATIVE_TILE_WIDTH, p.width);
+                size_t x = (tx + step - 1) / step * step;
+                size_t n = x < end ? (end - x + step - 1) / step : 0;
+                size_t h = std::min<size_t>(NATIVE_TILE_HEIGHT, p.height - ty);
+                for(size_t y = (ty + step - 1) / step * step; y < ty + h && n > 0; y += step)
+                    perturbSpan(b, ref, p, x, y, n, s);
+                bulb += s.bulb;
+                periodic += s.periodic;
+            });
+        }
+
+    _pool->wait();
+    stats.bulb += bulb;
+    stats.periodic += periodic;
+    return complete;
+}
+
+bool native::subdivide(mandelbrot::rect pos, size_t i, size_t step, bool check, mandelbrot::stats& stats)
+{
+    subdivision d;
+    d.p = params(pos, 0, i, step);
+    d.check = check;
+    d.filled = 0;
+    d.bulb = 0;
+    d.periodic = 0;
+    d.complete = true;
+
+    // Nur für zusammenhängende Mengen (wie in mandelbrot::computeImage), sonst wird jedes Sample gerechnet
+    if(_formula.type == mandelbrot::BURNING_SHIP || _formula.julia)
+        return run(d.p, 1, stats, nullptr);
+
+    // Grösse des Gitters jedes step-ten Samples
+    unsigned width = (_width + step - 1) / step;
+    unsigned height = (_height + step - 1) / step;
+
+    /* Zuerst die Zeilen, dann die Spalten des Gitters der Blöcke (ohne die Kreuzungen, so rechnet kein
+     * Sample zweimal). Danach sind alle Ränder der Blöcke gerechnet.
+     */
+    for(unsigned y = 0; y < height && !cancelled(); y++)
+        if(y % SUBDIVIDE_SIZE == 0 || y == height - 1)
+            _pool->submit([=, &d]() {
+                mandelbrot::stats s = { 0, 0, 0, 0, 0, 0 };
+                if(cancelled())
+                {
+                    d.complete = false;
+                    return;
+                }
+                _kernel(d.p, 0, y*d.p.step, width, s);
+                d.bulb += s.bulb;
+                d.periodic += s.periodic;
+            });
+    _pool->wait();
+    for(unsigned x = 0; x < width && !cancelled(); x++)
+        if(x % SUBDIVIDE_SIZE == 0 || x == width - 1)
+            _pool->submit([=, &d]() {
+                mandelbrot::stats s = { 0, 0, 0, 0, 0, 0 };
+                if(cancelled())
+                {
+                    d.complete = false;
+                    return;
+                }
+                std::vector<unsigned> column;
+                for(unsigned y = 1; y < height - 1; y++)
+                    if(y % SUBDIVIDE_SIZE != 0)
+                        column.push_back(y*d.p.step*_width + x*d.p.step);
+                _kernelPixels(d.p, column.data(), column.size(), 1, s);
+                d.bulb += s.bulb;
+                d.periodic += s.periodic;
+            });
+    _pool->wait();
+
+    // Die Blöcke teilen sich ihre Ränder, Aufgaben fügen ihre Hälften selbst hinzu
+    for(unsigned y = 0; y + 1 < height && !cancelled(); y += SUBDIVIDE_SIZE)
+        for(unsigned x = 0; x + 1 < width; x += SUBDIVIDE_SIZE)
+        {
+            nativeRect r = { x, y, std::min(x + SUBDIVIDE_SIZE, width - 1), std::min(y + SUBDIVIDE_SIZE, height - 1) };
+            _pool->submit([=, &d]() { subdivideRect(d, r); });
+        }
+    _pool->wait();
+
+    stats.bulb += d.bulb;
+    stats.periodic += d.periodic;
+    stats.filled += d.filled;
+    return d.complete && !cancelled();
+}
+
+void native::subdivideRect(subdivision& d, nativeRect r)
+{
+    const nativeBuffer& b = d.p.buffer;
+    size_t step = d.p.step;
+    mandelbrot::stats s = { 0, 0, 0, 0, 0, 0 };
+    std::vector<unsigned> list;
+
+    if(cancelled())
+    {
+        d.complete = false;
+        return;
+    }
+
+    /* Kleine Rechtecke werden ganz gerechnet, dort lohnt sich kein weiteres Teilen. Die Samples kommen
+     * in eine Liste, so füllen sie die Lanes über die kurzen Zeilen hinweg.
+     */
+    auto small = [&](const nativeRect& h) {
+        if(h.x1 - h.x0 >= SUBDIVIDE_MIN && h.y1 - h.y0 >= SUBDIVIDE_MIN)
+            return false;
+        for(unsigned y = h.y0 + 1; y < h.y1; y++)
+            for(unsigned x = h.x0 + 1; x < h.x1; x++)
+                list.push_back(y*step*b.width + x*step);
+        return true;
+    };
+    if(small(r))
+    {
+        _kernelPixels(d.p, list.data(), list.size(), 1, s);
+        d.bulb += s.bulb;
+        d.periodic += s.periodic;
+        return;
+    }
+
+    // Der Rand ist gleichförmig, falls alle seine Samples die Klasse der Ecke oben links haben
+    size_t g = r.y0*step*b.width + r.x0*step;
+    long c = nativeClass(b.smooth[g], b.count[g], d.p.iter);
+    for(unsigned x = r.x0; x <= r.x1 && c != SUBDIVIDE_MIXED; x++)
+    {
+        size_t top = r.y0*step*b.width + x*step;
+        size_t bottom = r.y1*step*b.width + x*step;
+        if(nativeClass(b.smooth[top], b.count[top], d.p.iter) != c || nativeClass(b.smooth[bottom], b.count[bottom], d.p.iter) != c)
+            c = SUBDIVIDE_MIXED;
+    }
+    for(unsigned y = r.y0 + 1; y < r.y1 && c != SUBDIVIDE_MIXED; y++)
+    {
+        size_t left = y*step*b.width + r.x0*step;
+        size_t right = y*step*b.width + r.x1*step;
+        if(nativeClass(b.smooth[left], b.count[left], d.p.iter) != c || nativeClass(b.smooth[right], b.count[right], d.p.iter) != c)
+            c = SUBDIVIDE_MIXED;
+    }
+
+    // Die Kontrolle rechnet einige Samples im Inneren, weicht eines ab wird doch geteilt
+    if(d.check && c != SUBDIVIDE_MIXED)
+    {
+        for(unsigned k = 0; k < SUBDIVIDE_PROBES; k++)
+        {
+            unsigned x, y;
+            nativeProbe(r, k, x, y);
+            list.push_back(y*step*b.width + x*step);
+        }
+        _kernelPixels(d.p, list.data(), list.size(), 1, s);
+        for(unsigned probe : list)
+            if(nativeClass(b.smooth[probe], b.count[probe], d.p.iter) != c)
+                c = SUBDIVIDE_MIXED;
+        list.clear();
+    }
+
+    if(c != SUBDIVIDE_MIXED)
+    {
+        // Gefüllt werden nur noch nicht gerechnete Samples, ein Band zeilenweise zwischen linkem und rechtem Rand
+        size_t filled = 0;
+        for(unsigned y = r.y0 + 1; y < r.y1; y++)
+        {
+            size_t row = y*step*b.width;
+            float left = b.smooth[row + r.x0*step];
+            float right = b.smooth[row + r.x1*step];
+            for(unsigned x = r.x0 + 1; x < r.x1; x++)
+            {
+                size_t f = row + x*step;
+                if(b.smooth[f] != SMOOTH_PENDING)
+                    continue;
+                b.smooth[f] = c < 0 ? SMOOTH_INTERIOR : left + (right - left) * (x - r.x0) / (r.x1 - r.x0);
+                b.count[f] = c < 0 ? 0 : c;
+                filled++;
+            }
+        }
+        d.filled += filled;
+    }
+    else
+    {
+        /* Geteilt wird entlang der längeren Seite, die Linie wird vor den Hälften gerechnet. Kleine
+         * Hälften werden gleich mit ihr gerechnet, nur die übrigen werden neue Aufgaben.
+         */
+        nativeRect half[2] = { r, r };
+        if(r.x1 - r.x0 >= r.y1 - r.y0)
+        {
+            unsigned m = (r.x0 + r.x1) / 2;
+            for(unsigned y = r.y0 + 1; y < r.y1; y++)
+                list.push_back(y*step*b.width + m*step);
+            half[0].x1 = m;
+            half[1].x0 = m;
+        }
+        else
+        {
+            unsigned m = (r.y0 + r.y1) / 2;
+            for(unsigned x = r.x0 + 1; x < r.x1; x++)
+                list.push_back(m*step*b.width + x*step);
+            half[0].y1 = m;
+            half[1].y0 = m;
+        }
+        bool done[2] = { small(half[0]), small(half[1]) };
+        _kernelPixels(d.p, list.data(), list.size(), 1, s);
+        for(int h = 0; h < 2; h++)
+            if(!done[h])
+            {
+                nativeRect child = half[h];
+                _pool->submit([=, &d]() { subdivideRect(d, child); });
+            }
+    }
+
+    d.bulb += s.bulb;
+    d.periodic += s.periodic;
+}
+
+void native::findEdges(mandelbrot::res resolution, size_t samples, size_t i, std::vector<unsigned>& pixels)
+{
+    size_t strips = (resolution.y + NATIVE_TILE_HEIGHT - 1) / NATIVE_TILE_HEIGHT;
+    std::vector<std::vector<unsigned>> found(strips);
+
+    // Jeder Streifen sammelt seine Pixel einzeln, so bleibt die Liste aufsteigend
+    for(size_t t = 0; t < strips; t++)
+    {
+        _pool->submit([=, &found]() {
+            size_t ty = t * NATIVE_TILE_HEIGHT;
+            size_t h = std::min<size_t>(NATIVE_TILE_HEIGHT, resolution.y - ty);
+            for(size_t y = ty; y < ty + h; y++)
+                for(size_t x = 0; x < resolution.x; x++)
+                {
+                    // Verglichen wird das erste Sample jedes Pixels mit dem der vier Nachbarn
+                    size_t g = y*samples*_width + x*samples;
+                    size_t neighbours[4] = { g - samples, g + samples, g - samples*_width, g + samples*_width };
+                    bool valid[4] = { x > 0, x + 1 < resolution.x, y > 0, y + 1 < resolution.y };
+                    for(int n = 0; n < 4; n++)
+                        if(valid[n] && nativeEdge(_smooth[g], _count[g], _smooth[neighbours[n]], _count[neighbours[n]], i))
+                        {
+                            found[t].push_back(y*resolution.x + x);
+                            break;
+                        }
+                }
+        });
+    }
+
+    _pool->wait();
+    pixels.clear();
+    for(const std::vector<unsigned>& f : found)
+        pixels.insert(pixels.end(), f.begin(), f.end());
+}
+
+void native::colorImage(mandelbrot::color* ret, mandelbrot::res resolution, size_t samples, size_t i, size_t step)
+{
+    size_t width = resolution.x * samples;
+
+    // Das Färben ist billig, es wird nur in Streifen aufgeteilt
+    for(size_t ty = 0; ty < resolution.y; ty += NATIVE_TILE_HEIGHT)
+    {
+        _pool->submit([=]() {
+            size_t h = std::min<size_t>(NATIVE_TILE_HEIGHT, resolution.y - ty);
+            for(size_t y = ty; y < ty + h; y++)
+            {
+                for(size_t x = 0; x < resolution.x; x++)
+                {
+                    float acc[3] = { 0, 0, 0 };
+                    size_t n = 0;
+
+                    // Durchschnitt der gerechneten Samples des Pixels
+                    for(size_t sy = 0; sy < samples; sy++)
+                        for(size_t sx = 0; sx < samples; sx++)
+                        {
+                            size_t g = (y*samples + sy)*width + x*samples + sx;
+                            if(_smooth[g] == SMOOTH_PENDING)
+                                continue;
+                            n++;
+                            if(_smooth[g] >= 0 && _count[g] < i)
+                                nativeColor(acc, _smooth[g], 1);
+                        }
+
+                    // Ohne gerechnetes Sample wird das vorherige auf dem Gitter übernommen
+                    if(n == 0)
+                    {
+                        size_t g = nativeLattice(y, samples, step)*width + nativeLattice(x, samples, step);
+                        n = 1;
+                        if(_smooth[g] >= 0 && _count[g] < i)
+                            nativeColor(acc, _smooth[g], 1);
+                    }
+
+                    mandelbrot::color& c = ret[y*resolution.x + x];
+                    c.r = nativeByte(acc[0] / n);
+                    c.g = nativeByte(acc[1] / n);
+                    c.b = nativeByte(acc[2] / n);
+                    c.pad = 0;
+                }
+            }
+        });
+    }
+
+    _pool->wait();
+}
+
+mandelbrot::work native::work(size_t i) const
+{
+    mandelbrot::work w = { 0, 0, 0, 0 };
+
+    for(size_t s = 0; s < _width * _height; s++)
+        nativeWork(w, _smooth[s], _count[s], i);
+    return w;
+}
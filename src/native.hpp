@@ -0,0 +1,446 @@
+/*  native.hpp
+ * Name Native-Modul
+ * Modul zum berechnen der Mandelbrot-Menge auf allen CPU-Kernen mithilfe von SIMD-Befehlen
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#ifndef NATIVE_HPP
+#define NATIVE_HPP
+
+#include "mandelbrot.hpp"
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+
+class pool;
+class reference;
+struct perturbParams;
+
+// Größe der Kacheln in die ein Bild zerlegt wird
+#define NATIVE_TILE_WIDTH 64
+#define NATIVE_TILE_HEIGHT 16
+
+/* Werte im Iterations-Buffer für Samples die (noch) nicht entkommen sind, entkommene Samples haben
+ * einen geglätteten Iterationswert >= 0 (muss mit mandelbrot.cl übereinstimmen)
+ */
+#define SMOOTH_ACTIVE -1.0f     // Kann mit mehr Iterationen fortgesetzt werden
+#define SMOOTH_INTERIOR -2.0f   // Liegt sicher in der Menge (Hauptkardioide oder periodisch)
+#define SMOOTH_PENDING -3.0f    // Muss noch gerechnet werden
+
+/* Unterschied der geglätteten Iterationswerte zweier benachbarter Pixel, ab dem beim adaptiven
+ * Supersampling alle Samples der Pixel gerechnet werden (muss mit mandelbrot.cl übereinstimmen)
+ */
+#define ADAPTIVE_THRESHOLD 1.0f
+
+// Anzahl Pixel pro Aufgabe beim Rechnen einer Liste von Pixeln
+#define NATIVE_PIXEL_CHUNK 64
+
+// Maximaler Abstand (in Samples) eines alten Samples vom neuen Gitter, damit es übernommen wird
+#define REPROJECT_TOLERANCE 1e-3
+
+// Abstand zweier Samples relativ zum Betrag der Punkte, ab dem in float gerechnet wird (siehe nativeSingle)
+#define SINGLE_MIN_SPACING (1.0 / 4096)
+
+/* Abstand (im Wert der Tests von nativeBulb) zum Rand der Hauptkardioide bei double-double, der Test
+ * selbst ist nur in double (muss mit mandelbrot.cl übereinstimmen)
+ */
+#define DD_BULB_MARGIN 1e-12
+
+// Position und Abstand der Samples in double-double ([0] + [1], etwa 106 Bit, siehe native::computeDoubleDouble)
+struct nativeDD
+{
+    double x0[2];   // Position des ersten Samples (x)
+    double y0[2];   // Position des ersten Samples (y)
+    double dx[2];   // Abstand zwischen zwei Samples (x)
+    double dy[2];   // Abstand zwischen zwei Samples (y)
+};
+
+// Abbildung des neuen Gitters der Samples auf das alte: alt = scale * neu + offset
+struct nativeMap
+{
+    double sx;      // scale (x)
+    double sy;      // scale (y)
+    double ox;      // offset (x)
+    double oy;      // offset (y)
+};
+
+/* Gibt den Index des alten Samples zurück, das genau auf dem neuen Sample x liegt, oder -1
+ * @param x Der Index des neuen Samples
+ * @param n Die Anzahl der alten Samples
+ * @param scale Das Verhältnis der Abstände der Samples (neu / alt)
+ * @param offset Die Position des ersten neuen Samples im alten Gitter
+ */
+static inline long nativeMapAxis(size_t x, size_t n, double scale, double offset)
+{
+    double f = scale * x + offset;
+    double r = round(f);
+
+    if(fabs(f - r) >= REPROJECT_TOLERANCE || r < 0 || r >= n)
+        return -1;
+    return (long)r;
+}
+
+/* Gibt das letzte Sample auf dem Gitter jedes step-ten Samples zurück, das nicht hinter dem Pixel
+ * liegt. Damit werden Pixel ohne eigenes gerechnetes Sample gefärbt (grobe Vorschau).
+ * @param x Der Index des Pixels
+ * @param samples Die Anzahl Samples pro Pixel
+ * @param step Der Abstand der gerechneten Samples
+ */
+static inline size_t nativeLattice(size_t x, size_t samples, size_t step)
+{
+    return x*samples / step * step;
+}
+
+/* Gibt true zurück falls die Samples weit genug auseinander liegen um in float zu rechnen. Der
+ * Abstand muss mindestens SINGLE_MIN_SPACING mal dem grössten Betrag der Punkte und von z (2) sein,
+ * so bleiben die Rundungsfehler von float weit unter dem Abstand zweier Samples.
+ * @param pos Die Fläche
+ * @param dx Abstand zwischen zwei Samples (x)
+ * @param dy Abstand zwischen zwei Samples (y)
+ */
+static inline bool nativeSingle(const mandelbrot::rect& pos, double dx, double dy)
+{
+    double size = fmax(fmax(2, fmax(fabs(pos.tl.x), fabs(pos.br.x))), fmax(fabs(pos.tl.y), fabs(pos.br.y)));
+
+    return fmin(fabs(dx), fabs(dy)) >= size * SINGLE_MIN_SPACING;
+}
+
+/* Unterteilen (Mariani-Silver, siehe native::subdivide): Die Blöcke beginnen mit SUBDIVIDE_SIZE
+ * gerechneten Samples Kantenlänge, Rechtecke mit einer kürzeren Seite als SUBDIVIDE_MIN werden ganz
+ * gerechnet. Mit Kontrolle werden SUBDIVIDE_PROBES Samples im Inneren geprüft (siehe nativeProbe).
+ * SUBDIVIDE_MIN, SUBDIVIDE_PROBES und SUBDIVIDE_MIXED müssen mit mandelbrot.cl übereinstimmen.
+ */
+#define SUBDIVIDE_SIZE 64
+#define SUBDIVIDE_MIN 6
+#define SUBDIVIDE_PROBES 5
+// Klasse eines Samples das nicht gefüllt werden kann (siehe nativeClass)
+#define SUBDIVIDE_MIXED -2
+
+// Rechteck im Gitter jedes step-ten Samples, der Rand (x0, y0, x1, y1) gehört dazu (wie uint4 in mandelbrot.cl)
+struct nativeRect
+{
+    unsigned x0;
+    unsigned y0;
+    unsigned x1;
+    unsigned y1;
+};
+
+/* Gibt die Klasse eines Samples beim Unterteilen zurück (wie classOf in mandelbrot.cl): -1 für innen,
+ * die Iteration des Entkommens für vor i entkommene Samples, sonst SUBDIVIDE_MIXED. Nicht entkommene
+ * Samples ohne SMOOTH_INTERIOR können fortgesetzt werden und brauchen ihr eigenes z.
+ */
+static inline long nativeClass(float smooth, unsigned count, unsigned i)
+{
+    if(smooth == SMOOTH_INTERIOR)
+        return -1;
+    if(smooth >= 0 && count < i)
+        return count;
+    return SUBDIVIDE_MIXED;
+}
+
+/* Gibt die Position der Probe k (< SUBDIVIDE_PROBES) eines Rechtecks zurück: die Mitte und die vier
+ * Punkte auf halbem Weg zu den Ecken (wie probeOf in mandelbrot.cl). Bei Seiten ab SUBDIVIDE_MIN
+ * liegen sie im Inneren.
+ */
+static inline void nativeProbe(const nativeRect& r, unsigned k, unsigned& x, unsigned& y)
+{
+    static const unsigned a[SUBDIVIDE_PROBES] = { 2, 1, 3, 1, 3 };
+    static const unsigned b[SUBDIVIDE_PROBES] = { 2, 1, 1, 3, 3 };
+    x = r.x0 + (r.x1 - r.x0) * a[k] / 4;
+    y = r.y0 + (r.y1 - r.y0) * b[k] / 4;
+}
+
+/* Iterations-Buffer: Ein Eintrag pro Sample, die Samples bilden ein Gitter mit samples-facher
+ * Auflösung des Bildes. Die Färbung wird erst aus diesem Buffer berechnet.
+ */
+struct nativeBuffer
+{
+    size_t width;       // Breite in Samples
+    size_t height;      // Höhe in Samples
+    float* smooth;      // Geglätteter Iterationswert oder SMOOTH_ACTIVE / SMOOTH_INTERIOR
+    unsigned* count;    // Iteration des Entkommens, bzw. Anzahl gerechneter Iterationen
+    double* z;          // z der Samples mit SMOOTH_ACTIVE (abwechselnd x und y)
+};
+
+// Parameter einer Berechnung, wie sie an die SIMD-Kernel übergeben werden
+struct nativeParams
+{
+    double dx;          // Abstand zwischen zwei Samples (x)
+    double dy;          // Abstand zwischen zwei Samples (y)
+    double x0;          // Position des ersten Samples (x)
+    double y0;          // Position des ersten Samples (y)
+    unsigned start;     // Bereits gerechnete Iterationen (0 für eine neue Berechnung)
+    unsigned iter;      // Maximale Anzahl an Iterationen
+    unsigned step;      // Nur jedes step-te Sample (in x und y) wird gerechnet
+    double period;      // Quadrat des Abstandes unter dem ein Orbit als periodisch gilt
+    bool single;        // In float rechnen (siehe nativeSingle)
+    mandelbrot::formula formula;    // Die Formel (double-double nur mit MANDELBROT)
+    const nativeDD* dd; // Falls gesetzt, in double-double mit diesen Positionen rechnen (x0, y0, dx, dy sind dann nur gerundet)
+    nativeBuffer buffer;// Der Iterations-Buffer
+};
+
+/* Gibt den geglätteten Iterationswert eines entkommenen Samples zurück (wie smoothOf in mandelbrot.cl).
+ * Die Funktion ist static, damit jede Übersetzungseinheit ihre eigene Kopie mit ihren Flags bekommt.
+ * @param i Die Anzahl der Iterationen bis zum Entkommen
+ * @param r2 Das Betragsquadrat von z nach den zusätzlichen Iterationen (siehe FORMULA_TAIL)
+ */
+static inline float nativeSmooth(unsigned i, double r2)
+{
+    return i + 1 - (.69314718055994530941723212145817656807550013436026f / sqrtf((float)r2) / .69314718055994530941723212145817656807550013436026f);
+}
+
+/* Addiert die Farbe eines entkommenen Samples zu acc (gleiche Färbung wie colorOf in mandelbrot.cl)
+ * @param acc Die Summe der Farben (r, g, b)
+ * @param smooth Der geglättete Iterationswert
+ * @param weight Das Gewicht des Samples (1 / samples²)
+ */
+static inline void nativeColor(float acc[3], float smooth, float weight)
+{
+    acc[0] += (sinf(0.01f * smooth + 1) * 230 + 25) * weight;
+    acc[1] += (sinf(0.013f * smooth + 2) * 230 + 25) * weight;
+    acc[2] += (sinf(0.016f * smooth + 4) * 230 + 25) * weight;
+}
+
+/* Gibt true zurück falls c in der Hauptkardioide oder im Kreis der Periode 2 liegt. Solche Punkte
+ * entkommen nie und müssen nicht iteriert werden.
+ * @param x Realteil von c
+ * @param y Imaginärteil von c
+ * @param margin Abstand (im Wert der Tests) der zum Rand eingehalten werden muss
+ */
+static inline bool nativeBulb(double x, double y, double margin)
+{
+    double qx = x - 0.25;
+    double q = qx*qx + y*y;
+    return q*(q + qx) - 0.25*y*y < -margin || (x + 1)*(x + 1) + y*y - 0.0625 < -margin;
+}
+
+/* Gibt true zurück falls sich zwei Samples sichtbar unterscheiden (wie edge in mandelbrot.cl): Nur
+ * eines ist vor i Iterationen entkommen, oder beide, aber mit mehr als ADAPTIVE_THRESHOLD Unterschied
+ */
+static inline bool nativeEdge(float a, unsigned countA, float b, unsigned countB, unsigned i)
+{
+    bool escapedA = a >= 0 && countA < i;
+    bool escapedB = b >= 0 && countB < i;
+
+    return escapedA != escapedB || (escapedA && fabsf(a - b) > ADAPTIVE_THRESHOLD);
+}
+
+/* Zählt ein Sample zur Arbeit w. Es hat ohne Abkürzungen bis zum Entkommen iteriert, sonst i mal (auch
+ * Samples die als innen erkannt wurden). Noch nicht gerechnete Samples zählen nicht.
+ */
+static inline void nativeWork(mandelbrot::work& w, float smooth, unsigned count, unsigned i)
+{
+    if(smooth == SMOOTH_PENDING)
+        return;
+    bool escaped = smooth >= 0 && count < i;
+    w.iterations += escaped ? count : i;
+    w.samples++;
+    w.escaped += escaped;
+    w.interior += !escaped;
+}
+
+// Wandelt eine Farbkomponente in ein Byte um
+static inline unsigned char nativeByte(float v)
+{
+    return v <= 0 ? 0 : (v >= 255 ? 255 : (unsigned char)v);
+}
+
+/* Deklariert die Kernel für einen Befehlssatz. Jeder Kernel wird aus native_kernel.cpp mit
+ * eigenen Compiler-Flags übersetzt (siehe makefile).
+ * computeSpan iteriert n Samples ab (x, y) im Abstand p.step und speichert sie in p.buffer. Ist p.start 0, werden
+ * nur Samples mit SMOOTH_PENDING gerechnet, sonst nur solche mit SMOOTH_ACTIVE. Vorzeitig beendete
+ * Samples werden zu s.bulb und s.periodic addiert.
+ * computePixels rechnet ebenso die samples² Samples jedes der n Pixel in pixels (Index y*Breite + x).
+ * Mit p.dd rechnen beide in double-double (nur mit p.start 0).
+ */
+#define NATIVE_KERNEL(isa) \
+    namespace isa { \
+        void computeSpan(const nativeParams& p, size_t x, size_t y, size_t n, mandelbrot::stats& s); \
+        void computePixels(const nativeParams& p, const unsigned* pixels, size_t n, size_t samples, mandelbrot::stats& s); \
+    }
+
+NATIVE_KERNEL(sse2)
+NATIVE_KERNEL(avx2)
+NATIVE_KERNEL(avx512)
+
+class native
+{
+public:
+    // Typ der Kernel-Funktion
+    typedef void (*kernel)(const nativeParams&, size_t, size_t, size_t, mandelbrot::stats&);
+    typedef void (*pixelKernel)(const nativeParams&, const unsigned*, size_t, size_t, mandelbrot::stats&);
+
+private:
+    kernel _kernel;                 // Der zur Laufzeit gewählte Kernel
+    pixelKernel _kernelPixels;      // Der Kernel für Listen von Pixeln
+    const char* _isa;               // Name des gewählten Befehlssatzes
+    size_t _threads;                // Anzahl der benutzten Threads
+    pool* _pool;                    // Threadpool der die Kacheln abarbeitet
+    std::vector<float> _smooth;     // Iterations-Buffer (siehe nativeBuffer)
+    std::vector<unsigned> _count;
+    std::vector<double> _z;
+    std::vector<float> _oldSmooth;  // Iterations-Buffer des letzten Bildes, für reproject()
+    std::vector<unsigned> _oldCount;
+    std::vector<double> _oldZ;
+    size_t _width;                  // Grösse des Iterations-Buffers in Samples
+    size_t _height;
+    bool _single;                   // float erlaubt (siehe setSingle)
+    mandelbrot::formula _formula;   // Die Formel (siehe setFormula)
+    const std::atomic<bool>* _cancel;   // Abbruch der laufenden Berechnung falls true (oder nullptr)
+
+    // Gemeinsame Daten der Aufgaben beim Unterteilen (siehe subdivide)
+    struct subdivision
+    {
+        nativeParams p;                 // Die Parameter
+        bool check;                     // Gleichförmige Rechtecke werden mit Proben kontrolliert
+        std::atomic<size_t> filled;     // Gefüllte Samples
+        std::atomic<size_t> bulb;       // Zähler der vorzeitig beendeten Samples
+        std::atomic<size_t> periodic;
+        std::atomic<bool> complete;     // false falls abgebrochen wurde
+    };
+
+    // Gibt den Iterations-Buffer zurück
+    nativeBuffer buffer();
+
+    /* Gibt die Parameter einer Berechnung zurück
+     * @param pos Die Fläche
+     * @param start Bereits gerechnete Iterationen
+     * @param i Die maximale Anzahl an Iterationen
+     * @param step Nur jedes step-te Sample (in x und y) wird gerechnet
+     */
+    nativeParams params(mandelbrot::rect pos, size_t start, size_t i, size_t step);
+
+    /* Rechnet jedes p.step-te Sample in Kacheln oder alle Samples der Pixel in pixels (siehe computeIterations)
+     * @param p Die Parameter
+     * @param samples Die Anzahl Samples pro Pixel (nur mit pixels)
+     * @param stats Die Zähler der vorzeitig beendeten Samples werden hier addiert
+     * @param pixels Die Pixel oder nullptr
+     * @return false falls die Berechnung abgebrochen wurde
+     */
+    bool run(nativeParams& p, size_t samples, mandelbrot::stats& stats, const std::vector<unsigned>* pixels);
+
+    /* Eine Aufgabe beim Unterteilen: Ist der (schon gerechnete) Rand des Rechtecks gleichförmig, wird
+     * das Innere gefüllt, sonst wird entlang der längeren Seite geteilt und jede Hälfte ist eine neue Aufgabe
+     * @param d Die gemeinsamen Daten
+     * @param r Das Rechteck
+     */
+    void subdivideRect(subdivision& d, nativeRect r);
+
+    // Gibt true zurück falls die laufende Berechnung abgebrochen werden soll
+    bool cancelled() const { return _cancel != nullptr && *_cancel; }
+
+public:
+    // Der Konstruktor wählt den besten vom Prozessor unterstützten Kernel und startet die Threads
+    native();
+    // Der Destructor beendet die Threads
+    ~native();
+
+    // Gibt den Namen des gewählten Befehlssatzes zurück
+    const char* isa() const { return _isa; }
+    // Gibt die Anzahl der benutzten Threads zurück
+    size_t threads() const { return _threads; }
+
+    /* Setzt das Flag mit dem laufende Berechnungen abgebrochen werden. Es wird vor jeder Kachel gelesen.
+     * @param flag Das Flag (nullptr falls nie abgebrochen wird)
+     */
+    void setCancel(const std::atomic<bool>* flag) { _cancel = flag; }
+
+    /* Erlaubt float für Bilder deren Samples weit genug auseinander liegen (siehe nativeSingle)
+     * @param allow false um immer in double zu rechnen
+     */
+    void setSingle(bool allow) { _single = allow; }
+
+    // Wählt die Formel (siehe mandelbrot::setFormula)
+    void setFormula(const mandelbrot::formula& f) { _formula = f; }
+
+    /* Erstellt einen neuen Iterations-Buffer. Samples des alten Buffers die genau auf dem neuen
+     * Gitter liegen werden übernommen, alle anderen mit SMOOTH_PENDING markiert.
+     * @param res Die Auflösung des Bildes
+     * @param samples Die Anzahl Samples pro Pixel
+     * @param map Die Abbildung auf das alte Gitter (nullptr falls nichts übernommen wird)
+     */
+    void reproject(mandelbrot::res res, size_t samples, const nativeMap* map);
+
+    /* Berechnet die Iterationen der Samples im Iterations-Buffer (siehe reproject())
+     * @param res Die Auflösung des Bildes
+     * @param pos Die Fläche die berechnet werden soll
+     * @param samples Die Anzahl Samples pro Pixel
+     * @param start Bereits gerechnete Iterationen, nicht entkommene Samples werden fortgesetzt
+     *              (0 um die Samples mit SMOOTH_PENDING zu rechnen)
+     * @param i Die maximale Anzahl an Iterationen
+     * @param step Nur jedes step-te Sample (in x und y) wird gerechnet
+     * @param stats Die Zähler der vorzeitig beendeten Samples werden hier addiert
+     * @param pixels Falls gesetzt, werden statt jedem step-ten Sample alle Samples dieser Pixel gerechnet
+     * @return false falls die Berechnung abgebrochen wurde
+     */
+    bool computeIterations(mandelbrot::res res, mandelbrot::rect pos, size_t samples, size_t start, size_t i, size_t step, mandelbrot::stats& stats,
+                           const std::vector<unsigned>* pixels = nullptr);
+
+    /* Berechnet die Samples mit SMOOTH_PENDING in double-double, für Zooms zu tief für double aber zu flach
+     * für die Störungsrechnung. Nicht entkommene Samples werden nicht fortgesetzt.
+     * @param dd Die Position und der Abstand der Samples
+     * @param i Die maximale Anzahl an Iterationen
+     * @param step Nur jedes step-te Sample (in x und y) wird gerechnet
+     * @param stats Die Zähler der vorzeitig beendeten Samples werden hier addiert
+     * @param samples Die Anzahl Samples pro Pixel (nur mit pixels)
+     * @param pixels Falls gesetzt, werden statt jedem step-ten Sample alle Samples dieser Pixel gerechnet
+     * @return false falls die Berechnung abgebrochen wurde
+     */
+    bool computeDoubleDouble(const nativeDD& dd, size_t i, size_t step, mandelbrot::stats& stats, size_t samples = 1,
+                             const std::vector<unsigned>* pixels = nullptr);
+
+    /* Berechnet die Samples mit SMOOTH_PENDING auf dem Gitter jedes step-ten Samples durch Unterteilen
+     * (Mariani-Silver): Zuerst werden die Ränder von Blöcken mit SUBDIVIDE_SIZE Samples gerechnet. Haben
+     * alle Samples des Randes die selbe Klasse (siehe nativeClass), wird das Innere gefüllt: innen mit
+     * SMOOTH_INTERIOR, ein Band mit der selben Iteration mit zwischen linkem und rechtem Rand
+     * interpoliertem Wert. Sonst wird das Rechteck geteilt. Die Rechtecke sind Aufgaben im Threadpool.
+     * Beim Burning Ship und bei Julia-Mengen (nicht zusammenhängend) wird jedes Sample gerechnet.
+     * @param pos Die Fläche die berechnet werden soll
+     * @param i Die maximale Anzahl an Iterationen
+     * @param step Nur jedes step-te Sample (in x und y) wird gerechnet
+     * @param check true um vor dem Füllen SUBDIVIDE_PROBES Samples im Inneren zu rechnen (siehe nativeProbe),
+     *              weicht eines ab wird geteilt
+     * @param stats Die Zähler der vorzeitig beendeten und der gefüllten Samples werden hier addiert
+     * @return false falls die Berechnung abgebrochen wurde
+     */
+    bool subdivide(mandelbrot::rect pos, size_t i, size_t step, bool check, mandelbrot::stats& stats);
+
+    /* Berechnet die Samples mit SMOOTH_PENDING mithilfe der Störungsrechnung (siehe perturbation.hpp)
+     * @param ref Der Referenz-Orbit in der Mitte des Bildes
+     * @param p Die Parameter
+     * @param stats Die Zähler der vorzeitig beendeten Samples werden hier addiert
+     * @param samples Die Anzahl Samples pro Pixel (nur mit pixels)
+     * @param pixels Falls gesetzt, werden statt jedem p.step-ten Sample alle Samples dieser Pixel gerechnet
+     * @return false falls die Berechnung abgebrochen wurde
+     */
+    bool computePerturbation(const reference& ref, const perturbParams& p, mandelbrot::stats& stats, size_t samples = 1,
+                             const std::vector<unsigned>* pixels = nullptr);
+
+    /* Sucht die Pixel, deren erstes Sample sich sichtbar von dem eines Nachbarn unterscheidet (siehe
+     * nativeEdge). Nur bei diesen lohnen sich beim adaptiven Supersampling weitere Samples.
+     * @param res Die Auflösung des Bildes
+     * @param samples Die Anzahl Samples pro Pixel
+     * @param i Die maximale Anzahl an Iterationen
+     * @param pixels Gibt die Pixel zurück (Index y*res.x + x, aufsteigend)
+     */
+    void findEdges(mandelbrot::res res, size_t samples, size_t i, std::vector<unsigned>& pixels);
+
+    /* Färbt das Bild aus dem Iterations-Buffer, ohne neu zu iterieren
+     * @param ret Ein Zeiger zum Buffer im RAM
+     * @param res Die Auflösung des Bildes
+     * @param samples Die Anzahl Samples pro Pixel
+     * @param i Die maximale Anzahl an Iterationen, später entkommene Samples sind schwarz
+     * @param step Jedes step-te Sample ist sicher gerechnet. Jedes Pixel ist der Durchschnitt seiner
+     *             gerechneten Samples, Pixel ohne eines übernehmen das vorherige (siehe nativeLattice).
+     */
+    void colorImage(mandelbrot::color* ret, mandelbrot::res res, size_t samples, size_t i, size_t step);
+
+    /* Zählt die Arbeit aller Samples im Iterations-Buffer (siehe nativeWork)
+     * @param i Die maximale Anzahl an Iterationen
+     */
+    mandelbrot::work work(size_t i) const;
+};
+
+#endif
@@ -0,0 +1,652 @@
+/*  native_kernel.cpp
+ * Name Native-Kernel
+ * SIMD-Version von computeIterations (kernel/mandelbrot.cl). Die Datei wird für jeden Befehlssatz
+ * mit eigenen Flags übersetzt: LANES gibt die Anzahl der doubles pro Vektor an, NATIVE_ISA
+ * den Namen des Namespaces (sse2, avx2, avx512). Mit p.single wird in float gerechnet, dann
+ * passen doppelt so viele Samples in einen Vektor. Mit p.dd wird in double-double gerechnet.
+ * Jede Formel (p.formula) bekommt über ein Template eigene Schleifen ohne Verzweigung.
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#include "native.hpp"
+#include <math.h>
+#include <immintrin.h>
+
+#ifndef LANES
+#error "LANES muss definiert sein"
+#endif
+
+// Hier dürfen nur Funktionen stehen die nicht mit anderen Übersetzungseinheiten geteilt werden,
+// da sie mit Befehlen übersetzt werden, die nicht jeder Prozessor unterstützt.
+namespace
+{
+    // Vektoren und Masken mit der Grösse von LANES doubles, für real = double oder float
+    template<typename real>
+    struct simd;
+
+    template<>
+    struct simd<double>
+    {
+        typedef double vreal __attribute__((vector_size(LANES*sizeof(double))));
+        typedef long long vmask __attribute__((vector_size(LANES*sizeof(double))));
+        typedef long long mask;
+    };
+
+    template<>
+    struct simd<float>
+    {
+        typedef float vreal __attribute__((vector_size(LANES*sizeof(double))));
+        typedef int vmask __attribute__((vector_size(LANES*sizeof(double))));
+        typedef int mask;
+    };
+
+    // Gibt true zurück falls mindestens eine Lane aktiv ist
+    template<typename vmask>
+    inline bool any(vmask m)
+    {
+        const int width = sizeof(vmask) / sizeof(m[0]);
+        long long r = 0;
+        for(int l = 0; l < width; l++)
+            r |= m[l];
+        return r != 0;
+    }
+
+    /* Die Formeln (siehe mandelbrot::fractal): next gibt das nächste z zurück, zx2 und zy2 sind z² (komponentenweise).
+     * tail ist die Anzahl der Iterationen für die Färbung nach dem Entkommen (wie FORMULA_TAIL in mandelbrot.cl).
+     */
+    struct quadratic
+    {
+        static const int tail = 4;
+
+        template<typename real, typename vreal>
+        static inline void next(vreal zx, vreal zy, vreal zx2, vreal zy2, vreal cx, vreal cy, vreal& tx, vreal& ty)
+        {
+            ty = (real)2*zx*zy + cy;
+            tx = zx2 - zy2 + cx;
+        }
+    };
+
+    struct ship
+    {
+        static const int tail = 4;
+
+        template<typename real, typename vreal>
+        static inline void next(vreal zx, vreal zy, vreal zx2, vreal zy2, vreal cx, vreal cy, vreal& tx, vreal& ty)
+        {
+            vreal xy = zx*zy;
+            ty = (real)2*(xy < 0 ? -xy : xy) + cy;
+            tx = zx2 - zy2 + cx;
+        }
+    };
+
+    // z^n + c, die Schleife wird für jedes n ausgerollt. Nach einer Iteration ist z schon so gross, dass mehr überlaufen würden.
+    template<int n>
+    struct power
+    {
+        static const int tail = 1;
+
+        template<typename real, typename vreal>
+        static inline void next(vreal zx, vreal zy, vreal zx2, vreal zy2, vreal cx, vreal cy, vreal& tx, vreal& ty)
+        {
+            vreal wx = zx;
+            vreal wy = zy;
+            for(int k = 1; k < n; k++)
+            {
+                vreal t = wx*zx - wy*zy;
+                wy = wx*zy + wy*zx;
+                wx = t;
+            }
+            tx = wx + cx;
+            ty = wy + cy;
+        }
+    };
+
+    /* Ruft c mit einem Objekt der Formel f auf (quadratic, ship oder power<n>), so wird der Code
+     * für jede Formel eigens übersetzt
+     */
+    template<typename call>
+    inline void withFormula(const mandelbrot::formula& f, call c)
+    {
+        if(f.type == mandelbrot::BURNING_SHIP)
+            c(ship());
+        else if(f.type == mandelbrot::MULTIBROT && f.power == 3)
+            c(power<3>());
+        else if(f.type == mandelbrot::MULTIBROT && f.power == 4)
+            c(power<4>());
+        else if(f.type == mandelbrot::MULTIBROT && f.power == 5)
+            c(power<5>());
+        else if(f.type == mandelbrot::MULTIBROT && f.power == 6)
+            c(power<6>());
+        else if(f.type == mandelbrot::MULTIBROT && f.power == 7)
+            c(power<7>());
+        else if(f.type == mandelbrot::MULTIBROT && f.power == 8)
+            c(power<8>());
+        else
+            c(quadratic());
+    }
+
+    template<typename real, typename F>
+    inline void finish(const nativeParams& p, const size_t* idx, int lanes, typename simd<real>::vreal zx, typename simd<real>::vreal zy,
+                       typename simd<real>::vreal cx, typename simd<real>::vreal cy, typename simd<real>::vmask n,
+                       typename simd<real>::vmask bulb, typename simd<real>::vmask periodic, mandelbrot::stats& s);
+
+    /* Iteriert die Samples aller Lanes gleichzeitig mit der Formel F und speichert sie im Iterations-Buffer
+     * @param p Die Parameter
+     * @param idx Index der Samples der Lanes im Iterations-Buffer
+     * @param lanes Anzahl der gültigen Lanes
+     * @param cx Realteil der Punkte
+     * @param cy Imaginärteil der Punkte
+     * @param s Die Zähler der vorzeitig beendeten Samples
+     */
+    template<typename real, typename F>
+    inline void iterate(const nativeParams& p, const size_t* idx, int lanes, typename simd<real>::vreal cx, typename simd<real>::vreal cy,
+                        mandelbrot::stats& s)
+    {
+        typedef typename simd<real>::vreal vreal;
+        typedef typename simd<real>::vmask vmask;
+        typedef typename simd<real>::mask mask;
+        const int width = sizeof(vreal) / sizeof(real);
+        const nativeBuffer& b = p.buffer;
+        vreal zx = cx - cx;
+        vreal zy = zx;
+        vmask n = (vmask)(zx != zx);
+        vmask skip = n;
+        unsigned iter = p.iter;
+        unsigned check = p.start + 1;
+        unsigned i;
+
+        // Unbenutzte Lanes werden nicht gerechnet
+        for(int l = lanes; l < width; l++)
+            skip[l] = -1;
+
+        // Punkte in der Hauptkardioide und im Kreis der Periode 2 entkommen nie (nur bei z² + c)
+        vmask bulb = n;
+        if(p.formula.type == mandelbrot::MANDELBROT && !p.formula.julia)
+        {
+            vreal qx = cx - (real)0.25;
+            vreal q = qx*qx + cy*cy;
+            vreal bx = cx + (real)1;
+            bulb = ((q*(q + qx) < (real)0.25*cy*cy) | ((bx*bx + cy*cy) < (real)0.0625)) & ~skip;
+        }
+
+        // Bei Julia-Mengen beginnt z beim Punkt, c ist fest
+        if(p.formula.julia)
+        {
+            zx = cx;
+            zy = cy;
+            cx = (cx - cx) + (real)p.formula.jx;
+            cy = (cy - cy) + (real)p.formula.jy;
+        }
+
+        // Beim Fortsetzen werden nur Samples gerechnet die noch nicht entkommen sind
+        if(p.start > 0)
+        {
+            bulb = n;
+            for(int l = 0; l < lanes; l++)
+            {
+                zx[l] = b.z[2*idx[l]];
+                zy[l] = b.z[2*idx[l] + 1];
+            }
+            n += (mask)p.start;
+        }
+
+        vreal zx2 = zx*zx;
+        vreal zy2 = zy*zy;
+        vreal sx = zx;
+        vreal sy = zy;
+        vmask periodic = (vmask)(zx != zx);
+
+        for(i = p.start; i < iter; i++)
+        {
+            // Lanes die noch nicht entkommen sind und nicht als innen erkannt wurden
+            vmask m = ((zx2 + zy2) < (real)4) & ~(bulb | periodic | skip);
+            if(!any(m))
+                break;
+            n -= m;
+            // Entkommene Lanes bleiben stehen, wie in computeIterations
+            vreal tx;
+            vreal ty;
+            F::template next<real>(zx, zy, zx2, zy2, cx, cy, tx, ty);
+            zx = m ? tx : zx;
+            zy = m ? ty : zy;
+            zx2 = zx*zx;
+            zy2 = zy*zy;
+
+            // Kehrt der Orbit zum gespeicherten Punkt zurück ist er periodisch (Brent)
+            vreal ddx = zx - sx;
+            vreal ddy = zy - sy;
+            periodic |= m & ((ddx*ddx + ddy*ddy) < (real)p.period);
+            if(i + 1 == check)
+            {
+                sx = zx;
+                sy = zy;
+                check *= 2;
+            }
+        }
+
+        finish<real, F>(p, idx, lanes, zx, zy, cx, cy, n, bulb, periodic, s);
+    }
+
+    /* Speichert die Ergebnisse der Lanes im Iterations-Buffer: die Anzahl Iterationen, nicht entkommene
+     * Samples mit z, entkommene mit dem geglätteten Wert nach den weiteren Iterationen
+     * @param p Die Parameter
+     * @param idx Index der Samples der Lanes im Iterations-Buffer
+     * @param lanes Anzahl der gültigen Lanes
+     * @param zx Realteil von z am Ende
+     * @param zy Imaginärteil von z am Ende
+     * @param cx Realteil der Punkte
+     * @param cy Imaginärteil der Punkte
+     * @param n Die Anzahl Iterationen der Lanes
+     * @param bulb Lanes in der Hauptkardioide oder im Kreis der Periode 2
+     * @param periodic Lanes mit periodischem Orbit
+     * @param s Die Zähler der vorzeitig beendeten Samples
+     */
+    template<typename real, typename F>
+    inline void finish(const nativeParams& p, const size_t* idx, int lanes, typename simd<real>::vreal zx, typename simd<real>::vreal zy,
+                       typename simd<real>::vreal cx, typename simd<real>::vreal cy, typename simd<real>::vmask n,
+                       typename simd<real>::vmask bulb, typename simd<real>::vmask periodic, mandelbrot::stats& s)
+    {
+        typedef typename simd<real>::vreal vreal;
+        const nativeBuffer& b = p.buffer;
+        unsigned iter = p.iter;
+        vreal zx2 = zx*zx;
+        vreal zy2 = zy*zy;
+
+        // Nicht entkommene Samples werden für das Fortsetzen gespeichert
+        for(int l = 0; l < lanes; l++)
+        {
+            b.count[idx[l]] = n[l];
+            if(bulb[l] || periodic[l])
+                b.smooth[idx[l]] = SMOOTH_INTERIOR;
+            else if((unsigned)n[l] >= iter)
+            {
+                b.smooth[idx[l]] = SMOOTH_ACTIVE;
+                b.z[2*idx[l]] = zx[l];
+                b.z[2*idx[l] + 1] = zy[l];
+            }
+            s.bulb += bulb[l] != 0;
+            s.periodic += periodic[l] != 0;
+        }
+
+        // Weitere Iterationen für eine glattere Färbung
+        for(int e = 0; e < F::tail; e++)
+        {
+            F::template next<real>(zx, zy, zx2, zy2, cx, cy, zx, zy);
+            zx2 = zx*zx;
+            zy2 = zy*zy;
+        }
+
+        for(int l = 0; l < lanes; l++)
+            if((unsigned)n[l] < iter && !bulb[l] && !periodic[l])
+                b.smooth[idx[l]] = nativeSmooth(n[l], zy2[l] + zx2[l]);
+    }
+
+    // Gesammelte Samples für die Lanes, es werden nur Samples gesammelt die gerechnet werden müssen
+    template<typename real>
+    struct batch
+    {
+        static const int width = LANES*sizeof(double) / sizeof(real);
+        size_t idx[width];                  // Index der Samples im Iterations-Buffer
+        typename simd<real>::vreal cx;      // Die Punkte der Samples
+        typename simd<real>::vreal cy;
+        int lanes;                          // Anzahl der belegten Lanes
+    };
+
+    // Fügt das Sample g mit dem Punkt (x, y) hinzu und rechnet, sobald alle Lanes belegt sind
+    template<typename real, typename F>
+    inline void add(const nativeParams& p, batch<real>& b, size_t g, double x, double y, mandelbrot::stats& s)
+    {
+        b.idx[b.lanes] = g;
+        b.cx[b.lanes] = x;
+        b.cy[b.lanes] = y;
+        if(++b.lanes == batch<real>::width)
+        {
+            iterate<real, F>(p, b.idx, b.lanes, b.cx, b.cy, s);
+            b.lanes = 0;
+        }
+    }
+
+    // Rechnet die restlichen Samples, freie Lanes bekommen den Punkt der ersten
+    template<typename real, typename F>
+    inline void flush(const nativeParams& p, batch<real>& b, mandelbrot::stats& s)
+    {
+        if(b.lanes > 0)
+        {
+            for(int l = b.lanes; l < batch<real>::width; l++)
+            {
+                b.cx[l] = b.cx[0];
+                b.cy[l] = b.cy[0];
+            }
+            iterate<real, F>(p, b.idx, b.lanes, b.cx, b.cy, s);
+            b.lanes = 0;
+        }
+
+#if LANES > 2
+        /* Der übrige Code (z.B. sinf beim Färben) ist SSE-Code. GCC lässt hier nicht auf allen Wegen
+         * vzeroupper aus, danach wird jeder SSE-Befehl stark gebremst.
+         */
+        __builtin_ia32_vzeroupper();
+#endif
+    }
+
+    template<typename real, typename F>
+    void span(const nativeParams& p, size_t x0, size_t y, size_t n, mandelbrot::stats& s)
+    {
+        const nativeBuffer& b = p.buffer;
+        float wanted = p.start > 0 ? SMOOTH_ACTIVE : SMOOTH_PENDING;
+        double cy = p.y0 + p.dy * y;
+        batch<real> lanes;
+
+        /* Nur Samples die gerechnet werden müssen (vom letzten Bild oder Durchgang übernommene
+         * nicht) werden in die Lanes gepackt, so bleiben keine Lanes leer
+         */
+        lanes.lanes = 0;
+        for(size_t x = 0; x < n; x++)
+        {
+            size_t g = y*b.width + x0 + x*p.step;
+            if(b.smooth[g] == wanted)
+                add<real, F>(p, lanes, g, p.x0 + p.dx * (double)(x0 + x*p.step), cy, s);
+        }
+        flush<real, F>(p, lanes, s);
+    }
+
+    template<typename real, typename F>
+    void pixels(const nativeParams& p, const unsigned* pixels, size_t n, size_t samples, mandelbrot::stats& s)
+    {
+        const nativeBuffer& b = p.buffer;
+        float wanted = p.start > 0 ? SMOOTH_ACTIVE : SMOOTH_PENDING;
+        size_t width = b.width / samples;
+        batch<real> lanes;
+
+        // Die Lanes werden über die Grenzen der Pixel hinweg gefüllt
+        lanes.lanes = 0;
+        for(size_t i = 0; i < n; i++)
+            for(size_t sy = 0; sy < samples; sy++)
+            {
+                size_t y = pixels[i] / width * samples + sy;
+                for(size_t sx = 0; sx < samples; sx++)
+                {
+                    size_t x = pixels[i] % width * samples + sx;
+                    size_t g = y*b.width + x;
+                    if(b.smooth[g] == wanted)
+                        add<real, F>(p, lanes, g, p.x0 + p.dx * (double)x, p.y0 + p.dy * y, s);
+                }
+            }
+        flush<real, F>(p, lanes, s);
+    }
+
+    typedef simd<double>::vreal vdouble;
+
+    // Eine Zahl in double-double: hi + lo mit |lo| höchstens ein halbes ulp von hi (T ist double oder vdouble)
+    template<typename T>
+    struct dd
+    {
+        T hi;
+        T lo;
+    };
+
+    // Exakte Summe a + b = hi + lo
+    template<typename T>
+    inline dd<T> twoSum(T a, T b)
+    {
+        T s = a + b;
+        T v = s - a;
+        return { s, (a - (s - v)) + (b - v) };
+    }
+
+    // Exakte Summe a + b = hi + lo, nur für |a| >= |b|
+    template<typename T>
+    inline dd<T> quickTwoSum(T a, T b)
+    {
+        T s = a + b;
+        return { s, b - (s - a) };
+    }
+
+    // Exaktes Produkt a * b = hi + lo
+    inline dd<double> twoProd(double a, double b)
+    {
+        double p = a * b;
+        return { p, fma(a, b, -p) };
+    }
+
+    inline dd<vdouble> twoProd(vdouble a, vdouble b)
+    {
+        vdouble p = a * b;
+#if LANES == 8
+        return { p, (vdouble)_mm512_fmsub_pd((__m512d)a, (__m512d)b, (__m512d)p) };
+#elif LANES == 4 && defined(__FMA__)
+        return { p, (vdouble)_mm256_fmsub_pd((__m256d)a, (__m256d)b, (__m256d)p) };
+#else
+        // Ohne FMA nach Dekker: die Faktoren werden in je zwei Hälften mit 26 Bit geteilt
+        vdouble ta = a * 134217729.0;
+        vdouble ah = ta - (ta - a);
+        vdouble al = a - ah;
+        vdouble tb = b * 134217729.0;
+        vdouble bh = tb - (tb - b);
+        vdouble bl = b - bh;
+        return { p, ((ah*bh - p) + ah*bl + al*bh) + al*bl };
+#endif
+    }
+
+    template<typename T>
+    inline dd<T> ddAdd(dd<T> a, dd<T> b)
+    {
+        dd<T> s = twoSum(a.hi, b.hi);
+        return quickTwoSum(s.hi, s.lo + a.lo + b.lo);
+    }
+
+    template<typename T>
+    inline dd<T> ddSub(dd<T> a, dd<T> b)
+    {
+        return ddAdd(a, { -b.hi, -b.lo });
+    }
+
+    template<typename T>
+    inline dd<T> ddMul(dd<T> a, dd<T> b)
+    {
+        dd<T> p = twoProd(a.hi, b.hi);
+        return quickTwoSum(p.hi, p.lo + (a.hi*b.lo + a.lo*b.hi));
+    }
+
+    template<typename T>
+    inline dd<T> ddSqr(dd<T> a)
+    {
+        dd<T> p = twoProd(a.hi, a.hi);
+        return quickTwoSum(p.hi, p.lo + 2*a.hi*a.lo);
+    }
+
+    // Produkt mit einem double
+    template<typename T>
+    inline dd<T> ddMulD(dd<T> a, T b)
+    {
+        dd<T> p = twoProd(a.hi, b);
+        return quickTwoSum(p.hi, p.lo + a.lo*b);
+    }
+
+    /* Iteriert die Samples aller Lanes gleichzeitig in double-double, wie iterate mit p.start 0
+     * @param p Die Parameter
+     * @param idx Index der Samples der Lanes im Iterations-Buffer
+     * @param lanes Anzahl der gültigen Lanes
+     * @param cx Realteil der Punkte
+     * @param cy Imaginärteil der Punkte
+     * @param s Die Zähler der vorzeitig beendeten Samples
+     */
+    inline void iterateDD(const nativeParams& p, const size_t* idx, int lanes, dd<vdouble> cx, dd<vdouble> cy, mandelbrot::stats& s)
+    {
+        typedef simd<double>::vmask vmask;
+        vdouble zero = cx.hi - cx.hi;
+        dd<vdouble> zx = { zero, zero };
+        dd<vdouble> zy = zx;
+        vmask n = (vmask)(zero != zero);
+        vmask skip = n;
+        unsigned iter = p.iter;
+        unsigned check = 1;
+        unsigned i;
+
+        for(int l = lanes; l < LANES; l++)
+            skip[l] = -1;
+
+        // Der Test ist nur in double, Punkte näher als DD_BULB_MARGIN am Rand werden normal gerechnet
+        vdouble qx = cx.hi - 0.25;
+        vdouble q = qx*qx + cy.hi*cy.hi;
+        vdouble bx = cx.hi + 1;
+        vmask bulb = ((q*(q + qx) < 0.25*cy.hi*cy.hi - DD_BULB_MARGIN) | ((bx*bx + cy.hi*cy.hi) < 0.0625 - DD_BULB_MARGIN)) & ~skip;
+
+        dd<vdouble> zx2 = zx;
+        dd<vdouble> zy2 = zx;
+        dd<vdouble> sx = zx;
+        dd<vdouble> sy = zx;
+        vmask periodic = n;
+
+        for(i = 0; i < iter; i++)
+        {
+            vmask m = ((zx2.hi + zy2.hi) < 4) & ~(bulb | periodic | skip);
+            if(!any(m))
+                break;
+            n -= m;
+            dd<vdouble> xy = ddMul(zx, zy);
+            dd<vdouble> ty = ddAdd({ 2*xy.hi, 2*xy.lo }, cy);
+            dd<vdouble> tx = ddAdd(ddSub(zx2, zy2), cx);
+            zx.hi = m ? tx.hi : zx.hi;
+            zx.lo = m ? tx.lo : zx.lo;
+            zy.hi = m ? ty.hi : zy.hi;
+            zy.lo = m ? ty.lo : zy.lo;
+            zx2 = ddSqr(zx);
+            zy2 = ddSqr(zy);
+
+            // Der Abstand ist klein gegenüber z, die Differenz der hi und lo reicht
+            vdouble ddx = (zx.hi - sx.hi) + (zx.lo - sx.lo);
+            vdouble ddy = (zy.hi - sy.hi) + (zy.lo - sy.lo);
+            periodic |= m & ((ddx*ddx + ddy*ddy) < p.period);
+            if(i + 1 == check)
+            {
+                sx = zx;
+                sy = zy;
+                check *= 2;
+            }
+        }
+
+        // Für die Färbung reicht double
+        finish<double, quadratic>(p, idx, lanes, zx.hi, zy.hi, cx.hi, cy.hi, n, bulb, periodic, s);
+    }
+
+    // Gesammelte Samples für die Lanes in double-double (siehe batch)
+    struct batchDD
+    {
+        size_t idx[LANES];
+        dd<vdouble> cx;
+        dd<vdouble> cy;
+        int lanes;
+    };
+
+    // Fügt das Sample g mit dem Punkt (x, y) hinzu und rechnet, sobald alle Lanes belegt sind
+    inline void addDD(const nativeParams& p, batchDD& b, size_t g, dd<double> x, dd<double> y, mandelbrot::stats& s)
+    {
+        b.idx[b.lanes] = g;
+        b.cx.hi[b.lanes] = x.hi;
+        b.cx.lo[b.lanes] = x.lo;
+        b.cy.hi[b.lanes] = y.hi;
+        b.cy.lo[b.lanes] = y.lo;
+        if(++b.lanes == LANES)
+        {
+            iterateDD(p, b.idx, b.lanes, b.cx, b.cy, s);
+            b.lanes = 0;
+        }
+    }
+
+    // Rechnet die restlichen Samples, freie Lanes bekommen den Punkt der ersten
+    inline void flushDD(const nativeParams& p, batchDD& b, mandelbrot::stats& s)
+    {
+        if(b.lanes > 0)
+        {
+            for(int l = b.lanes; l < LANES; l++)
+            {
+                b.cx.hi[l] = b.cx.hi[0];
+                b.cx.lo[l] = b.cx.lo[0];
+                b.cy.hi[l] = b.cy.hi[0];
+                b.cy.lo[l] = b.cy.lo[0];
+            }
+            iterateDD(p, b.idx, b.lanes, b.cx, b.cy, s);
+            b.lanes = 0;
+        }
+
+#if LANES > 2
+        __builtin_ia32_vzeroupper();
+#endif
+    }
+
+    // Der Punkt des Samples i in einer Richtung: start + delta * i
+    inline dd<double> position(const double* start, const double* delta, size_t i)
+    {
+        return ddAdd<double>({ start[0], start[1] }, ddMulD<double>({ delta[0], delta[1] }, (double)i));
+    }
+
+    void spanDD(const nativeParams& p, size_t x0, size_t y, size_t n, mandelbrot::stats& s)
+    {
+        const nativeBuffer& b = p.buffer;
+        dd<double> cy = position(p.dd->y0, p.dd->dy, y);
+        batchDD lanes;
+
+        lanes.lanes = 0;
+        for(size_t x = 0; x < n; x++)
+        {
+            size_t g = y*b.width + x0 + x*p.step;
+            if(b.smooth[g] == SMOOTH_PENDING)
+                addDD(p, lanes, g, position(p.dd->x0, p.dd->dx, x0 + x*p.step), cy, s);
+        }
+        flushDD(p, lanes, s);
+    }
+
+    void pixelsDD(const nativeParams& p, const unsigned* pixels, size_t n, size_t samples, mandelbrot::stats& s)
+    {
+        const nativeBuffer& b = p.buffer;
+        size_t width = b.width / samples;
+        batchDD lanes;
+
+        lanes.lanes = 0;
+        for(size_t i = 0; i < n; i++)
+            for(size_t sy = 0; sy < samples; sy++)
+            {
+                size_t y = pixels[i] / width * samples + sy;
+                dd<double> cy = position(p.dd->y0, p.dd->dy, y);
+                for(size_t sx = 0; sx < samples; sx++)
+                {
+                    size_t x = pixels[i] % width * samples + sx;
+                    size_t g = y*b.width + x;
+                    if(b.smooth[g] == SMOOTH_PENDING)
+                        addDD(p, lanes, g, position(p.dd->x0, p.dd->dx, x), cy, s);
+                }
+            }
+        flushDD(p, lanes, s);
+    }
+}
+
+namespace NATIVE_ISA
+{
+    void computeSpan(const nativeParams& p, size_t x0, size_t y, size_t n, mandelbrot::stats& s)
+    {
+        if(p.dd != nullptr)
+            spanDD(p, x0, y, n, s);
+        else
+            withFormula(p.formula, [&](auto f) {
+                if(p.single)
+                    span<float, decltype(f)>(p, x0, y, n, s);
+                else
+                    span<double, decltype(f)>(p, x0, y, n, s);
+            });
+    }
+
+    void computePixels(const nativeParams& p, const unsigned* list, size_t n, size_t samples, mandelbrot::stats& s)
+    {
+        if(p.dd != nullptr)
+            pixelsDD(p, list, n, samples, s);
+        else
+            withFormula(p.formula, [&](auto f) {
+                if(p.single)
+                    pixels<float, decltype(f)>(p, list, n, samples, s);
+                else
+                    pixels<double, decltype(f)>(p, list, n, samples, s);
+            });
+    }
+}
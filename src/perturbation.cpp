@@ -0,0 +1,300 @@
+/*  perturbation.cpp
+ * Name Perturbation-Modul
+ * Störungsrechnung für tiefe Zooms: Ein Referenz-Orbit wird mit beliebiger Genauigkeit berechnet,
+ * alle Pixel iterieren nur ihre Abweichung davon in double (bzw. floatexp falls diese zu klein ist).
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#include "perturbation.hpp"
+#include "native.hpp"
+
+reference::reference()
+{
+    _iter = 0;
+}
+
+void reference::compute(const bigfloat& x, const bigfloat& y, size_t i)
+{
+    if(!_orbit.empty() && _iter == i && _x == x && _y == y)
+        return;
+
+    _x = x;
+    _y = y;
+    _iter = i;
+    _orbit.clear();
+
+    // Beide Teile mit der selben Genauigkeit
+    size_t limbs = x.limbs() > y.limbs() ? x.limbs() : y.limbs();
+    bigfloat cx = x;
+    bigfloat cy = y;
+    cx.setLimbs(limbs);
+    cy.setLimbs(limbs);
+
+    bigfloat zx(limbs);
+    bigfloat zy(limbs);
+    _orbit.push_back(0);
+    _orbit.push_back(0);
+
+    // Z_n wird gespeichert bis der Orbit entkommt (inklusive dem ersten entkommenen Punkt)
+    while(length() <= i)
+    {
+        bigfloat zx2 = zx*zx;
+        bigfloat zy2 = zy*zy;
+        if(zx2.toDouble() + zy2.toDouble() >= 4)
+            break;
+        bigfloat zxy = zx*zy;
+        zy = zxy + zxy + cy;
+        zx = zx2 - zy2 + cx;
+        _orbit.push_back(zx.toDouble());
+        _orbit.push_back(zy.toDouble());
+    }
+}
+
+complexexp deltaOf(const perturbParams& p, double fx, double fy)
+{
+    // Abstand zum Referenzpunkt in der Mitte des Bildes
+    floatexp cx(p.dx.m * (fx - p.width / 2.0), p.dx.e);
+    floatexp cy(p.dy.m * (fy - p.height / 2.0), p.dy.e);
+    long ce = cx.m == 0 ? cy.e : (cy.m == 0 ? cx.e : (cx.e > cy.e ? cx.e : cy.e));
+
+    return complexexp(complexexp::scale(cx.m, cx.e - ce), complexexp::scale(cy.m, cy.e - ce), ce);
+}
+
+/* Iteriert dz vom Anfang bis zur Iteration n, ohne Umsetzen der Referenz
+ * @return false falls das Umsetzen nötig wäre oder der Punkt entkommt
+ */
+static bool iterateDelta(const reference& ref, complexexp dc, unsigned n, complexexp& dz)
+{
+    const double* orbit = ref.orbit();
+
+    dz = complexexp();
+    for(unsigned m = 0; m < n; m++)
+    {
+        complexexp Z(orbit[2*m], orbit[2*m + 1], 0);
+        complexexp z = Z + dz;
+        if(m > 0 && z.log2() <= dz.log2())
+            return false;
+        if(z.log2() >= 1)
+            return false;
+        dz = complexexp(2, 0, 0) * Z * dz + dz * dz + dc;
+    }
+    return true;
+}
+
+void approximate(const reference& ref, perturbParams& p)
+{
+    const double* orbit = ref.orbit();
+    std::vector<complexexp> coeffs;
+    complexexp a;
+    complexexp b;
+    complexexp c;
+    unsigned n;
+
+    p.skip = 0;
+
+    // Grösster Abstand eines Samples vom Referenzpunkt (Ecke des Bildes)
+    double delta = deltaOf(p, -1, -1).log2();
+
+    /* A_n+1 = 2 Z_n A_n + 1, B_n+1 = 2 Z_n B_n + A_n², C_n+1 = 2 Z_n C_n + 2 A_n B_n
+     * Abgebrochen wird sobald der dritte Term nicht mehr vernachlässigbar gegenüber dem ersten ist.
+     */
+    for(n = 0; n + 1 < ref.length() && n + 1 < p.iter; n++)
+    {
+        complexexp Z2(2*orbit[2*n], 2*orbit[2*n + 1], 0);
+        complexexp na = Z2 * a + complexexp(1, 0, 0);
+        complexexp nb = Z2 * b + a * a;
+        complexexp nc = Z2 * c + complexexp(2, 0, 0) * a * b;
+        if(!na.zero() && nc.log2() + 2*delta > na.log2() + log2(SERIES_TOLERANCE))
+            break;
+        a = na;
+        b = nb;
+        c = nc;
+        coeffs.push_back(a);
+        coeffs.push_back(b);
+        coeffs.push_back(c);
+    }
+
+    /* Überprüfen an den Ecken und Seitenmitten. Stimmt ein Testpunkt nicht mit der vollen
+     * Iteration überein, wird weniger übersprungen.
+     */
+    static const double probes[8][2] = { { 0, 0 }, { 0.5, 0 }, { 1, 0 }, { 0, 0.5 }, { 1, 0.5 }, { 0, 1 }, { 0.5, 1 }, { 1, 1 } };
+    while(n >= SERIES_MIN_SKIP)
+    {
+        bool valid = true;
+        a = coeffs[3*(n - 1)];
+        b = coeffs[3*(n - 1) + 1];
+        c = coeffs[3*(n - 1) + 2];
+
+        for(int t = 0; t < 8 && valid; t++)
+        {
+            complexexp dc = deltaOf(p, probes[t][0] * p.width, probes[t][1] * p.height);
+            complexexp exact;
+            if(!iterateDelta(ref, dc, n, exact))
+            {
+                valid = false;
+                break;
+            }
+            complexexp approx = dc * (a + dc * (b + dc * c));
+            valid = (approx - exact).log2() - exact.log2() < log2(SERIES_PROBE_TOLERANCE);
+        }
+
+        if(valid)
+        {
+            p.skip = n;
+            p.a = a;
+            p.b = b;
+            p.c = c;
+            return;
+        }
+        n = n * 3 / 4;
+    }
+}
+
+/* Iteriert ein Sample mit der Abweichung dc vom Referenzpunkt und speichert es im Iterations-Buffer
+ * @param b Der Iterations-Buffer
+ * @param idx Der Index des Samples im Iterations-Buffer
+ * @param ref Der Referenz-Orbit
+ * @param p Die Parameter
+ * @param dc Die Abweichung vom Referenzpunkt
+ * @param s Die Zähler der vorzeitig beendeten Samples
+ */
+static void perturbSample(const nativeBuffer& b, size_t idx, const reference& ref, const perturbParams& p, complexexp dc, mandelbrot::stats& s)
+{
+    const double* orbit = ref.orbit();
+    size_t len = ref.length();
+    size_t m = 0;
+    unsigned n = 0;
+    double zx = 0;
+    double zy = 0;
+    double dzx = 0;
+    double dzy = 0;
+    double dcx = complexexp::scale(dc.x, dc.e);
+    double dcy = complexexp::scale(dc.y, dc.e);
+    complexexp dz;
+
+    // Vom letzten Bild übernommene Samples (siehe native::reproject)
+    if(b.smooth[idx] != SMOOTH_PENDING)
+        return;
+
+    /* Punkte in der Hauptkardioide und im Kreis der Periode 2 entkommen nie. c ist hier nur auf
+     * double genau, deshalb muss c deutlich innerhalb liegen. Auf Periodizität wird nicht geprüft,
+     * da die Toleranz kleiner als ein Pixel sein müsste, z aber nur auf double genau ist.
+     */
+    if(nativeBulb(p.cx + dcx, p.cy + dcy, PERTURB_BULB_MARGIN))
+    {
+        b.smooth[idx] = SMOOTH_INTERIOR;
+        b.count[idx] = 0;
+        s.bulb++;
+        return;
+    }
+
+    // Die ersten Iterationen werden mit der Reihenentwicklung übersprungen
+    if(p.skip > 0)
+    {
+        dz = dc * (p.a + dc * (p.b + dc * p.c));
+        n = p.skip;
+        m = p.skip;
+    }
+    else
+        dz = complexexp(0, 0, dc.e);
+
+    // Solange die Abweichung zu klein für double ist, wird sie als Mantisse und Exponent gerechnet
+    if(dz.zero() ? dc.e < PERTURB_DOUBLE_EXP : dz.e < PERTURB_DOUBLE_EXP)
+    {
+        double mx = dz.x;
+        double my = dz.y;
+        long e = dz.zero() ? dc.e : dz.e;
+
+        for(; n < p.iter; n++)
+        {
+            double Zx = orbit[2*m];
+            double Zy = orbit[2*m + 1];
+            zx = Zx + complexexp::scale(mx, e);
+            zy = Zy + complexexp::scale(my, e);
+            if(zx*zx + zy*zy >= 4 || m == len - 1)
+                break;
+
+            // dz = 2*Z*dz + dz² + dc, alles auf den grössten Exponenten gebracht
+            long E = e > dc.e ? e : dc.e;
+            complexexp next(complexexp::scale(2*(Zx*mx - Zy*my), e - E) + complexexp::scale(mx*mx - my*my, 2*e - E) + complexexp::scale(dc.x, dc.e - E),
+                            complexexp::scale(2*(Zx*my + Zy*mx), e - E) + complexexp::scale(2*mx*my, 2*e - E) + complexexp::scale(dc.y, dc.e - E), E);
+            mx = next.x;
+            my = next.y;
+            e = next.zero() ? E : next.e;
+            m++;
+
+            if(e > PERTURB_DOUBLE_EXP)
+            {
+                n++;
+                break;
+            }
+        }
+        dzx = complexexp::scale(mx, e);
+        dzy = complexexp::scale(my, e);
+    }
+    else
+    {
+        dzx = complexexp::scale(dz.x, dz.e);
+        dzy = complexexp::scale(dz.y, dz.e);
+    }
+
+    for(; n < p.iter; n++)
+    {
+        double Zx = orbit[2*m];
+        double Zy = orbit[2*m + 1];
+        zx = Zx + dzx;
+        zy = Zy + dzy;
+        double r2 = zx*zx + zy*zy;
+        if(r2 >= 4)
+            break;
+
+        /* Ist der Punkt näher bei 0 als seine Abweichung, oder ist die Referenz zu Ende, wird
+         * die Abweichung auf den Anfang der Referenz umgesetzt (Z_0 = 0). Damit werden Fehler
+         * (Glitches) vermieden, die sonst durch den Verlust an Genauigkeit entstehen.
+         */
+        if(r2 < dzx*dzx + dzy*dzy || m == len - 1)
+        {
+            dzx = zx;
+            dzy = zy;
+            Zx = 0;
+            Zy = 0;
+            m = 0;
+        }
+
+        double ndx = 2*(Zx*dzx - Zy*dzy) + dzx*dzx - dzy*dzy + dcx;
+        double ndy = 2*(Zx*dzy + Zy*dzx) + 2*dzx*dzy + dcy;
+        dzx = ndx;
+        dzy = ndy;
+        m++;
+    }
+
+    /* Nicht entkommene Samples werden nicht fortgesetzt, da der Zustand der Störungsrechnung
+     * (Abweichung, Exponent und Index in der Referenz) nicht gespeichert wird
+     */
+    b.count[idx] = n;
+    b.smooth[idx] = SMOOTH_ACTIVE;
+
+    if(n < p.iter)
+    {
+        // Vier weitere Iterationen für eine glattere Färbung, wie in computeIterations
+        double cx = p.cx + dcx;
+        double cy = p.cy + dcy;
+        double tx = zx*zx;
+        double ty = zy*zy;
+        for(int e = 0; e < 4; e++)
+        {
+            zy = 2*zx*zy + cy;
+            zx = tx - ty + cx;
+            tx = zx*zx;
+            ty = zy*zy;
+        }
+        b.smooth[idx] = nativeSmooth(n, tx + ty);
+    }
+}
+
+void perturbSpan(const nativeBuffer& b, const reference& ref, const perturbParams& p, size_t x, size_t y, size_t n, mandelbrot::stats& s)
+{
+    for(size_t i = 0; i < n; i++)
+        perturbSample(b, y*p.width + x + i*p.step, ref, p, deltaOf(p, x + i*p.step, y), s);
+}
@@ -0,0 +1,162 @@
+/*  perturbation.hpp
+ * Name Perturbation-Modul
+ * Störungsrechnung für tiefe Zooms: Ein Referenz-Orbit wird mit beliebiger Genauigkeit berechnet,
+ * alle Pixel iterieren nur ihre Abweichung davon in double (bzw. floatexp falls diese zu klein ist).
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#ifndef PERTURBATION_HPP
+#define PERTURBATION_HPP
+
+#include <vector>
+
+#include "mandelbrot.hpp"
+#include "bigfloat.hpp"
+#include "floatexp.hpp"
+
+struct nativeBuffer;
+
+// Exponent (Basis 2) ab dem eine Abweichung in double statt in floatexp gerechnet wird
+#define PERTURB_DOUBLE_EXP -900
+
+// Abstand zum Rand (im Wert des Tests) den ein Punkt in der Hauptkardioide haben muss
+#define PERTURB_BULB_MARGIN 1e-12
+
+// Maximaler Fehler des nächsten Terms der Reihenentwicklung relativ zum ersten
+#define SERIES_TOLERANCE 1e-12
+// Maximaler relativer Fehler der Reihenentwicklung an den Testpunkten
+#define SERIES_PROBE_TOLERANCE 1e-9
+// Minimale Anzahl übersprungener Iterationen, darunter lohnt sich die Reihenentwicklung nicht
+#define SERIES_MIN_SKIP 16
+
+// Komplexe Zahl (x + iy) * 2^e mit gemeinsamem Exponenten, |x| oder |y| in [0.5, 1)
+struct complexexp
+{
+    double x;
+    double y;
+    long e;
+
+    complexexp() : x(0), y(0), e(0) { }
+
+    complexexp(double mx, double my, long ex) : x(mx), y(my), e(ex)
+    {
+        double a = fabs(x) > fabs(y) ? fabs(x) : fabs(y);
+        int norm;
+
+        if(a == 0)
+        {
+            e = 0;
+            return;
+        }
+        frexp(a, &norm);
+        x = ldexp(x, -norm);
+        y = ldexp(y, -norm);
+        e += norm;
+    }
+
+    // Gibt true zurück falls die Zahl 0 ist
+    bool zero() const { return x == 0 && y == 0; }
+
+    // Gibt log2(|z|) zurück
+    double log2() const { return zero() ? -INFINITY : ::log2(hypot(x, y)) + e; }
+
+    // Gibt m * 2^e zurück, ohne Überlauf bei sehr grossen Differenzen
+    static double scale(double m, long e) { return e < -2000 ? 0 : ldexp(m, e); }
+
+    complexexp operator*(const complexexp& o) const
+    {
+        return complexexp(x*o.x - y*o.y, x*o.y + y*o.x, e + o.e);
+    }
+
+    complexexp operator+(const complexexp& o) const
+    {
+        if(zero())
+            return o;
+        if(o.zero())
+            return *this;
+        long E = e > o.e ? e : o.e;
+        return complexexp(scale(x, e - E) + scale(o.x, o.e - E), scale(y, e - E) + scale(o.y, o.e - E), E);
+    }
+
+    complexexp operator-(const complexexp& o) const
+    {
+        return *this + complexexp(-o.x, -o.y, o.e);
+    }
+};
+
+// Referenz-Orbit der Störungsrechnung
+class reference
+{
+private:
+    std::vector<double> _orbit;     // Die Punkte Z_n des Orbits, abwechselnd x und y
+    bigfloat _x;                    // Realteil des Referenzpunktes
+    bigfloat _y;                    // Imaginärteil des Referenzpunktes
+    size_t _iter;                   // Maximale Anzahl an Iterationen der letzten Berechnung
+
+public:
+    reference();
+
+    /* Berechnet den Orbit von (x, y) bis er entkommt oder i Iterationen erreicht sind. Ist der
+     * Orbit bereits für die selben Werte berechnet, passiert nichts.
+     * @param x Realteil des Referenzpunktes
+     * @param y Imaginärteil des Referenzpunktes
+     * @param i Die maximale Anzahl an Iterationen
+     */
+    void compute(const bigfloat& x, const bigfloat& y, size_t i);
+
+    // Gibt die Punkte des Orbits zurück (abwechselnd x und y)
+    const double* orbit() const { return _orbit.data(); }
+    // Gibt die Anzahl der Punkte des Orbits zurück
+    size_t length() const { return _orbit.size() / 2; }
+    // Gibt den Referenzpunkt als double zurück
+    double x() const { return _x.toDouble(); }
+    double y() const { return _y.toDouble(); }
+};
+
+// Parameter einer Berechnung mit Störungsrechnung
+struct perturbParams
+{
+    floatexp dx;        // Abstand zwischen zwei Samples (x)
+    floatexp dy;        // Abstand zwischen zwei Samples (y)
+    double cx;          // Referenzpunkt als double (für die Färbung)
+    double cy;
+    size_t width;       // Auflösung in Samples, der Referenzpunkt liegt in der Mitte
+    size_t height;
+    unsigned iter;      // Maximale Anzahl an Iterationen
+    unsigned step;      // Nur jedes step-te Sample (in x und y) wird gerechnet
+    unsigned skip;      // Anzahl durch die Reihenentwicklung übersprungener Iterationen
+    complexexp a;       // Koeffizienten der Reihenentwicklung dz_skip = a*dc + b*dc² + c*dc³
+    complexexp b;
+    complexexp c;
+};
+
+/* Berechnet eine Reihenentwicklung von dz in dc, mit der alle Pixel die ersten Iterationen
+ * überspringen können. Die Entwicklung wird abgebrochen, sobald der Fehler für den grössten
+ * Abstand im Bild zu gross wird, und an Testpunkten am Rand mit voller Iteration überprüft.
+ * Setzt skip, a, b und c in p (skip = 0 falls sich die Entwicklung nicht lohnt).
+ * @param ref Der Referenz-Orbit
+ * @param p Die Parameter, dx, dy, width, height und iter müssen gesetzt sein
+ */
+void approximate(const reference& ref, perturbParams& p);
+
+/* Gibt die Abweichung dc eines Samples vom Referenzpunkt zurück
+ * @param p Die Parameter
+ * @param fx Position relativ zum ersten Sample in Samples (x)
+ * @param fy Position relativ zum ersten Sample in Samples (y)
+ */
+complexexp deltaOf(const perturbParams& p, double fx, double fy);
+
+/* Iteriert n Samples ab (x, y) im Abstand p.step mithilfe der Störungsrechnung und speichert sie
+ * in b. Nur Samples mit SMOOTH_PENDING werden gerechnet.
+ * @param b Der Iterations-Buffer (siehe native.hpp)
+ * @param ref Der Referenz-Orbit
+ * @param p Die Parameter
+ * @param x Die Position des ersten Samples (x)
+ * @param y Die Position des ersten Samples (y)
+ * @param n Die Anzahl der Samples
+ * @param s Die Zähler der vorzeitig beendeten Samples (nur bulb, die Periodizität wird nicht geprüft)
+ */
+void perturbSpan(const nativeBuffer& b, const reference& ref, const perturbParams& p, size_t x, size_t y, size_t n, mandelbrot::stats& s);
+
+#endif
@@ -0,0 +1,149 @@
+/*  pool.cpp
+ * Name Threadpool-Modul
+ * Threadpool mit einer Warteschlange pro Thread, leere Threads stehlen Aufgaben von den anderen
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#include "pool.hpp"
+
+// Pool und Warteschlange des momentanen Threads
+static thread_local pool* currentPool = nullptr;
+static thread_local size_t currentIndex = 0;
+
+pool::pool(size_t threads)
+{
+    _size = threads > 0 ? threads : 1;
+    _queues = new queue[_size];
+    _queued = 0;
+    _pending = 0;
+    _next = 0;
+    _end = false;
+
+    // Warteschlange 0 gehört dem Thread der wait() aufruft
+    for(size_t i = 1; i < _size; i++)
+        _threads.emplace_back(&pool::worker, this, i);
+}
+
+pool::~pool()
+{
+    {
+        std::lock_guard<std::mutex> lck(_lock);
+        _end = true;
+    }
+    _wake.notify_all();
+    for(std::thread& t : _threads)
+        t.join();
+    delete[] _queues;
+}
+
+void pool::submit(task t)
+{
+    size_t index;
+
+    // Aufgaben aus einem Thread des Pools bleiben lokal, andere werden verteilt
+    if(currentPool == this)
+        index = currentIndex;
+    else
+        index = _next++ % _size;
+
+    _pending++;
+    {
+        std::lock_guard<std::mutex> lck(_queues[index].lock);
+        _queues[index].tasks.push_back(std::move(t));
+    }
+    {
+        std::lock_guard<std::mutex> lck(_lock);
+        _queued++;
+    }
+    _wake.notify_all();
+}
+
+bool pool::take(size_t index, task& t)
+{
+    // Die eigene Warteschlange wird von hinten abgearbeitet
+    {
+        queue& q = _queues[index];
+        std::lock_guard<std::mutex> lck(q.lock);
+        if(!q.tasks.empty())
+        {
+            t = std::move(q.tasks.back());
+            q.tasks.pop_back();
+            _queued--;
+            return true;
+        }
+    }
+    // Stehlen von vorne aus den anderen Warteschlangen
+    for(size_t i = 1; i < _size; i++)
+    {
+        queue& q = _queues[(index + i) % _size];
+        std::lock_guard<std::mutex> lck(q.lock);
+        if(!q.tasks.empty())
+        {
+            t = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            _queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void pool::execute(task& t)
+{
+    t();
+    t = nullptr;
+    // Die letzte Aufgabe weckt den wartenden Thread
+    if(--_pending == 0)
+    {
+        std::lock_guard<std::mutex> lck(_lock);
+        _wake.notify_all();
+    }
+}
+
+void pool::worker(size_t index)
+{
+    task t;
+
+    currentPool = this;
+    currentIndex = index;
+
+    while(true)
+    {
+        if(take(index, t))
+        {
+            execute(t);
+            continue;
+        }
+        std::unique_lock<std::mutex> lck(_lock);
+        _wake.wait(lck, [this]() { return _end || _queued > 0; });
+        if(_end)
+            return;
+    }
+}
+
+void pool::wait()
+{
+    task t;
+    pool* prevPool = currentPool;
+    size_t prevIndex = currentIndex;
+
+    currentPool = this;
+    currentIndex = 0;
+
+    while(true)
+    {
+        if(take(0, t))
+        {
+            execute(t);
+            continue;
+        }
+        std::unique_lock<std::mutex> lck(_lock);
+        _wake.wait(lck, [this]() { return _pending == 0 || _queued > 0; });
+        if(_pending == 0)
+            break;
+    }
+
+    currentPool = prevPool;
+    currentIndex = prevIndex;
+}
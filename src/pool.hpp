@@ -0,0 +1,71 @@
+/*  pool.hpp
+ * Name Threadpool-Modul
+ * Threadpool mit einer Warteschlange pro Thread, leere Threads stehlen Aufgaben von den anderen
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <functional>
+
+class pool
+{
+public:
+    // Eine Aufgabe
+    typedef std::function<void()> task;
+
+private:
+    // Warteschlange eines Threads
+    struct queue
+    {
+        std::mutex lock;
+        std::deque<task> tasks;
+    };
+
+    size_t _size;                       // Anzahl der Warteschlangen (Threads + aufrufender Thread)
+    queue* _queues;                     // Eine Warteschlange pro Thread
+    std::vector<std::thread> _threads;  // Die Threads des Pools
+    std::mutex _lock;                   // Schützt _end und das Warten auf _wake
+    std::condition_variable _wake;      // Weckt Threads bei neuen Aufgaben oder am Ende
+    std::atomic<size_t> _queued;        // Anzahl Aufgaben in den Warteschlangen
+    std::atomic<size_t> _pending;       // Anzahl noch nicht beendeter Aufgaben
+    std::atomic<size_t> _next;          // Nächste Warteschlange für Aufgaben von außen
+    bool _end;                          // True falls der Pool beendet wird
+
+    // Schleife der Threads
+    void worker(size_t index);
+    // Holt eine Aufgabe aus der eigenen Warteschlange oder stiehlt eine andere
+    bool take(size_t index, task& t);
+    // Führt eine Aufgabe aus
+    void execute(task& t);
+
+public:
+    /* Der Konstruktor startet die Threads
+     * @param threads Die Anzahl der Threads inklusive des Threads der wait() aufruft
+     */
+    pool(size_t threads);
+    // Der Destructor beendet alle Threads
+    ~pool();
+
+    // Gibt die Anzahl der Threads zurück
+    size_t size() const { return _size; }
+
+    /* Fügt eine Aufgabe hinzu. Aufgaben können selbst neue Aufgaben hinzufügen, diese
+     * landen dann in der Warteschlange des ausführenden Threads.
+     * @param t Die Aufgabe
+     */
+    void submit(task t);
+
+    // Arbeitet mit bis alle Aufgaben beendet sind
+    void wait();
+};
+
+#endif
@@ -0,0 +1,241 @@
+/*  render.cpp
+ * Name: Mandelbrot-Renderer
+ * Berechnet ein Bild beliebiger Grösse ohne Fenster und schreibt es in eine Datei (PPM, PNG, TIFF).
+ * Das Bild wird in Kacheln berechnet und Streifen für Streifen geschrieben, der Speicher hängt
+ * deshalb nur von der Breite des Bildes und der Grösse der Kacheln ab, nicht von der Höhe.
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ */
+
+#include <iostream>
+#include <chrono>
+#include <future>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#include "mandelbrot.hpp"
+#include "image.hpp"
+
+// Konstanten
+    // Default-Werte
+#define DEF_WIDTH 4096
+#define DEF_HEIGHT 4096
+#define DEF_ITERATIONEN 1000
+#define DEF_SAMPLES 1
+#define DEF_TILE 512
+#define DEF_OUTPUT "mandelbrot.png"
+
+// Gibt die Verwendung aus
+static void usage()
+{
+    std::cout << "Usage: render [options]\n"
+                << "  -o FILE             output file, format by extension (.png, .ppm, .tif)\n"
+                << "  --size WxH          resolution in pixels (default " << DEF_WIDTH << "x" << DEF_HEIGHT << ")\n"
+                << "  --center X Y W      center and width of the area (any precision)\n"
+                << "  --area X0 Y0 X1 Y1  top left and bottom right corner of the area\n"
+                << "  --iter N            maximum number of iterations (default " << DEF_ITERATIONEN << ")\n"
+                << "  --samples N         samples per pixel in x and y (default " << DEF_SAMPLES << ")\n"
+                << "  --tile N            size of a tile in pixels (default " << DEF_TILE << ")\n"
+                << "  --cpu               use the native backend instead of OpenCL\n"
+                << "  --multi             use all OpenCL devices and the native backend\n"
+                << "  --adaptive          adaptive supersampling (only edges get all samples)\n"
+                << "  --subdivide         fill rectangles with a uniform border instead of iterating them\n"
+                << "  --subdivide-check   like --subdivide, but probe the inside before filling\n"
+                << "  --double            always iterate in double precision (no float for shallow views)\n"
+                << "  --no-dd             use perturbation instead of double-double for moderately deep views\n"
+                << "  --julia X Y         Julia set of the point X + iY instead of the Mandelbrot set\n"
+                << "  --power N           iterate z^N + c (2 to " << FORMULA_MAX_POWER << ")\n"
+                << "  --burning-ship      iterate the Burning Ship (|Re z| + i|Im z|)^2 + c\n";
+}
+
+int main(int argc, char** argv)
+{
+    mandelbrot::res res = { DEF_WIDTH, DEF_HEIGHT };
+    mandelbrot::backend backend = mandelbrot::OPENCL;
+    const char* output = DEF_OUTPUT;
+    const char* center[2] = { nullptr, nullptr };
+    double width = 0;
+    mandelbrot::rect rect = { { -2, 2 }, { 2, -2 } };
+    size_t iterationen = DEF_ITERATIONEN;
+    size_t samples = DEF_SAMPLES;
+    size_t tile = DEF_TILE;
+    bool adaptive = false;
+    bool subdivide = false;
+    bool check = false;
+    bool single = true;
+    bool doubleDouble = true;
+    mandelbrot::formula formula = { mandelbrot::MANDELBROT, 2, false, 0, 0 };
+
+    // Auswerten der Argumente
+    for(int a = 1; a < argc; a++)
+    {
+        if(strcmp(argv[a], "-o") == 0 && a + 1 < argc)
+            output = argv[++a];
+        else if(strcmp(argv[a], "--size") == 0 && a + 1 < argc)
+        {
+            if(sscanf(argv[++a], "%zux%zu", &res.x, &res.y) != 2)
+                res.x = 0;
+        }
+        else if(strcmp(argv[a], "--center") == 0 && a + 3 < argc)
+        {
+            center[0] = argv[++a];
+            center[1] = argv[++a];
+            width = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--area") == 0 && a + 4 < argc)
+        {
+            rect.tl.x = atof(argv[++a]);
+            rect.tl.y = atof(argv[++a]);
+            rect.br.x = atof(argv[++a]);
+            rect.br.y = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--iter") == 0 && a + 1 < argc)
+            iterationen = strtoul(argv[++a], nullptr, 10);
+        else if(strcmp(argv[a], "--samples") == 0 && a + 1 < argc)
+            samples = strtoul(argv[++a], nullptr, 10);
+        else if(strcmp(argv[a], "--tile") == 0 && a + 1 < argc)
+            tile = strtoul(argv[++a], nullptr, 10);
+        else if(strcmp(argv[a], "--cpu") == 0)
+            backend = mandelbrot::NATIVE;
+        else if(strcmp(argv[a], "--multi") == 0)
+            backend = mandelbrot::MULTI;
+        else if(strcmp(argv[a], "--adaptive") == 0)
+            adaptive = true;
+        else if(strcmp(argv[a], "--subdivide") == 0)
+            subdivide = true;
+        else if(strcmp(argv[a], "--subdivide-check") == 0)
+            subdivide = check = true;
+        else if(strcmp(argv[a], "--double") == 0)
+            single = false;
+        else if(strcmp(argv[a], "--no-dd") == 0)
+            doubleDouble = false;
+        else if(strcmp(argv[a], "--julia") == 0 && a + 2 < argc)
+        {
+            formula.julia = true;
+            formula.jx = atof(argv[++a]);
+            formula.jy = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--power") == 0 && a + 1 < argc)
+        {
+            formula.type = mandelbrot::MULTIBROT;
+            formula.power = atoi(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--burning-ship") == 0)
+            formula.type = mandelbrot::BURNING_SHIP;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if(res.x == 0 || res.y == 0 || tile == 0 || samples == 0 || iterationen == 0)
+    {
+        usage();
+        return 1;
+    }
+
+    // Die Fläche, mit --center in beliebiger Genauigkeit (die Höhe folgt aus dem Seitenverhältnis)
+    mandelbrot::deep area = mandelbrot::toDeep(rect);
+    if(center[0] != nullptr)
+    {
+        area.w = floatexp(width);
+        area.h = floatexp(-width * res.y / res.x);
+        size_t limbs = bigfloat::limbsFor(area.w / floatexp((double)res.x));
+        area.x = bigfloat::fromString(center[0], limbs);
+        area.y = bigfloat::fromString(center[1], limbs);
+    }
+
+    imageWriter writer;
+    if(!writer.open(output, res, imageWriter::formatOf(output)))
+    {
+        std::cerr << "Failed to open " << output << "\n";
+        return 1;
+    }
+
+    mandelbrot* brot = new mandelbrot(backend);
+    mandelbrot::res tileRes = { tile, tile };
+    brot->setAdaptive(adaptive);
+    brot->setSubdivide(subdivide, check);
+    brot->setSingle(single);
+    brot->setDoubleDouble(doubleDouble);
+    brot->setFormula(formula);
+    brot->setAsync(true);
+    brot->createBuffer(tileRes);
+
+    /* Eine Reihe von Kacheln wird in einen Streifen kopiert. Während ein Streifen geschrieben wird,
+     * wird schon der nächste berechnet, deshalb gibt es zwei davon. Ebenso zwei Kacheln: während eine
+     * Kachel gerechnet wird, wird die vorherige noch übertragen (siehe setAsync) und dann kopiert.
+     */
+    std::vector<mandelbrot::color> tileBuffers[2];
+    tileBuffers[0].resize(tile * tile);
+    tileBuffers[1].resize(tile * tile);
+    std::vector<mandelbrot::color> bands[2];
+    bands[0].resize(res.x * tile);
+    bands[1].resize(res.x * tile);
+    std::future<bool> writing;
+    bool ok = true;
+    size_t filled = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    size_t numBands = (res.y + tile - 1) / tile;
+    size_t perBand = (res.x + tile - 1) / tile;
+    size_t numTiles = numBands * perBand;
+    for(size_t n = 0; n <= numTiles && ok; n++)
+    {
+        // Kachel n rechnen, ihre Übertragung läuft danach im Hintergrund weiter
+        if(n < numTiles)
+        {
+            size_t x = n % perBand * tile;
+            size_t y = n / perBand * tile;
+            mandelbrot::res t = { std::min(tile, res.x - x), std::min(tile, res.y - y) };
+
+            // Benachbarte Kacheln haben keine gemeinsamen Samples, übernehmen lohnt sich nicht
+            brot->reset();
+            brot->computeImage(tileBuffers[n % 2].data(), t, mandelbrot::tileArea(area, res, x, y, t), iterationen, samples);
+            filled += brot->lastStats().filled;
+        }
+        if(n == 0)
+            continue;
+
+        // Die vorherige Kachel in ihren Streifen kopieren, sobald sie übertragen ist
+        size_t p = n - 1;
+        size_t b = p / perBand;
+        size_t x = p % perBand * tile;
+        size_t w = std::min(tile, res.x - x);
+        size_t h = std::min(tile, res.y - b * tile);
+        std::vector<mandelbrot::color>& band = bands[b % 2];
+        brot->waitImage(tileBuffers[p % 2].data());
+        for(size_t r = 0; r < h; r++)
+            memcpy(band.data() + r*res.x + x, tileBuffers[p % 2].data() + r*w, w * sizeof(mandelbrot::color));
+        if(p % perBand != perBand - 1)
+            continue;
+
+        // Warten bis der vorherige Streifen geschrieben ist, dann diesen im Hintergrund schreiben
+        if(writing.valid())
+            ok = writing.get();
+        writing = std::async(std::launch::async, [&writer, &band, h]() { return writer.writeRows(band.data(), h); });
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "[band " << b + 1 << " of " << numBands << ", " << ms / 1000 << " s]\n";
+    }
+    if(writing.valid())
+        ok = writing.get() && ok;
+    ok = writer.close() && ok;
+
+    // Anteil der Samples die beim Unterteilen gefüllt statt gerechnet wurden
+    if(subdivide)
+        std::cout << "[filled " << 100.0 * filled / (res.x * res.y * samples * samples) << "% of samples]\n";
+
+    brot->deleteBuffer();
+    delete brot;
+
+    if(!ok)
+    {
+        std::cerr << "Failed to write " << output << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,648 @@
+/*  server.cpp
+ * Name: Mandelbrot-Kachelserver
+ * Liefert Kacheln im XYZ-Schema (/z/x/y.png, wie es Slippy-Map-Viewer erwarten) über HTTP auf
+ * localhost, für mehrere Viewer gleichzeitig. Gleiche Anfragen die noch gerechnet werden, warten auf
+ * die selbe Berechnung. Gleichzeitig angefragte, benachbarte Kacheln werden in einem Block mit einem
+ * Aufruf des Mandelbrot-Moduls gerechnet. Ist die Warteschlange voll, wird mit 503 geantwortet.
+ * Unter /stats gibt es Latenz und Durchsatz als JSON.
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ */
+
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <map>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+#include <cctype>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "mandelbrot.hpp"
+#include "tilecache.hpp"
+#include "image.hpp"
+
+// Konstanten
+    // Default-Werte
+#define DEF_PORT 8080
+#define DEF_ITERATIONEN 1000
+#define DEF_SAMPLES 1
+#define DEF_BATCH 16
+    // Die Ebene 0 ist eine Kachel mit dieser Fläche
+#define ROOT_X0 -2
+#define ROOT_Y0 2
+#define ROOT_X1 2
+#define ROOT_Y1 -2
+    // Grenzen der Parameter einer Anfrage
+#define SERVER_MAX_ITER 1000000
+#define SERVER_MAX_SAMPLES 8
+    // Maximale Anzahl wartender Kacheln, darüber wird mit 503 geantwortet
+#define SERVER_MAX_QUEUE 64
+    // Maximale Anzahl offener Verbindungen, darüber wird mit 503 geantwortet
+#define SERVER_MAX_CONNECTIONS 128
+    // Maximale Grösse des Headers einer Anfrage
+#define SERVER_MAX_HEADER 8192
+    // Eine Verbindung ohne Anfrage wird nach so vielen Sekunden geschlossen
+#define SERVER_TIMEOUT 10
+    // Anzahl der letzten Anfragen für die Perzentile der Latenz
+#define SERVER_LATENCIES 4096
+    // Zeitfenster für den aktuellen Durchsatz in Sekunden
+#define SERVER_RATE_WINDOW 10
+
+// Eine angefragte Kachel, auf deren Berechnung alle Anfragen dieser Kachel warten
+struct job
+{
+    tileCache::key key;
+    std::vector<mandelbrot::color> pixels;  // Die Kachel, sobald done gesetzt ist
+    bool done;
+    bool ok;                                // false falls die Berechnung fehlgeschlagen ist
+};
+
+// Eine beantwortete Anfrage (für die Statistik)
+struct sample
+{
+    int64_t end;        // Zeitpunkt der Antwort in Nanosekunden der steady_clock
+    double ms;          // Latenz vom Ende des Headers bis zur gesendeten Antwort
+};
+
+// Globale Variablen
+mandelbrot* brot;                   // Mandelbrot-Modul (nur render-Thread)
+tileCache* tiles;                   // Die fertigen Kacheln (geschützt durch lock)
+size_t batchTiles;                  // Maximale Anzahl Kacheln pro Aufruf von computeImage
+size_t defIter;                     // Iterationen ohne ?iter=
+size_t defSamples;                  // Samples ohne ?samples=
+mandelbrot::formula formula;        // Die Formel aller Kacheln (von brot, für die Schlüssel)
+int64_t startTime;                  // Start des Servers (für den Durchsatz)
+
+std::mutex lock;                    // Schützt alle folgenden Felder und tiles
+std::condition_variable queued;     // Neue Kachel in queue oder Ende
+std::condition_variable finished;   // Eine Kachel ist fertig
+std::deque<std::shared_ptr<job> > queue;            // Die wartenden Kacheln, älteste zuerst
+std::map<std::string, std::shared_ptr<job> > flight;    // Die wartenden und laufenden Kacheln
+std::deque<sample> latencies;       // Die letzten SERVER_LATENCIES Antworten mit Kachel
+size_t connections;                 // Offene Verbindungen
+uint64_t requests;                  // Anfragen insgesamt
+uint64_t hits;                      // Kacheln aus dem Cache
+uint64_t collapsed;                 // Kacheln die auf eine laufende Berechnung gewartet haben
+uint64_t rejected;                  // Mit 503 abgelehnte Anfragen
+uint64_t failed;                    // Fehlerhafte Anfragen (4xx) und Fehler der Berechnung
+uint64_t rendered;                  // Gerechnete Kacheln (mit den Kacheln zum Auffüllen der Blöcke)
+uint64_t launches;                  // Aufrufe von computeImage
+
+std::atomic<bool> running;          // false beendet den Server
+
+static int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Gibt den Namen einer Kachel für flight zurück
+static std::string name(const tileCache::key& k)
+{
+    const mandelbrot::formula& f = k.formula;
+    char formula[80];
+    snprintf(formula, sizeof(formula), "/%d/%u/%d/%a/%a", (int)f.type, f.power, (int)f.julia, f.jx, f.jy);
+    return std::to_string(k.level) + "/" + std::to_string(k.x) + "/" + std::to_string(k.y) + "/"
+           + std::to_string(k.iter) + "/" + std::to_string(k.samples) + formula;
+}
+
+/* Sucht den nächsten Block: die älteste wartende Kachel und alle wartenden Kacheln der selben Ebene
+ * und Parameter, solange der umschliessende Block höchstens batchTiles Kacheln hat und mindestens zur
+ * Hälfte angefragt ist. Die Kacheln des Blocks werden aus queue entfernt. lock muss gesperrt sein.
+ * @param first Die Kachel oben links
+ * @param w Die Anzahl Kacheln nebeneinander
+ * @param h Die Anzahl Kacheln untereinander
+ * @return Die angefragten Kacheln im Block
+ */
+static std::vector<std::shared_ptr<job> > takeBatch(tileCache::key& first, size_t& w, size_t& h)
+{
+    const tileCache::key& k = queue.front()->key;
+    int64_t x0 = k.x, y0 = k.y, x1 = k.x, y1 = k.y;
+    size_t count = 1;
+
+    for(size_t j = 1; j < queue.size(); j++)
+    {
+        const tileCache::key& o = queue[j]->key;
+        if(o.level != k.level || o.iter != k.iter || o.samples != k.samples || !(o.formula == k.formula))
+            continue;
+        int64_t nx0 = std::min(x0, o.x), ny0 = std::min(y0, o.y);
+        int64_t nx1 = std::max(x1, o.x), ny1 = std::max(y1, o.y);
+        size_t area = (nx1 - nx0 + 1) * (ny1 - ny0 + 1);
+        if(area <= batchTiles && area <= 2 * (count + 1))
+        {
+            x0 = nx0; y0 = ny0; x1 = nx1; y1 = ny1;
+            count++;
+        }
+    }
+
+    // Alle wartenden Kacheln im Block werden mitgerechnet, auch die oben übersprungenen
+    std::vector<std::shared_ptr<job> > batch;
+    std::deque<std::shared_ptr<job> > rest;
+    for(const std::shared_ptr<job>& j : queue)
+    {
+        const tileCache::key& o = j->key;
+        if(o.level == k.level && o.iter == k.iter && o.samples == k.samples && o.formula == k.formula && o.x >= x0 && o.x <= x1 && o.y >= y0 && o.y <= y1)
+            batch.push_back(j);
+        else
+            rest.push_back(j);
+    }
+    queue.swap(rest);
+
+    first = { k.level, x0, y0, k.iter, k.samples, k.formula };
+    w = x1 - x0 + 1;
+    h = y1 - y0 + 1;
+    return batch;
+}
+
+// Thread der die wartenden Kacheln blockweise rechnet
+void renderThread()
+{
+    std::vector<mandelbrot::color> image(batchTiles * TILE_SIZE * TILE_SIZE);
+    std::unique_lock<std::mutex> guard(lock);
+
+    while(running || !queue.empty())
+    {
+        if(queue.empty())
+        {
+            queued.wait(guard);
+            continue;
+        }
+
+        tileCache::key first;
+        size_t w, h;
+        std::vector<std::shared_ptr<job> > batch = takeBatch(first, w, h);
+        mandelbrot::deep area = tiles->tileArea(first, w, h);
+        guard.unlock();
+
+        // Benachbarte Blöcke haben keine gemeinsamen Samples, übernehmen lohnt sich nicht
+        mandelbrot::res res = { w * TILE_SIZE, h * TILE_SIZE };
+        brot->reset();
+        bool ok = brot->computeImage(image.data(), res, area, first.iter, first.samples);
+        if(ok)
+            brot->waitImage(image.data());
+
+        guard.lock();
+        if(ok)
+        {
+            tileCache::grid g = { first.level, first.x * TILE_SIZE, first.y * TILE_SIZE };
+            rendered += tiles->store(image.data(), res, g, first.iter, first.samples, first.formula);
+            launches++;
+        }
+        // Die Kacheln werden aus dem Block kopiert, der Cache könnte sie schon wieder verdrängt haben
+        for(const std::shared_ptr<job>& j : batch)
+        {
+            j->pixels.resize(TILE_SIZE * TILE_SIZE);
+            for(size_t r = 0; r < TILE_SIZE && ok; r++)
+                memcpy(j->pixels.data() + r * TILE_SIZE, image.data() + ((j->key.y - first.y) * TILE_SIZE + r) * res.x
+                       + (j->key.x - first.x) * TILE_SIZE, TILE_SIZE * sizeof(mandelbrot::color));
+            j->ok = ok;
+            j->done = true;
+            flight.erase(name(j->key));
+            if(!j->ok)
+                failed++;
+        }
+        finished.notify_all();
+    }
+}
+
+/* Kodiert eine Kachel als PNG
+ * @param pixels Die Pixel der Kachel
+ * @param png Die PNG-Datei
+ * @return false falls ein Fehler aufgetreten ist
+ */
+static bool encode(const std::vector<mandelbrot::color>& pixels, std::string& png)
+{
+    char* data = nullptr;
+    size_t size = 0;
+    FILE* file = open_memstream(&data, &size);
+    if(file == nullptr)
+        return false;
+
+    imageWriter writer;
+    mandelbrot::res res = { TILE_SIZE, TILE_SIZE };
+    bool ok = writer.open(file, res, imageWriter::PNG) && writer.writeRows(pixels.data(), TILE_SIZE);
+    ok = writer.close() && ok;
+    if(ok)
+        png.assign(data, size);
+    free(data);
+    return ok;
+}
+
+/* Sendet eine Antwort
+ * @param fd Die Verbindung
+ * @param status Der Status (z.B. "200 OK")
+ * @param type Der Content-Type
+ * @param body Der Inhalt
+ * @param keep false falls die Verbindung danach geschlossen wird
+ * @return false falls nicht alles gesendet werden konnte
+ */
+static bool respond(int fd, const char* status, const char* type, const std::string& body, bool keep)
+{
+    std::string head = std::string("HTTP/1.1 ") + status + "\r\n"
+                       + "Content-Type: " + type + "\r\n"
+                       + "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                       + "Access-Control-Allow-Origin: *\r\n"
+                       + (strncmp(status, "200", 3) == 0 ? "Cache-Control: public, max-age=86400\r\n" : "")
+                       + (strncmp(status, "503", 3) == 0 ? "Retry-After: 1\r\n" : "")
+                       + "Connection: " + (keep ? "keep-alive" : "close") + "\r\n\r\n";
+    std::string all = head + body;
+
+    for(size_t sent = 0; sent < all.size();)
+    {
+        ssize_t n = send(fd, all.data() + sent, all.size() - sent, MSG_NOSIGNAL);
+        if(n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Gibt die Statistik als JSON zurück
+static std::string stats()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    double uptime = (now() - startTime) / 1e9;
+    int64_t window = now() - (int64_t)SERVER_RATE_WINDOW * 1000000000;
+    std::vector<double> ms;
+    size_t recent = 0;
+
+    for(const sample& s : latencies)
+    {
+        ms.push_back(s.ms);
+        if(s.end >= window)
+            recent++;
+    }
+    std::sort(ms.begin(), ms.end());
+    auto percentile = [&ms](double p) { return ms.empty() ? 0.0 : ms[std::min((size_t)(p * ms.size()), ms.size() - 1)]; };
+
+    char buffer[1024];
+    snprintf(buffer, sizeof(buffer),
+             "{\"uptime_s\":%.3f,\"requests\":%llu,\"hits\":%llu,\"collapsed\":%llu,\"rejected\":%llu,\"failed\":%llu,"
+             "\"rendered\":%llu,\"launches\":%llu,\"tiles_per_launch\":%.2f,\"queue\":%zu,\"in_flight\":%zu,\"connections\":%zu,"
+             "\"requests_per_s\":%.2f,\"recent_per_s\":%.2f,"
+             "\"latency_ms\":{\"count\":%zu,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}}\n",
+             uptime, (unsigned long long)requests, (unsigned long long)hits, (unsigned long long)collapsed,
+             (unsigned long long)rejected, (unsigned long long)failed, (unsigned long long)rendered,
+             (unsigned long long)launches, launches > 0 ? (double)rendered / launches : 0.0, queue.size(), flight.size(),
+             connections, uptime > 0 ? requests / uptime : 0.0, (double)recent / SERVER_RATE_WINDOW,
+             ms.size(), percentile(0.5), percentile(0.9), percentile(0.99), ms.empty() ? 0.0 : ms.back());
+    return buffer;
+}
+
+/* Liest eine Zahl aus der Query (z.B. "iter=5000")
+ * @param query Die Query ohne '?'
+ * @param key Der Name
+ * @param def Der Wert falls er fehlt
+ */
+static size_t queryValue(const std::string& query, const char* key, size_t def)
+{
+    std::string k = std::string(key) + "=";
+    for(size_t p = 0; p < query.size();)
+    {
+        size_t end = query.find('&', p);
+        if(end == std::string::npos)
+            end = query.size();
+        if(query.compare(p, k.size(), k) == 0)
+            return strtoul(query.c_str() + p + k.size(), nullptr, 10);
+        p = end + 1;
+    }
+    return def;
+}
+
+/* Beantwortet die Anfrage einer Kachel
+ * @param fd Die Verbindung
+ * @param path Der Pfad ohne Query
+ * @param query Die Query ohne '?'
+ * @param keep false falls die Verbindung danach geschlossen wird
+ * @return false falls die Verbindung geschlossen werden muss
+ */
+static bool serveTile(int fd, const std::string& path, const std::string& query, bool keep)
+{
+    int64_t start = now();
+    int level;
+    long long x, y;
+    int length = 0;
+    tileCache::key k;
+
+    if(sscanf(path.c_str(), "/%d/%lld/%lld.png%n", &level, &x, &y, &length) != 3 || length != (int)path.size()
+       || level < 0 || level > TILE_MAX_LEVEL || x < 0 || y < 0 || x >= (1LL << level) || y >= (1LL << level))
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        failed++;
+        return respond(fd, "404 Not Found", "text/plain", "no such tile\n", keep);
+    }
+    k = { level, x, y, queryValue(query, "iter", defIter), queryValue(query, "samples", defSamples), formula };
+    if(k.iter == 0 || k.iter > SERVER_MAX_ITER || k.samples == 0 || k.samples > SERVER_MAX_SAMPLES)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        failed++;
+        return respond(fd, "400 Bad Request", "text/plain", "bad iter or samples\n", keep);
+    }
+
+    // Aus dem Cache, sonst auf eine laufende Berechnung warten oder eine neue einreihen
+    std::shared_ptr<job> j;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        std::string n = name(k);
+        auto found = flight.find(n);
+        if(found != flight.end())
+        {
+            j = found->second;
+            collapsed++;
+        }
+        else
+        {
+            j = std::make_shared<job>();
+            j->key = k;
+            j->done = false;
+            j->ok = false;
+            j->pixels.resize(TILE_SIZE * TILE_SIZE);
+            if(tiles->get(k, j->pixels.data()))
+            {
+                j->done = true;
+                j->ok = true;
+                hits++;
+            }
+            else if(queue.size() >= SERVER_MAX_QUEUE || !running)
+            {
+                rejected++;
+                guard.unlock();
+                return respond(fd, "503 Service Unavailable", "text/plain", "busy\n", keep);
+            }
+            else
+            {
+                queue.push_back(j);
+                flight[n] = j;
+                queued.notify_one();
+            }
+        }
+        while(!j->done)
+            finished.wait(guard);
+    }
+
+    std::string png;
+    if(!j->ok || !encode(j->pixels, png))
+        return respond(fd, "500 Internal Server Error", "text/plain", "failed to render tile\n", keep);
+    bool ok = respond(fd, "200 OK", "image/png", png, keep);
+
+    std::lock_guard<std::mutex> guard(lock);
+    latencies.push_back({ now(), (now() - start) / 1e6 });
+    if(latencies.size() > SERVER_LATENCIES)
+        latencies.pop_front();
+    return ok;
+}
+
+/* Liest den Header der nächsten Anfrage
+ * @param fd Die Verbindung
+ * @param buffer Bereits gelesene Bytes, danach die Bytes nach dem Header
+ * @param header Der Header ohne die leere Zeile
+ * @return false falls die Verbindung geschlossen wurde, zu lange still war oder der Header zu gross ist
+ */
+static bool readHeader(int fd, std::string& buffer, std::string& header)
+{
+    int idle = 0;
+
+    for(;;)
+    {
+        size_t end = buffer.find("\r\n\r\n");
+        if(end != std::string::npos)
+        {
+            header = buffer.substr(0, end);
+            buffer.erase(0, end + 4);
+            return true;
+        }
+        if(buffer.size() > SERVER_MAX_HEADER)
+            return false;
+
+        // Jede Sekunde wird geprüft ob der Server beendet wird
+        pollfd p = { fd, POLLIN, 0 };
+        int r = poll(&p, 1, 1000);
+        if(r < 0 || (r == 0 && (++idle >= SERVER_TIMEOUT || !running)))
+            return false;
+        if(r == 0)
+            continue;
+
+        char chunk[4096];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if(n <= 0)
+            return false;
+        buffer.append(chunk, n);
+        idle = 0;
+    }
+}
+
+// Thread einer Verbindung, beantwortet Anfragen bis die Verbindung geschlossen wird (Keep-Alive)
+void connectionThread(int fd)
+{
+    std::string buffer;
+    std::string header;
+    bool keep = true;
+
+    while(keep && readHeader(fd, buffer, header))
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            requests++;
+        }
+        char method[16], target[2048], version[16];
+        if(sscanf(header.c_str(), "%15s %2047s %15s", method, target, version) != 3)
+        {
+            respond(fd, "400 Bad Request", "text/plain", "bad request\n", false);
+            break;
+        }
+
+        // HTTP/1.1 hält die Verbindung offen, HTTP/1.0 nur mit "Connection: keep-alive"
+        std::string lower = header;
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        if(strcmp(version, "HTTP/1.1") == 0)
+            keep = lower.find("connection: close") == std::string::npos;
+        else
+            keep = lower.find("connection: keep-alive") != std::string::npos;
+        keep = keep && running;
+
+        std::string path = target;
+        std::string query;
+        size_t q = path.find('?');
+        if(q != std::string::npos)
+        {
+            query = path.substr(q + 1);
+            path.erase(q);
+        }
+
+        bool ok;
+        if(strcmp(method, "GET") != 0)
+            ok = respond(fd, "405 Method Not Allowed", "text/plain", "only GET\n", keep);
+        else if(path == "/stats")
+            ok = respond(fd, "200 OK", "application/json", stats(), keep);
+        else
+            ok = serveTile(fd, path, query, keep);
+        keep = keep && ok;
+    }
+    close(fd);
+
+    std::lock_guard<std::mutex> guard(lock);
+    connections--;
+    finished.notify_all();
+}
+
+// Beendet den Server bei SIGINT und SIGTERM
+static void stop(int)
+{
+    running = false;
+}
+
+// Gibt die Verwendung aus
+static void usage()
+{
+    std::cout << "Usage: server [options]\n"
+                << "  --port N            port on 127.0.0.1 (default " << DEF_PORT << ")\n"
+                << "  --iter N            iterations without ?iter= (default " << DEF_ITERATIONEN << ")\n"
+                << "  --samples N         samples per pixel without ?samples= (default " << DEF_SAMPLES << ")\n"
+                << "  --batch N           maximum number of tiles per device launch (default " << DEF_BATCH << ", 1 disables batching)\n"
+                << "  --memory MB         tile cache in RAM (default " << (TILE_MEMORY >> 20) << ")\n"
+                << "  --disk MB           tile cache on disk (default " << (TILE_DISK >> 20) << ", 0 disables it)\n"
+                << "  --cpu               use the native backend instead of OpenCL\n"
+                << "  --multi             use all OpenCL devices and the native backend\n"
+                << "  --adaptive          adaptive supersampling (only edges get all samples)\n"
+                << "  --double            always iterate in double precision (no float for shallow views)\n"
+                << "Tiles are " << TILE_SIZE << "x" << TILE_SIZE << " pixels at /{z}/{x}/{y}.png?iter=N&samples=N,\n"
+                << "level 0 is the area (" << ROOT_X0 << ", " << ROOT_Y0 << ") to (" << ROOT_X1 << ", " << ROOT_Y1 << "). Statistics at /stats.\n";
+}
+
+int main(int argc, char** argv)
+{
+    mandelbrot::backend backend = mandelbrot::OPENCL;
+    int port = DEF_PORT;
+    uint64_t memory = TILE_MEMORY;
+    uint64_t disk = TILE_DISK;
+    bool adaptive = false;
+    bool single = true;
+    defIter = DEF_ITERATIONEN;
+    defSamples = DEF_SAMPLES;
+    batchTiles = DEF_BATCH;
+
+    // Auswerten der Argumente
+    for(int a = 1; a < argc; a++)
+    {
+        if(strcmp(argv[a], "--port") == 0 && a + 1 < argc)
+            port = atoi(argv[++a]);
+        else if(strcmp(argv[a], "--iter") == 0 && a + 1 < argc)
+            defIter = strtoul(argv[++a], nullptr, 10);
+        else if(strcmp(argv[a], "--samples") == 0 && a + 1 < argc)
+            defSamples = strtoul(argv[++a], nullptr, 10);
+        else if(strcmp(argv[a], "--batch") == 0 && a + 1 < argc)
+            batchTiles = strtoul(argv[++a], nullptr, 10);
+        else if(strcmp(argv[a], "--memory") == 0 && a + 1 < argc)
+            memory = strtoull(argv[++a], nullptr, 10) << 20;
+        else if(strcmp(argv[a], "--disk") == 0 && a + 1 < argc)
+            disk = strtoull(argv[++a], nullptr, 10) << 20;
+        else if(strcmp(argv[a], "--cpu") == 0)
+            backend = mandelbrot::NATIVE;
+        else if(strcmp(argv[a], "--multi") == 0)
+            backend = mandelbrot::MULTI;
+        else if(strcmp(argv[a], "--adaptive") == 0)
+            adaptive = true;
+        else if(strcmp(argv[a], "--double") == 0)
+            single = false;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if(port <= 0 || port > 65535 || batchTiles == 0 || defIter == 0 || defIter > SERVER_MAX_ITER
+       || defSamples == 0 || defSamples > SERVER_MAX_SAMPLES)
+    {
+        usage();
+        return 1;
+    }
+
+    // Nur auf localhost, die Viewer laufen auf dem selben Rechner oder über einen Proxy
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(server < 0 || bind(server, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(server, SOMAXCONN) != 0)
+    {
+        std::cerr << "Failed to listen on 127.0.0.1:" << port << "\n";
+        return 1;
+    }
+
+    brot = new mandelbrot(backend);
+    brot->setAdaptive(adaptive);
+    brot->setSingle(single);
+    formula = brot->getFormula();
+    // Der Buffer reicht für jeden Block, er hat höchstens batchTiles Kacheln
+    brot->createBuffer({ batchTiles * TILE_SIZE, TILE_SIZE });
+    tiles = new tileCache(mandelbrot::toDeep({ { ROOT_X0, ROOT_Y0 }, { ROOT_X1, ROOT_Y1 } }), { TILE_SIZE, TILE_SIZE }, memory, disk);
+
+    running = true;
+    startTime = now();
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    std::thread render(renderThread);
+    std::cout << "Serving tiles on http://127.0.0.1:" << port << "/{z}/{x}/{y}.png\n";
+
+    while(running)
+    {
+        // Alle 200 ms wird geprüft ob der Server beendet wird
+        pollfd p = { server, POLLIN, 0 };
+        if(poll(&p, 1, 200) <= 0)
+            continue;
+        int fd = accept(server, nullptr, nullptr);
+        if(fd < 0)
+            continue;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::unique_lock<std::mutex> guard(lock);
+        if(connections >= SERVER_MAX_CONNECTIONS)
+        {
+            rejected++;
+            guard.unlock();
+            respond(fd, "503 Service Unavailable", "text/plain", "too many connections\n", false);
+            close(fd);
+            continue;
+        }
+        connections++;
+        guard.unlock();
+        std::thread(connectionThread, fd).detach();
+    }
+    close(server);
+
+    // Die wartenden Kacheln werden noch gerechnet, dann schliessen die Verbindungen nach der Antwort
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        queued.notify_all();
+    }
+    render.join();
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while(connections > 0)
+            finished.wait(guard);
+    }
+    std::cout << stats();
+
+    brot->deleteBuffer();
+    delete brot;
+    delete tiles;
+    return 0;
+}
@@ -0,0 +1,354 @@
+/*  tilecache.cpp
+ * Name Kachel-Cache
+ * Speichert fertig gefärbte Kacheln fester Grösse in einem Quadtree: die Kacheln einer Ebene haben
+ * halb so grosse Pixel wie die der Ebene darüber, jede Kachel hat vier Kinder. Die zuletzt benutzten
+ * Kacheln liegen im RAM, verdrängte werden komprimiert auf die Disk geschrieben und von dort wieder
+ * gelesen (mmap). Bilder die auf dem Gitter der Kacheln liegen, werden aus dem Cache zusammengesetzt.
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#include "tilecache.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <algorithm>
+
+// Bytes der Pixel einer Kachel
+#define TILE_BYTES (TILE_SIZE * TILE_SIZE * sizeof(mandelbrot::color))
+// Erlaubte Abweichung vom Gitter in Pixeln (Rundung der Fläche in double)
+#define TILE_TOLERANCE 1e-3
+
+// Division die auch für negative Zahlen abrundet
+static int64_t floorDiv(int64_t a, int64_t b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/* Kopiert den Teil einer Kachel, der im Bild liegt, in das Bild
+ * @param ret Das Bild
+ * @param res Die Auflösung des Bildes
+ * @param g Die Lage des Bildes
+ * @param k Der Schlüssel der Kachel
+ * @param tile Die Pixel der Kachel
+ */
+static void blit(mandelbrot::color* ret, mandelbrot::res res, const tileCache::grid& g, const tileCache::key& k, const mandelbrot::color* tile)
+{
+    int64_t left = std::max(k.x * TILE_SIZE, g.x);
+    int64_t right = std::min((k.x + 1) * TILE_SIZE, g.x + (int64_t)res.x);
+    int64_t top = std::max(k.y * TILE_SIZE, g.y);
+    int64_t bottom = std::min((k.y + 1) * TILE_SIZE, g.y + (int64_t)res.y);
+
+    for(int64_t y = top; y < bottom; y++)
+        memcpy(ret + (y - g.y) * res.x + (left - g.x), tile + (y - k.y * TILE_SIZE) * TILE_SIZE + (left - k.x * TILE_SIZE),
+               (right - left) * sizeof(mandelbrot::color));
+}
+
+// Gibt die Bits eines double zurück (für den Hash und die Namen der Dateien)
+static uint64_t bits(double d)
+{
+    uint64_t b;
+    memcpy(&b, &d, sizeof(b));
+    return b;
+}
+
+size_t tileCache::hash::operator()(const key& k) const
+{
+    const mandelbrot::formula& f = k.formula;
+    uint64_t values[10] = { (uint64_t)k.level, (uint64_t)k.x, (uint64_t)k.y, (uint64_t)k.iter, (uint64_t)k.samples,
+                            (uint64_t)f.type, (uint64_t)f.power, (uint64_t)f.julia, bits(f.jx), bits(f.jy) };
+    uint64_t h = 0;
+
+    for(uint64_t v : values)
+        h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+tileCache::tileCache(const mandelbrot::deep& root, mandelbrot::res rootRes, uint64_t memory, uint64_t disk)
+{
+    _root = root;
+    _rootRes = rootRes;
+    _pixel = root.w / floatexp((double)rootRes.x);
+    _memoryTiles = std::max(memory / TILE_BYTES, (uint64_t)1);
+    _diskSize = 0;
+    _diskLimit = disk;
+    _scratch.resize(TILE_SIZE * TILE_SIZE);
+
+    // Ein eigenes Verzeichnis pro Prozess, die Kacheln hängen von den Einstellungen des Prozesses ab
+    std::string dir = disk > 0 ? mandelbrot::cacheDirectory() : "";
+    if(!dir.empty())
+    {
+        _dir = dir + "/tiles-" + std::to_string(getpid());
+        if(mkdir(_dir.c_str(), 0700) != 0 && errno != EEXIST)
+            _dir = "";
+    }
+}
+
+tileCache::~tileCache()
+{
+    if(_dir.empty())
+        return;
+    for(const key& k : _files)
+        remove(path(k).c_str());
+    rmdir(_dir.c_str());
+}
+
+std::string tileCache::path(const key& k) const
+{
+    const mandelbrot::formula& f = k.formula;
+    char name[192];
+    snprintf(name, sizeof(name), "/%d_%lld_%lld_%zu_%zu_%d_%u_%d_%016llx_%016llx.tile", k.level, (long long)k.x, (long long)k.y,
+             k.iter, k.samples, (int)f.type, f.power, (int)f.julia, (unsigned long long)bits(f.jx), (unsigned long long)bits(f.jy));
+    return _dir + name;
+}
+
+void tileCache::spill(const key& k, const std::vector<mandelbrot::color>& pixels)
+{
+    // Eine Kachel ändert sich nie, eine bereits geschriebene Datei bleibt gültig
+    if(_dir.empty() || _disk.count(k) > 0)
+        return;
+
+    uLongf size = compressBound(TILE_BYTES);
+    std::vector<Bytef> data(size);
+    if(compress2(data.data(), &size, (const Bytef*)pixels.data(), TILE_BYTES, Z_BEST_SPEED) != Z_OK)
+        return;
+
+    std::string p = path(k);
+    FILE* f = fopen(p.c_str(), "wb");
+    if(f == nullptr)
+        return;
+    bool ok = fwrite(data.data(), 1, size, f) == size;
+    ok = fclose(f) == 0 && ok;
+    if(!ok)
+    {
+        remove(p.c_str());
+        return;
+    }
+    _files.push_back(k);
+    _disk[k] = { (size_t)size, std::prev(_files.end()) };
+    _diskSize += size;
+
+    // Die ältesten Dateien werden gelöscht, bis der Cache wieder klein genug ist
+    while(_diskSize > _diskLimit && !_files.empty())
+    {
+        key old = _files.front();
+        _files.pop_front();
+        remove(path(old).c_str());
+        _diskSize -= _disk[old].size;
+        _disk.erase(old);
+    }
+}
+
+bool tileCache::load(const key& k, std::vector<mandelbrot::color>& pixels)
+{
+    auto found = _disk.find(k);
+    if(found == _disk.end())
+        return false;
+
+    int fd = open(path(k).c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    size_t size = found->second.size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+        return false;
+
+    pixels.resize(TILE_SIZE * TILE_SIZE);
+    uLongf length = TILE_BYTES;
+    bool ok = uncompress((Bytef*)pixels.data(), &length, (const Bytef*)data, size) == Z_OK && length == TILE_BYTES;
+    munmap(data, size);
+    return ok;
+}
+
+const mandelbrot::color* tileCache::insert(const key& k, std::vector<mandelbrot::color>& pixels)
+{
+    auto found = _memory.find(k);
+    if(found != _memory.end())
+    {
+        _lru.splice(_lru.begin(), _lru, found->second.use);
+        found->second.pixels.swap(pixels);
+        return found->second.pixels.data();
+    }
+
+    _lru.push_front(k);
+    entry& e = _memory[k];
+    e.pixels.swap(pixels);
+    e.use = _lru.begin();
+
+    // Die neue Kachel steht vorne und wird als letzte verdrängt
+    while(_memory.size() > _memoryTiles)
+    {
+        auto old = _memory.find(_lru.back());
+        spill(old->first, old->second.pixels);
+        _memory.erase(old);
+        _lru.pop_back();
+    }
+    return e.pixels.data();
+}
+
+const mandelbrot::color* tileCache::find(const key& k)
+{
+    auto found = _memory.find(k);
+    if(found != _memory.end())
+    {
+        _lru.splice(_lru.begin(), _lru, found->second.use);
+        return found->second.pixels.data();
+    }
+
+    std::vector<mandelbrot::color> pixels;
+    if(!load(k, pixels))
+        return nullptr;
+    return insert(k, pixels);
+}
+
+bool tileCache::placeholder(const key& k)
+{
+    const int half = TILE_SIZE / 2;
+
+    // Die vier Kinder sind schärfer, jedes füllt ein Viertel mit jedem zweiten Pixel
+    int children = 0;
+    for(int c = 0; c < 4 && k.level < TILE_MAX_LEVEL; c++)
+    {
+        key child = { k.level + 1, 2*k.x + (c & 1), 2*k.y + (c >> 1), k.iter, k.samples, k.formula };
+        const mandelbrot::color* tile = find(child);
+        if(tile == nullptr)
+            break;
+        for(int y = 0; y < half; y++)
+            for(int x = 0; x < half; x++)
+                _scratch[((c >> 1)*half + y) * TILE_SIZE + (c & 1)*half + x] = tile[2*y * TILE_SIZE + 2*x];
+        children++;
+    }
+    if(children == 4)
+        return true;
+
+    // Sonst die nächste Kachel darüber, jedes ihrer Pixel wird 2^d mal vergrössert
+    for(int d = 1; d <= TILE_PARENT_LEVELS && d <= k.level; d++)
+    {
+        key parent = { k.level - d, floorDiv(k.x, 1LL << d), floorDiv(k.y, 1LL << d), k.iter, k.samples, k.formula };
+        const mandelbrot::color* tile = find(parent);
+        if(tile == nullptr)
+            continue;
+        int64_t ox = (k.x - parent.x * (1LL << d)) * TILE_SIZE >> d;
+        int64_t oy = (k.y - parent.y * (1LL << d)) * TILE_SIZE >> d;
+        for(int y = 0; y < TILE_SIZE; y++)
+            for(int x = 0; x < TILE_SIZE; x++)
+                _scratch[y * TILE_SIZE + x] = tile[(oy + (y >> d)) * TILE_SIZE + ox + (x >> d)];
+        return true;
+    }
+    return false;
+}
+
+bool tileCache::align(const mandelbrot::deep& area, mandelbrot::res res, tileCache::grid& g) const
+{
+    floatexp dx = area.w / floatexp((double)res.x);
+    floatexp dy = -area.h / floatexp((double)res.y);
+    double level = (_pixel / dx).log2();
+    long l = lround(level);
+
+    // Quadratische Pixel, genau 2^l mal kleiner als die der Wurzel
+    if(fabs(level - l) > 1e-9 || l < 0 || l > TILE_MAX_LEVEL || fabs((dy / dx).toDouble() - 1) > 1e-9)
+        return false;
+
+    // Das Pixel oben links, relativ zur linken oberen Ecke der Wurzel
+    floatexp p = _pixel * floatexp(1.0, -l);
+    double scale = ldexp(1.0, l);
+    double x = ((area.x - _root.x).toFloatexp() / p).toDouble() + _rootRes.x * scale / 2 - res.x / 2.0;
+    double y = ((_root.y - area.y).toFloatexp() / p).toDouble() + _rootRes.y * scale / 2 - res.y / 2.0;
+    if(fabs(x - round(x)) > TILE_TOLERANCE || fabs(y - round(y)) > TILE_TOLERANCE)
+        return false;
+
+    g.level = l;
+    g.x = llround(x);
+    g.y = llround(y);
+    return true;
+}
+
+mandelbrot::deep tileCache::tileArea(const key& k, size_t w, size_t h) const
+{
+    mandelbrot::deep area;
+    floatexp p = _pixel * floatexp(1.0, -k.level);
+    double scale = ldexp(1.0, k.level);
+
+    // Die Mitte des Blocks in Pixeln relativ zur Mitte der Wurzel, y wächst nach unten
+    double cx = (k.x + w / 2.0) * TILE_SIZE - _rootRes.x * scale / 2;
+    double cy = (k.y + h / 2.0) * TILE_SIZE - _rootRes.y * scale / 2;
+    size_t limbs = bigfloat::limbsFor(p);
+
+    area.w = p * floatexp((double)(w * TILE_SIZE));
+    area.h = -p * floatexp((double)(h * TILE_SIZE));
+    area.x = _root.x;
+    area.y = _root.y;
+    area.x.setLimbs(limbs);
+    area.y.setLimbs(limbs);
+    area.x = area.x + p * floatexp(cx);
+    area.y = area.y + p * floatexp(-cy);
+    return area;
+}
+
+void tileCache::put(const key& k, const mandelbrot::color* tile)
+{
+    std::vector<mandelbrot::color> pixels(tile, tile + TILE_SIZE * TILE_SIZE);
+    insert(k, pixels);
+}
+
+bool tileCache::get(const key& k, mandelbrot::color* tile)
+{
+    const mandelbrot::color* found = find(k);
+    if(found == nullptr)
+        return false;
+    memcpy(tile, found, TILE_BYTES);
+    return true;
+}
+
+size_t tileCache::assemble(mandelbrot::color* ret, mandelbrot::res res, const tileCache::grid& g, size_t iter, size_t samples,
+                           const mandelbrot::formula& f, std::vector<tileCache::key>& missing)
+{
+    size_t drawn = 0;
+
+    for(int64_t ty = floorDiv(g.y, TILE_SIZE); ty <= floorDiv(g.y + res.y - 1, TILE_SIZE); ty++)
+    {
+        for(int64_t tx = floorDiv(g.x, TILE_SIZE); tx <= floorDiv(g.x + res.x - 1, TILE_SIZE); tx++)
+        {
+            key k = { g.level, tx, ty, iter, samples, f };
+            const mandelbrot::color* tile = find(k);
+            if(tile == nullptr)
+            {
+                missing.push_back(k);
+                if(!placeholder(k))
+                    continue;
+                tile = _scratch.data();
+            }
+            blit(ret, res, g, k, tile);
+            drawn++;
+        }
+    }
+    return drawn;
+}
+
+size_t tileCache::store(const mandelbrot::color* image, mandelbrot::res res, const tileCache::grid& g, size_t iter, size_t samples,
+                        const mandelbrot::formula& f)
+{
+    size_t stored = 0;
+
+    // Nur Kacheln die ganz im Bild liegen
+    for(int64_t ty = floorDiv(g.y + TILE_SIZE - 1, TILE_SIZE); (ty + 1) * TILE_SIZE <= g.y + (int64_t)res.y; ty++)
+    {
+        for(int64_t tx = floorDiv(g.x + TILE_SIZE - 1, TILE_SIZE); (tx + 1) * TILE_SIZE <= g.x + (int64_t)res.x; tx++)
+        {
+            key k = { g.level, tx, ty, iter, samples, f };
+            for(int y = 0; y < TILE_SIZE; y++)
+                memcpy(_scratch.data() + y * TILE_SIZE, image + (ty * TILE_SIZE + y - g.y) * res.x + (tx * TILE_SIZE - g.x),
+                       TILE_SIZE * sizeof(mandelbrot::color));
+            put(k, _scratch.data());
+            stored++;
+        }
+    }
+    return stored;
+}
@@ -0,0 +1,195 @@
+/*  tilecache.hpp
+ * Name Kachel-Cache
+ * Speichert fertig gefärbte Kacheln fester Grösse in einem Quadtree: die Kacheln einer Ebene haben
+ * halb so grosse Pixel wie die der Ebene darüber, jede Kachel hat vier Kinder. Die zuletzt benutzten
+ * Kacheln liegen im RAM, verdrängte werden komprimiert auf die Disk geschrieben und von dort wieder
+ * gelesen (mmap). Bilder die auf dem Gitter der Kacheln liegen, werden aus dem Cache zusammengesetzt.
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#ifndef TILECACHE_HPP
+#define TILECACHE_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "mandelbrot.hpp"
+
+// Kantenlänge einer Kachel in Pixeln
+#define TILE_SIZE 128
+// Tiefste Ebene, darunter reicht double nicht mehr sicher für die Position der Kacheln
+#define TILE_MAX_LEVEL 32
+// Anzahl Ebenen nach oben, in denen eine Kachel als Platzhalter gesucht wird
+#define TILE_PARENT_LEVELS 4
+// Standardgrösse des Caches im RAM und auf der Disk in Bytes
+#define TILE_MEMORY (256ULL << 20)
+#define TILE_DISK (1024ULL << 20)
+
+class tileCache
+{
+public:
+    // Schlüssel einer Kachel
+    struct key
+    {
+        int level;          // Die Ebene, Pixel sind 2^level mal kleiner als die der Wurzel
+        int64_t x;          // Position in Kacheln (x), 0 beginnt an der linken Kante der Wurzel
+        int64_t y;          // Position in Kacheln (y), 0 beginnt an der oberen Kante der Wurzel
+        size_t iter;        // Die maximale Anzahl an Iterationen
+        size_t samples;     // Die Anzahl Samples pro Pixel
+        mandelbrot::formula formula;    // Die Formel (siehe mandelbrot::getFormula)
+
+        bool operator==(const key& o) const
+        {
+            return level == o.level && x == o.x && y == o.y && iter == o.iter && samples == o.samples && formula == o.formula;
+        }
+    };
+    // Lage eines Bildes auf dem Gitter der Kacheln (siehe align)
+    struct grid
+    {
+        int level;          // Die Ebene
+        int64_t x;          // Das Pixel oben links auf der Ebene (x)
+        int64_t y;          // Das Pixel oben links auf der Ebene (y)
+    };
+
+private:
+    struct hash
+    {
+        size_t operator()(const key& k) const;
+    };
+    // Eine Kachel im RAM
+    struct entry
+    {
+        std::vector<mandelbrot::color> pixels;  // TILE_SIZE² Pixel
+        std::list<key>::iterator use;           // Position in _lru
+    };
+    // Eine Kachel auf der Disk
+    struct file
+    {
+        size_t size;                            // Grösse der komprimierten Datei
+        std::list<key>::iterator age;           // Position in _files
+    };
+
+    mandelbrot::deep _root;         // Die Fläche der Wurzel (Ebene 0)
+    mandelbrot::res _rootRes;       // Die Auflösung der Wurzel
+    floatexp _pixel;                // Grösse eines Pixels der Wurzel
+    std::list<key> _lru;            // Die Kacheln im RAM, zuletzt benutzte zuerst
+    std::unordered_map<key, entry, hash> _memory;   // Die Kacheln im RAM
+    size_t _memoryTiles;            // Maximale Anzahl Kacheln im RAM
+    std::list<key> _files;          // Die Kacheln auf der Disk, älteste zuerst
+    std::unordered_map<key, file, hash> _disk;      // Die Kacheln auf der Disk
+    uint64_t _diskSize;             // Summe der Grössen in _disk
+    uint64_t _diskLimit;            // Maximale Summe der Grössen in _disk
+    std::string _dir;               // Verzeichnis der Dateien ("" falls es keine Disk-Stufe gibt)
+    std::vector<mandelbrot::color> _scratch;    // Buffer einer Kachel für Platzhalter und store
+
+    // Gibt den Pfad der Datei einer Kachel zurück
+    std::string path(const key& k) const;
+
+    /* Schreibt eine Kachel komprimiert auf die Disk und löscht bei Bedarf die ältesten Dateien
+     * @param k Der Schlüssel
+     * @param pixels Die Pixel der Kachel
+     */
+    void spill(const key& k, const std::vector<mandelbrot::color>& pixels);
+
+    /* Liest eine Kachel von der Disk (die Datei wird mit mmap gelesen)
+     * @param k Der Schlüssel
+     * @param pixels Die Pixel der Kachel
+     * @return false falls die Kachel nicht auf der Disk ist
+     */
+    bool load(const key& k, std::vector<mandelbrot::color>& pixels);
+
+    /* Fügt eine Kachel in den RAM ein und verdrängt die am längsten nicht benutzten auf die Disk
+     * @param k Der Schlüssel
+     * @param pixels Die Pixel der Kachel (werden übernommen)
+     * @return Die Pixel im Cache
+     */
+    const mandelbrot::color* insert(const key& k, std::vector<mandelbrot::color>& pixels);
+
+    /* Sucht eine Kachel im RAM, dann auf der Disk. Der Zeiger gilt nur bis zum nächsten Aufruf.
+     * @param k Der Schlüssel
+     * @return Die Pixel der Kachel (nullptr falls sie nicht im Cache ist)
+     */
+    const mandelbrot::color* find(const key& k);
+
+    /* Erstellt einen Platzhalter für eine fehlende Kachel aus der nächsten Kachel darüber (jedes
+     * Pixel vergrössert) und aus den Kindern (jedes zweite Pixel) in _scratch
+     * @param k Der Schlüssel der fehlenden Kachel
+     * @return false falls es keine Kachel dafür gibt
+     */
+    bool placeholder(const key& k);
+
+public:
+    /* Der Konstruktor legt das Gitter fest. Die Dateien der Disk-Stufe liegen in einem eigenen
+     * Verzeichnis im Cache (siehe mandelbrot::cacheDirectory) und gelten nur für diesen Prozess.
+     * @param root Die Fläche der Wurzel (Ebene 0)
+     * @param rootRes Die Auflösung der Wurzel, die Pixel müssen quadratisch sein
+     * @param memory Die maximale Grösse im RAM in Bytes
+     * @param disk Die maximale Grösse auf der Disk in Bytes (0 ohne Disk-Stufe)
+     */
+    tileCache(const mandelbrot::deep& root, mandelbrot::res rootRes, uint64_t memory = TILE_MEMORY, uint64_t disk = TILE_DISK);
+    // Der Destructor löscht die Dateien der Disk-Stufe
+    ~tileCache();
+
+    /* Prüft ob ein Bild auf dem Gitter liegt: seine Pixel sind genau die einer Ebene, bis auf eine
+     * Verschiebung um ganze Pixel. Das gilt z.B. für die Wurzel, nach Verschieben um ganze Pixel und
+     * nach Zoomen um Faktor 2 um die Mitte.
+     * @param area Die Fläche des Bildes
+     * @param res Die Auflösung des Bildes
+     * @param g Die Lage auf dem Gitter (falls true zurückgegeben wird)
+     * @return false falls das Bild nicht auf dem Gitter liegt
+     */
+    bool align(const mandelbrot::deep& area, mandelbrot::res res, tileCache::grid& g) const;
+
+    /* Gibt die Fläche eines Blocks von Kacheln zurück (für mandelbrot::computeImage mit w·TILE_SIZE mal
+     * h·TILE_SIZE Pixeln). Das Bild liegt mit der Lage { k.level, k.x·TILE_SIZE, k.y·TILE_SIZE } auf dem Gitter.
+     * @param k Der Schlüssel der Kachel oben links
+     * @param w Die Anzahl Kacheln nebeneinander
+     * @param h Die Anzahl Kacheln untereinander
+     */
+    mandelbrot::deep tileArea(const key& k, size_t w = 1, size_t h = 1) const;
+
+    /* Kopiert eine Kachel aus dem Cache
+     * @param k Der Schlüssel
+     * @param tile Die TILE_SIZE² Pixel der Kachel
+     * @return false falls die Kachel nicht im Cache ist
+     */
+    bool get(const key& k, mandelbrot::color* tile);
+
+    /* Speichert eine Kachel
+     * @param k Der Schlüssel
+     * @param tile Die TILE_SIZE² Pixel der Kachel
+     */
+    void put(const key& k, const mandelbrot::color* tile);
+
+    /* Setzt ein Bild aus den Kacheln zusammen. Fehlende Kacheln werden mit Platzhaltern aus anderen
+     * Ebenen gefüllt, falls es welche gibt, sonst bleiben ihre Pixel unverändert.
+     * @param ret Das Bild
+     * @param res Die Auflösung des Bildes
+     * @param g Die Lage des Bildes (siehe align)
+     * @param iter Die maximale Anzahl an Iterationen
+     * @param samples Die Anzahl Samples pro Pixel
+     * @param f Die Formel
+     * @param missing Die Schlüssel der fehlenden Kacheln
+     * @return Die Anzahl gezeichneter Kacheln (mit Platzhaltern)
+     */
+    size_t assemble(mandelbrot::color* ret, mandelbrot::res res, const tileCache::grid& g, size_t iter, size_t samples,
+                    const mandelbrot::formula& f, std::vector<tileCache::key>& missing);
+
+    /* Speichert alle Kacheln, die ganz in einem fertigen Bild liegen
+     * @param image Das Bild
+     * @param res Die Auflösung des Bildes
+     * @param g Die Lage des Bildes (siehe align)
+     * @param iter Die maximale Anzahl an Iterationen
+     * @param samples Die Anzahl Samples pro Pixel
+     * @param f Die Formel
+     * @return Die Anzahl gespeicherter Kacheln
+     */
+    size_t store(const mandelbrot::color* image, mandelbrot::res res, const tileCache::grid& g, size_t iter, size_t samples,
+                 const mandelbrot::formula& f);
+};
+
+#endif
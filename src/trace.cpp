@@ -0,0 +1,159 @@
+/*  trace.cpp
+ * Name Trace-Modul
+ * Sammelt die Zeiten der einzelnen Schritte jedes Bildes (auf dem Host und auf dem OpenCL-Device)
+ * und Zähler, und schreibt sie als Chrome-Trace (JSON, lesbar mit Perfetto oder chrome://tracing).
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#include "trace.hpp"
+#include <stdio.h>
+#include <chrono>
+
+/* Schreibt einen String für JSON, mit Escapes für Anführungszeichen, Backslash und Steuerzeichen
+ * @param file Die Datei
+ * @param s Der String
+ */
+static void writeString(FILE* file, const std::string& s)
+{
+    fputc('"', file);
+    for(char c : s)
+    {
+        if(c == '"' || c == '\\')
+            fprintf(file, "\\%c", c);
+        else if((unsigned char)c < 0x20)
+            fprintf(file, "\\u%04x", c);
+        else
+            fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+trace::trace()
+{
+    _start = now();
+}
+
+int64_t trace::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int trace::threadTrack(const char* name)
+{
+    std::thread::id id = std::this_thread::get_id();
+    auto found = _threads.find(id);
+    if(found != _threads.end())
+        return found->second;
+
+    int t = _tracks.size();
+    _tracks.push_back(name != nullptr ? name : "thread " + std::to_string(t));
+    _threads[id] = t;
+    return t;
+}
+
+void trace::add(const event& e)
+{
+    if(_events.size() >= TRACE_MAX_EVENTS)
+        _events.pop_front();
+    _events.push_back(e);
+}
+
+int trace::track(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    _tracks.push_back(name);
+    return _tracks.size() - 1;
+}
+
+void trace::nameThread(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    _tracks[threadTrack(name.c_str())] = name;
+}
+
+void trace::span(const char* name, const char* category, int64_t start, int64_t end, int track)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    if(track < 0)
+        track = threadTrack(nullptr);
+    add({ 'X', name, category, track, start, end - start, trace::values() });
+    _current[std::string(category) + "/" + name] += (end - start) / 1e6;
+}
+
+void trace::counter(const char* name, int64_t time, const trace::values& v)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    add({ 'C', name, "counter", 0, time, 0, v });
+    for(const auto& value : v)
+        _current[std::string(name) + "/" + value.first] = value.second;
+}
+
+void trace::endFrame()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    _last.swap(_current);
+    _current.clear();
+}
+
+double trace::last(const std::string& key) const
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    auto found = _last.find(key);
+    return found != _last.end() ? found->second : 0;
+}
+
+bool trace::write(const char* path) const
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    FILE* file = fopen(path, "w");
+    if(file == nullptr)
+        return false;
+
+    // Zeiten in Mikrosekunden seit der Erstellung, eine Spur ist ein Thread des Prozesses 1
+    const char* separator = "";
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for(size_t t = 0; t < _tracks.size(); t++)
+    {
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":", separator, t);
+        writeString(file, _tracks[t]);
+        fprintf(file, "}}");
+        separator = ",";
+    }
+    for(const event& e : _events)
+    {
+        fprintf(file, "%s\n{\"name\":", separator);
+        writeString(file, e.name);
+        fprintf(file, ",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f", e.category, e.phase, e.track, (e.start - _start) / 1e3);
+        if(e.phase == 'X')
+            fprintf(file, ",\"dur\":%.3f", e.duration / 1e3);
+        else
+        {
+            fprintf(file, ",\"args\":{");
+            for(size_t a = 0; a < e.args.size(); a++)
+            {
+                writeString(file, e.args[a].first);
+                fprintf(file, ":%.17g%s", e.args[a].second, a + 1 < e.args.size() ? "," : "");
+            }
+            fprintf(file, "}");
+        }
+        fprintf(file, "}");
+        separator = ",";
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
+traceScope::traceScope(trace* t, const char* name, const char* category)
+{
+    _trace = t;
+    _name = name;
+    _category = category;
+    _start = t != nullptr ? trace::now() : 0;
+}
+
+traceScope::~traceScope()
+{
+    if(_trace != nullptr)
+        _trace->span(_name, _category, _start, trace::now());
+}
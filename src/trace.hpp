@@ -0,0 +1,123 @@
+/*  trace.hpp
+ * Name Trace-Modul
+ * Sammelt die Zeiten der einzelnen Schritte jedes Bildes (auf dem Host und auf dem OpenCL-Device)
+ * und Zähler, und schreibt sie als Chrome-Trace (JSON, lesbar mit Perfetto oder chrome://tracing).
+ * Autor: Roland Bernard
+ * Lizenz: (C) Copyright 2018 by Roland Bernard. All rights reserved.
+ * */
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Maximale Anzahl gespeicherter Einträge, danach werden die ältesten verworfen
+#define TRACE_MAX_EVENTS 1000000
+
+class trace
+{
+public:
+    // Werte eines Zählers (Name und Wert)
+    typedef std::vector<std::pair<std::string, double> > values;
+
+private:
+    // Ein Eintrag des Traces
+    struct event
+    {
+        char phase;             // 'X' für eine Dauer, 'C' für Zähler
+        std::string name;       // Der Name des Schrittes oder Zählers
+        const char* category;   // Die Kategorie ("host", "device", "viewer")
+        int track;              // Die Spur (Thread oder Device)
+        int64_t start;          // Beginn in Nanosekunden der steady_clock
+        int64_t duration;       // Dauer in Nanosekunden (0 bei Zählern)
+        trace::values args;     // Die Werte der Zähler
+    };
+
+    mutable std::mutex _lock;                   // Schützt alle folgenden Felder
+    int64_t _start;                             // Erstellung des Traces, Nullpunkt der Zeiten in der Datei
+    std::deque<event> _events;                  // Die Einträge, höchstens TRACE_MAX_EVENTS
+    std::vector<std::string> _tracks;           // Die Namen der Spuren, der Index ist die Spur
+    std::map<std::thread::id, int> _threads;    // Die Spur jedes Threads
+    std::map<std::string, double> _current;     // Summen des laufenden Bildes (siehe endFrame)
+    std::map<std::string, double> _last;        // Summen des letzten Bildes
+
+    /* Gibt die Spur des aufrufenden Threads zurück und erstellt sie falls nötig. _lock muss gesperrt sein.
+     * @param name Der Name einer neuen Spur (nullptr für "thread N")
+     */
+    int threadTrack(const char* name);
+
+    // Fügt einen Eintrag hinzu, _lock muss gesperrt sein
+    void add(const event& e);
+
+public:
+    // Der Konstruktor setzt den Nullpunkt der Zeiten
+    trace();
+
+    // Gibt die Zeit der steady_clock in Nanosekunden zurück
+    static int64_t now();
+
+    /* Erstellt eine eigene Spur, z.B. für die Befehle auf einem OpenCL-Device
+     * @param name Der Name der Spur
+     * @return Die Spur für span
+     */
+    int track(const std::string& name);
+
+    /* Benennt die Spur des aufrufenden Threads
+     * @param name Der Name (z.B. "calculation")
+     */
+    void nameThread(const std::string& name);
+
+    /* Speichert die Dauer eines Schrittes. Die Dauer wird zur Summe des laufenden Bildes addiert,
+     * unter "category/name" in Millisekunden (siehe last).
+     * @param name Der Name des Schrittes
+     * @param category Die Kategorie
+     * @param start Beginn (siehe now)
+     * @param end Ende (siehe now)
+     * @param track Die Spur (-1 für den aufrufenden Thread)
+     */
+    void span(const char* name, const char* category, int64_t start, int64_t end, int track = -1);
+
+    /* Speichert die Werte eines Zählers, sie gelten im laufenden Bild als "name/wert"
+     * @param name Der Name des Zählers
+     * @param time Der Zeitpunkt (siehe now)
+     * @param v Die Werte
+     */
+    void counter(const char* name, int64_t time, const trace::values& v);
+
+    // Beendet das laufende Bild, seine Summen sind danach mit last abrufbar
+    void endFrame();
+
+    /* Gibt einen Wert des letzten Bildes zurück (0 falls es keinen gibt)
+     * @param key "category/name" eines Schrittes (Millisekunden) oder "name/wert" eines Zählers
+     */
+    double last(const std::string& key) const;
+
+    /* Schreibt alle Einträge als Chrome-Trace (JSON)
+     * @param path Der Pfad der Datei
+     * @return false falls die Datei nicht geschrieben werden konnte
+     */
+    bool write(const char* path) const;
+};
+
+// Misst die Dauer eines Blocks als Schritt in der Spur des Threads (nichts falls kein Trace)
+class traceScope
+{
+private:
+    trace* _trace;
+    const char* _name;
+    const char* _category;
+    int64_t _start;
+
+public:
+    traceScope(trace* t, const char* name, const char* category = "host");
+    ~traceScope();
+};
+
+#endif